@@ -0,0 +1,256 @@
+/*
+ * Image arena check: runs main/image_arena.c on the host shim.
+ *
+ * A randomized sequence of ring allocations and frees, in order and out of order, is checked against a model of the
+ * live blocks: blocks must not overlap, keep their contents and be reclaimed once all of them are freed. Blocks
+ * cycling behind a pinned block, blocks freed out of order behind a live one, slots and `image_arena_reset()` are
+ * checked too.
+ *
+ *   build/image_arena_check [--rounds <n>] [--seed <n>]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "image_arena.h"
+
+static const char *TAG = "arena_check";
+
+#define MAX_LIVE            16
+
+typedef struct {
+    uint8_t *ptr;
+    size_t size;
+    uint8_t fill;
+} live_block_t;
+
+static struct {
+    uint32_t rounds;
+    unsigned seed;
+} s_config = {
+    .rounds = 20000,
+    .seed = 1,
+};
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...) do {                           \
+        if (!(cond)) {                                  \
+            ESP_LOGE(TAG, __VA_ARGS__);                 \
+            s_failures++;                               \
+        }                                               \
+    } while (0)
+
+static bool overlaps(const live_block_t *a, const live_block_t *b)
+{
+    return a->ptr < b->ptr + b->size && b->ptr < a->ptr + a->size;
+}
+
+static bool contents_ok(const live_block_t *b)
+{
+    for (size_t i = 0; i < b->size; i++) {
+        if (b->ptr[i] != b->fill) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void check_empty(const char *step)
+{
+    image_arena_usage_t usage;
+    image_arena_get_usage(&usage);
+    CHECK(usage.ring_used == 0 && usage.ring_blocks == 0, "%s: %u bytes in %lu blocks still held", step,
+          (unsigned)usage.ring_used, (unsigned long)usage.ring_blocks);
+
+    // Everything reclaimed: the largest block fits again
+    void *all = image_arena_alloc(usage.ring_size - IMAGE_ARENA_ALIGN);
+    CHECK(all, "%s: ring not reclaimed", step);
+    image_arena_free(all);
+}
+
+static void check_ring_random(void)
+{
+    image_arena_usage_t usage;
+    image_arena_get_usage(&usage);
+    live_block_t live[MAX_LIVE];
+    int n = 0;
+    uint32_t allocs = 0, failures = 0;
+
+    for (uint32_t round = 0; round < s_config.rounds; round++) {
+        uint8_t *ptr = NULL;
+        size_t size = 0;
+        if (n < MAX_LIVE && (n == 0 || rand() % 2 != 0)) {
+            // Mostly photo sized blocks, some large ones to force wrapping and failures
+            size = (rand() % 8 == 0) ? 1 + rand() % (usage.ring_size / 3) : 1 + rand() % 200000;
+            ptr = image_arena_alloc(size);
+            failures += !ptr;
+        }
+        if (ptr) {
+            CHECK(((uintptr_t)ptr % IMAGE_ARENA_ALIGN) == 0, "round %lu: %p not aligned", (unsigned long)round, ptr);
+            live_block_t b = { .ptr = ptr, .size = size, .fill = (uint8_t)rand() };
+            for (int i = 0; i < n; i++) {
+                CHECK(!overlaps(&b, &live[i]), "round %lu: block %p+%u overlaps %p+%u", (unsigned long)round,
+                      b.ptr, (unsigned)b.size, live[i].ptr, (unsigned)live[i].size);
+            }
+            memset(ptr, b.fill, size);
+            live[n++] = b;
+            allocs++;
+        } else if (n > 0) {
+            // Oldest first most of the time, like the slideshow, otherwise any block
+            const int i = (rand() % 4 != 0) ? 0 : rand() % n;
+            CHECK(contents_ok(&live[i]), "round %lu: block %p+%u overwritten", (unsigned long)round, live[i].ptr,
+                  (unsigned)live[i].size);
+            image_arena_free(live[i].ptr);
+            memmove(&live[i], &live[i + 1], (n - i - 1) * sizeof(live[0]));
+            n--;
+        }
+    }
+    while (n > 0) {
+        const int i = rand() % n;
+        CHECK(contents_ok(&live[i]), "end: block %p+%u overwritten", live[i].ptr, (unsigned)live[i].size);
+        image_arena_free(live[i].ptr);
+        live[i] = live[--n];
+    }
+    check_empty("random");
+    printf("ring: %lu allocations, %lu did not fit\n", (unsigned long)allocs, (unsigned long)failures);
+}
+
+// Two in-flight blocks, freed in order behind a preloaded block that stays, like the slides read on demand
+static void check_pinned(void)
+{
+    image_arena_usage_t usage;
+    image_arena_get_usage(&usage);
+    const size_t preload_size = usage.ring_size / 4;
+    uint8_t *preloaded = image_arena_alloc(preload_size);
+    CHECK(preloaded && image_arena_pin() == ESP_OK, "pinned: preload failed");
+
+    // Two blocks fit above the preloaded one, a third one never does
+    const size_t size = (usage.ring_size - image_arena_block_size(preload_size)) * 2 / 5;
+    uint8_t *in_flight[2] = { image_arena_alloc(size), image_arena_alloc(size) };
+    uint32_t failures = 0;
+    for (uint32_t round = 0; round < s_config.rounds; round++) {
+        // The oldest slide is done, its job reads the next one
+        image_arena_free(in_flight[round % 2]);
+        in_flight[round % 2] = image_arena_alloc(size);
+        failures += !in_flight[round % 2];
+    }
+    CHECK(failures == 0, "pinned: %lu of %lu allocations failed", (unsigned long)failures,
+          (unsigned long)s_config.rounds);
+    image_arena_free(in_flight[0]);
+    image_arena_free(in_flight[1]);
+
+    image_arena_get_usage(&usage);
+    CHECK(usage.ring_blocks == 1 && usage.ring_used == image_arena_block_size(preload_size),
+          "pinned: %u bytes in %lu blocks held, expected the preloaded block only", (unsigned)usage.ring_used,
+          (unsigned long)usage.ring_blocks);
+    image_arena_free(preloaded);
+    check_empty("pinned");
+}
+
+// Blocks freed out of order behind a live block come back once the newest one is freed
+static void check_head_reclaim(void)
+{
+    image_arena_usage_t usage;
+    image_arena_get_usage(&usage);
+    const size_t preload_size = usage.ring_size / 4;
+    uint8_t *preloaded = image_arena_alloc(preload_size);
+    const size_t size = (usage.ring_size - image_arena_block_size(preload_size)) * 2 / 5;
+
+    for (uint32_t round = 0; round < s_config.rounds / 100; round++) {
+        uint8_t *a = image_arena_alloc(size);
+        uint8_t *b = image_arena_alloc(size);
+        CHECK(a && b, "head: round %lu: allocation failed", (unsigned long)round);
+        image_arena_free(a);
+        image_arena_free(b);
+    }
+    image_arena_get_usage(&usage);
+    CHECK(usage.ring_blocks == 1, "head: %lu blocks held, expected the preloaded block only",
+          (unsigned long)usage.ring_blocks);
+
+    // All the space above the live block is back in one piece
+    uint8_t *rest = image_arena_alloc(usage.ring_size - image_arena_block_size(preload_size) - IMAGE_ARENA_ALIGN);
+    CHECK(rest, "head: space above the live block not reclaimed");
+    image_arena_free(rest);
+    image_arena_free(preloaded);
+    check_empty("head");
+}
+
+static void check_slots_and_reset(void)
+{
+    image_arena_usage_t usage;
+    image_arena_get_usage(&usage);
+    if (usage.slots == 0) {
+        return;
+    }
+
+    int slot = -1;
+    uint8_t *frame = image_arena_slot_acquire(&slot);
+    CHECK(frame && slot >= 0, "no slot");
+    if (!frame) {
+        return;
+    }
+    memset(frame, 0x5a, usage.slot_size);
+    CHECK(image_arena_alloc(1000) != NULL, "ring allocation failed");
+
+    // An album change while the frame is on screen: the ring is dropped, the slot stays acquired
+    image_arena_reset();
+    image_arena_get_usage(&usage);
+    CHECK(usage.slots_used == 1, "reset released the slot on screen (%lu used)", (unsigned long)usage.slots_used);
+    check_empty("reset");
+
+    int others[32];
+    uint32_t acquired = 0;
+    while (acquired < 32 && image_arena_slot_acquire(&others[acquired])) {
+        CHECK(others[acquired] != slot, "slot %d handed out twice", slot);
+        acquired++;
+    }
+    CHECK(acquired == usage.slots - 1, "%lu slots free after reset, expected %lu", (unsigned long)acquired,
+          (unsigned long)(usage.slots - 1));
+    const live_block_t b = { .ptr = frame, .size = usage.slot_size, .fill = 0x5a };
+    CHECK(contents_ok(&b), "slot %d overwritten", slot);
+
+    for (uint32_t i = 0; i < acquired; i++) {
+        image_arena_slot_release(others[i]);
+    }
+    image_arena_slot_release(slot);
+    image_arena_get_usage(&usage);
+    CHECK(usage.slots_used == 0, "%lu slots still used", (unsigned long)usage.slots_used);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [--rounds <n>] [--seed <n>]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "rounds", required_argument, NULL, 'r' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:s:", options, NULL)) != -1) {
+        switch (opt) {
+        case 'r': s_config.rounds = strtoul(optarg, NULL, 0); break;
+        case 's': s_config.seed = strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    srand(s_config.seed);
+
+    if (image_arena_init() != ESP_OK) {
+        return 1;
+    }
+    check_ring_random();
+    check_pinned();
+    check_head_reclaim();
+    check_slots_and_reset();
+
+    printf("%s\n", s_failures ? "FAILED" : "OK");
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * Job pool check and benchmark: runs main/job_pool.c on the host shim.
+ *
+ * The checks run parallel loops of random sizes and grains, from several tasks at once and nested, and verify that
+ * every index is visited exactly once. The benchmark then times a box filter like photo_display_scale() with
+ * 1 to --workers workers against the same kernel run by the caller alone.
+ *
+ *   build/job_pool_bench [--workers <n>] [--rounds <n>] [--size <w>x<h>]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "job_pool.h"
+
+static const char *TAG = "job_bench";
+
+#define CALLERS             4       // Tasks running loops at the same time
+#define MAX_RANGE           5000
+#define BENCH_RUNS          5       // Best of
+
+static struct {
+    size_t workers;
+    uint32_t rounds;
+    uint32_t w, h;
+} s_config = {
+    .workers = 4,
+    .rounds = 2000,
+    .w = 1600,
+    .h = 960,
+};
+
+static uint32_t s_failures;
+
+/* Coverage: every index of a loop is counted once */
+
+typedef struct {
+    uint8_t hits[MAX_RANGE];
+    uint32_t seed;
+    uint32_t rounds;
+    bool nested;
+    SemaphoreHandle_t done;
+} cover_ctx_t;
+
+static uint32_t rand_next(uint32_t *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+static void cover_fn(uint32_t begin, uint32_t end, void *arg)
+{
+    cover_ctx_t *ctx = arg;
+    for (uint32_t i = begin; i < end; i++) {
+        __atomic_fetch_add(&ctx->hits[i], 1, __ATOMIC_RELAXED);
+    }
+}
+
+typedef struct {
+    cover_ctx_t *ctx;
+    uint32_t cols;
+} nested_arg_t;
+
+static void nested_cols(uint32_t begin, uint32_t end, void *arg)
+{
+    const nested_arg_t *a = arg;
+    cover_fn(begin, end, a->ctx);
+}
+
+// Each row runs an inner loop over its own columns
+static void nested_rows(uint32_t begin, uint32_t end, void *arg)
+{
+    const nested_arg_t *a = arg;
+    for (uint32_t row = begin; row < end; row++) {
+        job_pool_parallel_for(row * a->cols, (row + 1) * a->cols, 4, nested_cols, (void *)a);
+    }
+}
+
+static void cover_round(cover_ctx_t *ctx)
+{
+    const uint32_t begin = rand_next(&ctx->seed) % 100;
+    uint32_t end = begin + rand_next(&ctx->seed) % (MAX_RANGE - 100);
+    const uint32_t grain = 1 + rand_next(&ctx->seed) % 64;
+    memset(ctx->hits, 0, sizeof(ctx->hits));
+
+    if (ctx->nested) {
+        const uint32_t rows = 1 + rand_next(&ctx->seed) % 40;
+        nested_arg_t a = { .ctx = ctx, .cols = (end - begin) / rows + 1 };
+        end = rows * a.cols;
+        job_pool_parallel_for(0, rows, 1, nested_rows, &a);
+        for (uint32_t i = 0; i < end; i++) {
+            if (ctx->hits[i] != 1) {
+                ESP_LOGE(TAG, "Nested %u x %u: index %u visited %u times", (unsigned)rows, (unsigned)a.cols,
+                         (unsigned)i, ctx->hits[i]);
+                __atomic_fetch_add(&s_failures, 1, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+        return;
+    }
+
+    job_pool_parallel_for(begin, end, grain, cover_fn, ctx);
+    for (uint32_t i = 0; i < MAX_RANGE; i++) {
+        const uint8_t want = (i >= begin && i < end);
+        if (ctx->hits[i] != want) {
+            ESP_LOGE(TAG, "Loop %u..%u grain %u: index %u visited %u times", (unsigned)begin, (unsigned)end,
+                     (unsigned)grain, (unsigned)i, ctx->hits[i]);
+            __atomic_fetch_add(&s_failures, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+static void cover_task(void *arg)
+{
+    cover_ctx_t *ctx = arg;
+    for (uint32_t r = 0; r < ctx->rounds; r++) {
+        cover_round(ctx);
+    }
+    xSemaphoreGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+static void check_pool(size_t workers)
+{
+    ESP_ERROR_CHECK(job_pool_init(workers));
+
+    static cover_ctx_t ctx[CALLERS];
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(CALLERS, 0);
+    for (int i = 0; i < CALLERS; i++) {
+        ctx[i].seed = 1 + i * 7919 + (uint32_t)workers;
+        ctx[i].rounds = s_config.rounds;
+        ctx[i].nested = (i == CALLERS - 1);
+        ctx[i].done = done;
+        if (xTaskCreate(cover_task, "cover", 4096, &ctx[i], 1, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Can't create caller %d", i);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < CALLERS; i++) {
+        xSemaphoreTake(done, portMAX_DELAY);
+    }
+    vSemaphoreDelete(done);
+
+    job_pool_stats_t stats;
+    job_pool_get_stats(&stats, false);
+    printf("check %zu workers: %u loops (%u serial), %u ranges, %u stolen, %u unsplit\n", workers,
+           (unsigned)stats.loops, (unsigned)stats.serial, (unsigned)stats.ranges, (unsigned)stats.steals,
+           (unsigned)stats.deque_full);
+    job_pool_deinit();
+}
+
+/* Scaling: 4x4 box filter of an RGB565 picture, out of place */
+
+typedef struct {
+    const uint16_t *src;
+    uint16_t *dst;
+    uint32_t w, h;              // Source size, the destination is w/4 x h/4
+} box_job_t;
+
+static void box_rows(uint32_t begin, uint32_t end, void *arg)
+{
+    const box_job_t *job = arg;
+    const uint32_t dw = job->w / 4;
+    for (uint32_t y = begin; y < end; y++) {
+        for (uint32_t x = 0; x < dw; x++) {
+            uint32_t r = 0, g = 0, b = 0;
+            for (uint32_t sy = y * 4; sy < y * 4 + 4; sy++) {
+                const uint16_t *row = job->src + sy * job->w + x * 4;
+                for (uint32_t sx = 0; sx < 4; sx++) {
+                    r += row[sx] >> 11;
+                    g += (row[sx] >> 5) & 0x3F;
+                    b += row[sx] & 0x1F;
+                }
+            }
+            job->dst[y * dw + x] = (uint16_t)(((r / 16) << 11) | ((g / 16) << 5) | (b / 16));
+        }
+    }
+}
+
+static int64_t bench_once(const box_job_t *job)
+{
+    int64_t best = INT64_MAX;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        const int64_t start = esp_timer_get_time();
+        job_pool_parallel_for(0, job->h / 4, 8, box_rows, (void *)job);
+        const int64_t us = esp_timer_get_time() - start;
+        best = us < best ? us : best;
+    }
+    return best;
+}
+
+static void bench(void)
+{
+    const size_t px = (size_t)s_config.w * s_config.h;
+    uint16_t *src = malloc(px * sizeof(uint16_t));
+    uint16_t *ref = calloc(px / 16, sizeof(uint16_t));
+    uint16_t *dst = calloc(px / 16, sizeof(uint16_t));
+    if (!src || !ref || !dst) {
+        ESP_LOGE(TAG, "Out of memory");
+        exit(1);
+    }
+    uint32_t seed = 1;
+    for (size_t i = 0; i < px; i++) {
+        src[i] = (uint16_t)rand_next(&seed);
+    }
+
+    box_job_t job = { .src = src, .dst = ref, .w = s_config.w, .h = s_config.h };
+    const int64_t serial_us = bench_once(&job);     // Pool not started: the caller runs the whole loop
+    printf("\nbox filter %ux%u -> %ux%u\n", (unsigned)s_config.w, (unsigned)s_config.h,
+           (unsigned)s_config.w / 4, (unsigned)s_config.h / 4);
+    printf("workers  time_us  speedup\n");
+    printf("serial  %8lld     1.00\n", (long long)serial_us);
+
+    job.dst = dst;
+    for (size_t workers = 1; workers <= s_config.workers; workers++) {
+        ESP_ERROR_CHECK(job_pool_init(workers));
+        memset(dst, 0, px / 16 * sizeof(uint16_t));
+        const int64_t us = bench_once(&job);
+        job_pool_deinit();
+        if (memcmp(dst, ref, px / 16 * sizeof(uint16_t)) != 0) {
+            ESP_LOGE(TAG, "%zu workers: result differs from the serial run", workers);
+            s_failures++;
+        }
+        // The calling task works too: n workers use up to n + 1 threads
+        printf("%7zu  %8lld  %7.2f\n", workers, (long long)us, (double)serial_us / us);
+    }
+    free(src);
+    free(ref);
+    free(dst);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--workers <n>] [--rounds <n>] [--size <w>x<h>]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "workers", required_argument, NULL, 'w' },
+        { "rounds", required_argument, NULL, 'r' },
+        { "size", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "w:r:s:", options, NULL)) != -1) {
+        switch (opt) {
+        case 'w': s_config.workers = strtoul(optarg, NULL, 0); break;
+        case 'r': s_config.rounds = strtoul(optarg, NULL, 0); break;
+        case 's':
+            if (sscanf(optarg, "%ux%u", &s_config.w, &s_config.h) != 2) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (s_config.workers < 1 || s_config.workers > JOB_POOL_MAX_WORKERS || s_config.w < 4 || s_config.h < 4) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    for (size_t workers = 1; workers <= s_config.workers; workers++) {
+        check_pool(workers);
+    }
+    bench();
+
+    printf("\n%s\n", s_failures ? "FAILED" : "OK");
+    return s_failures ? 1 : 0;
+}
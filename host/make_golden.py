@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Write the golden frames of the render harness that are fully known without running LVGL.
+
+A full screen opaque photo reaches the frame buffer unchanged, so those frames are the generated patterns of
+render_harness.c (photo_pattern()) in RGB565, written as PPM like frame_check() does. Frames with text or blending
+are not listed here and are recorded with `render_harness --update`.
+
+    host/make_golden.py -o host/build/golden
+    host/build/render_harness --golden host/build/golden host/scenarios/slideshow.scn
+"""
+
+import argparse
+import os
+import sys
+
+H_RES = 800     # LVGL_PORT_H_RES, rotation 0
+V_RES = 480
+
+# Scenario -> frame name -> pattern shown full screen at that frame
+FRAMES = {
+    'slideshow': {'gradient': 'gradient', 'bars': 'bars', 'checker': 'checker', 'noise': 'noise'},
+    'overlay_clock': {'photo': 'gradient', 'restored': 'gradient'},
+    'photo_opa': {'opaque': 'gradient', 'restored': 'bars'},
+}
+
+BARS = (0xffffff, 0xffff00, 0x00ffff, 0x00ff00, 0xff00ff, 0xff0000, 0x0000ff, 0x000000)
+
+
+def rgb565(r, g, b):
+    # lv_color_make() at LV_COLOR_DEPTH 16 without LV_COLOR_16_SWAP
+    return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)
+
+
+def hex565(c):
+    return rgb565((c >> 16) & 0xff, (c >> 8) & 0xff, c & 0xff)
+
+
+def pattern(name, w, h):
+    px = []
+    seed = 12345
+    white, blue = hex565(0xffffff), rgb565(0x20, 0x40, 0x80)
+    for y in range(h):
+        for x in range(w):
+            if name == 'bars':
+                c = hex565(BARS[x * 8 // w])
+            elif name == 'checker':
+                c = white if ((x // 40) + (y // 40)) & 1 else blue
+            elif name == 'noise':
+                seed = (seed * 1103515245 + 12345) & 0xffffffff
+                c = hex565(seed >> 8)
+            else:
+                c = rgb565(x * 255 // w, y * 255 // h, 255 - x * 255 // w)
+            px.append(c)
+    return px
+
+
+def ppm(px, w, h):
+    # rgb565_to_rgb888() of render_harness.c
+    out = bytearray(b'P6\n%d %d\n255\n' % (w, h))
+    for c in px:
+        r, g, b = (c >> 11) & 0x1f, (c >> 5) & 0x3f, c & 0x1f
+        out += bytes(((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)))
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-o', '--out', required=True, help='golden directory, <out>/<scenario>/<frame>.ppm')
+    parser.add_argument('-s', '--scenario', action='append', choices=sorted(FRAMES),
+                        help='only these scenarios (default: all)')
+    args = parser.parse_args()
+
+    cache = {}
+    for scenario in args.scenario or sorted(FRAMES):
+        os.makedirs(os.path.join(args.out, scenario), exist_ok=True)
+        for frame, name in sorted(FRAMES[scenario].items()):
+            if name not in cache:
+                cache[name] = ppm(pattern(name, H_RES, V_RES), H_RES, V_RES)
+            with open(os.path.join(args.out, scenario, frame + '.ppm'), 'wb') as f:
+                f.write(cache[name])
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,136 @@
+#include "mem_panel.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_panel_rgb.h"
+
+#define MEM_PANEL_MAX_FBS           3
+#define MEM_PANEL_MIN_VSYNC_US      50
+
+struct esp_lcd_panel_t {
+    mem_panel_config_t config;
+    uint16_t *fbs[MEM_PANEL_MAX_FBS];
+    uint32_t front;                     // Index of the frame buffer scanned out
+    mem_panel_stats_t stats;
+    pthread_t vsync_thread;
+};
+
+static void *vsync_thread(void *arg)
+{
+    esp_lcd_panel_handle_t panel = arg;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (1) {
+        next.tv_nsec += (long)panel->config.vsync_period_us * 1000;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+        __atomic_fetch_add(&panel->stats.vsyncs, 1, __ATOMIC_RELAXED);
+        if (panel->config.on_vsync) {
+            panel->config.on_vsync(panel->config.user_ctx);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t mem_panel_create(const mem_panel_config_t *config, esp_lcd_panel_handle_t *ret_panel)
+{
+    if (!config || !ret_panel || config->h_res <= 0 || config->v_res <= 0 ||
+            config->num_fbs < 1 || config->num_fbs > MEM_PANEL_MAX_FBS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_lcd_panel_handle_t panel = calloc(1, sizeof(*panel));
+    if (!panel) {
+        return ESP_ERR_NO_MEM;
+    }
+    panel->config = *config;
+    if (panel->config.vsync_period_us < MEM_PANEL_MIN_VSYNC_US) {
+        panel->config.vsync_period_us = MEM_PANEL_MIN_VSYNC_US;
+    }
+    for (uint32_t i = 0; i < config->num_fbs; i++) {
+        panel->fbs[i] = calloc((size_t)config->h_res * config->v_res, sizeof(uint16_t));
+        if (!panel->fbs[i]) {
+            goto err;
+        }
+    }
+    if (pthread_create(&panel->vsync_thread, NULL, vsync_thread, panel) != 0) {
+        goto err;
+    }
+    pthread_detach(panel->vsync_thread);
+    *ret_panel = panel;
+    return ESP_OK;
+
+err:
+    for (uint32_t i = 0; i < MEM_PANEL_MAX_FBS; i++) {
+        free(panel->fbs[i]);
+    }
+    free(panel);
+    return ESP_ERR_NO_MEM;
+}
+
+const uint16_t *mem_panel_get_front(esp_lcd_panel_handle_t panel)
+{
+    return panel->fbs[__atomic_load_n(&panel->front, __ATOMIC_ACQUIRE)];
+}
+
+void mem_panel_get_stats(esp_lcd_panel_handle_t panel, mem_panel_stats_t *stats)
+{
+    *stats = panel->stats;
+    stats->vsyncs = __atomic_load_n(&panel->stats.vsyncs, __ATOMIC_RELAXED);
+}
+
+esp_err_t esp_lcd_panel_draw_bitmap(esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end,
+                                    const void *color_data)
+{
+    if (!panel || !color_data || x_start >= x_end || y_start >= y_end || x_start < 0 || y_start < 0 ||
+            x_end > panel->config.h_res || y_end > panel->config.v_res) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Same rule as the RGB driver: one of the panel's own frame buffers is scanned out from the next frame on
+    for (uint32_t i = 0; i < panel->config.num_fbs; i++) {
+        if (color_data == panel->fbs[i]) {
+            __atomic_store_n(&panel->front, i, __ATOMIC_RELEASE);
+            panel->stats.fb_switches++;
+            return ESP_OK;
+        }
+    }
+
+    // Any other buffer holds the area only, copied into the frame buffer being scanned out
+    const int w = x_end - x_start;
+    const uint16_t *from = color_data;
+    uint16_t *to = panel->fbs[panel->front] + (size_t)y_start * panel->config.h_res + x_start;
+    for (int y = y_start; y < y_end; y++) {
+        memcpy(to, from, w * sizeof(uint16_t));
+        from += w;
+        to += panel->config.h_res;
+    }
+    panel->stats.copies++;
+    panel->stats.copied_px += (uint64_t)w * (y_end - y_start);
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_rgb_panel_get_frame_buffer(esp_lcd_panel_handle_t panel, uint32_t fb_num, void **fb0, ...)
+{
+    if (!panel || fb_num == 0 || fb_num > panel->config.num_fbs) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    va_list args;
+    va_start(args, fb0);
+    *fb0 = panel->fbs[0];
+    for (uint32_t i = 1; i < fb_num; i++) {
+        void **fb = va_arg(args, void **);
+        *fb = panel->fbs[i];
+    }
+    va_end(args);
+    return ESP_OK;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Memory-backed stand-in for the RGB panel of esp_lcd: frame buffers in RAM, `esp_lcd_panel_draw_bitmap()` either
+ * switches the scanned-out frame buffer (when given one of its own buffers) or copies the area into it, and a thread
+ * reports VSYNC periodically, like the RGB peripheral does at the end of every frame.
+ */
+typedef struct {
+    int h_res;                          // Horizontal resolution of the panel, in pixels
+    int v_res;                          // Vertical resolution of the panel, in pixels
+    uint32_t num_fbs;                   // Frame buffers, 1..3
+    uint32_t vsync_period_us;           // Time between two VSYNC events, at least 50 us
+    bool (*on_vsync)(void *user_ctx);   // Called from the VSYNC thread, can be NULL
+    void *user_ctx;
+} mem_panel_config_t;
+
+/**
+ * @brief Statistics of a memory panel
+ */
+typedef struct {
+    uint32_t fb_switches;               // Calls of `esp_lcd_panel_draw_bitmap()` with one of the frame buffers
+    uint32_t copies;                    // Calls of `esp_lcd_panel_draw_bitmap()` with another buffer
+    uint64_t copied_px;                 // Pixels copied by those calls
+    uint32_t vsyncs;                    // VSYNC events reported
+} mem_panel_stats_t;
+
+/**
+ * @brief Create a memory panel, frame buffers are cleared to black
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid configuration
+ *      - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t mem_panel_create(const mem_panel_config_t *config, esp_lcd_panel_handle_t *ret_panel);
+
+/**
+ * @brief Get the frame buffer currently scanned out, `h_res * v_res` RGB565 pixels
+ */
+const uint16_t *mem_panel_get_front(esp_lcd_panel_handle_t panel);
+
+/**
+ * @brief Get the statistics of a panel
+ */
+void mem_panel_get_stats(esp_lcd_panel_handle_t panel, mem_panel_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
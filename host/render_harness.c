@@ -0,0 +1,688 @@
+/*
+ * Headless render harness: runs LVGL, lvgl_port.c and the slideshow modules on the host with a memory panel, plays
+ * scripted scenarios, compares frames with golden images and reports per-frame render times.
+ *
+ * Scenario scripts (host/scenarios/ *.scn), one step per line, `#` starts a comment:
+ *
+ *   photo <gradient|bars|checker|noise>   Show a generated full screen photo through photo_display_show()
+ *   photo file <path>                     Show a JPEG/PNG file, passed to the decoders like main.c does
+ *   overlay <duration_ms> <text>          ui_cmd_show_overlay(), `0` keeps the overlay
+ *   hide_overlay                          ui_cmd_hide_overlay()
+ *   brightness <0..255>                   ui_cmd_set_brightness()
+ *   photo_opa <0..255>                    Draw the photo through a full screen parent with this opacity, which
+ *                                         LVGL renders as a layer with alpha, `255` puts it back on the screen
+ *   wait <ms>                             Let LVGL timers run
+ *   frame [name]                          Render the pending changes, time them and, with a name, compare the
+ *                                         scanned out frame buffer with <golden>/<scenario>/<name>.ppm
+ *   repeat <n> ... end                    Repeat the enclosed steps, `{i}` and `{i2}` expand to the iteration
+ *                                         number (zero padded to two digits for `{i2}`)
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "image_arena.h"
+#include "lvgl.h"
+#include "lvgl_port.h"
+#include "mem_panel.h"
+#include "perf_monitor.h"
+#include "photo_display.h"
+#include "ui_cmd.h"
+
+static const char *TAG = "harness";
+
+#define MAX_STEPS           4096
+#define MAX_ARGS            4
+#define MAX_LINE            256
+#define BATCH_MAX_CMDS      (LVGL_PORT_CMD_QUEUE_LEN / 2)   // Posted while the LVGL task is held, must fit the queue
+
+typedef enum {
+    STEP_PHOTO,
+    STEP_OVERLAY,
+    STEP_HIDE_OVERLAY,
+    STEP_BRIGHTNESS,
+    STEP_PHOTO_OPA,
+    STEP_WAIT,
+    STEP_FRAME,
+} step_type_t;
+
+typedef struct {
+    step_type_t type;
+    int line;                       // Line in the script, for messages
+    char *args[MAX_ARGS];           // Owned copies, args[0] is the first argument after the keyword
+    int argc;
+    lv_img_dsc_t *photo;            // STEP_PHOTO: source, kept until exit since LVGL may still refer to it
+    int64_t render_us;              // STEP_FRAME results
+    uint32_t dirty_px;
+} step_t;
+
+typedef struct {
+    const char *golden_dir;
+    const char *out_dir;
+    const char *csv_path;
+    uint32_t vsync_us;
+    uint32_t tolerance_px;          // Differing pixels accepted by a comparison
+    bool update;                    // Write the golden images instead of comparing
+} harness_config_t;
+
+static harness_config_t s_config = {
+    .golden_dir = "golden",
+    .out_dir = ".",
+    .vsync_us = 50,
+};
+
+static esp_lcd_panel_handle_t s_panel = NULL;
+static SemaphoreHandle_t s_step_done = NULL;
+static uint16_t *s_capture = NULL;  // Copy of the front buffer taken by the last STEP_FRAME
+static int s_h_res = 0;
+static int s_v_res = 0;
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+/* Scripts */
+
+static bool parse_type(const char *word, step_type_t *type)
+{
+    static const char *const names[] = {
+        [STEP_PHOTO] = "photo",
+        [STEP_OVERLAY] = "overlay",
+        [STEP_HIDE_OVERLAY] = "hide_overlay",
+        [STEP_BRIGHTNESS] = "brightness",
+        [STEP_PHOTO_OPA] = "photo_opa",
+        [STEP_WAIT] = "wait",
+        [STEP_FRAME] = "frame",
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(word, names[i]) == 0) {
+            *type = (step_type_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Replace `{i}` and `{i2}` by the iteration number
+static char *expand(const char *arg, int iteration)
+{
+    char out[MAX_LINE];
+    size_t n = 0;
+    while (*arg && n < sizeof(out) - 8) {
+        if (strncmp(arg, "{i}", 3) == 0) {
+            n += snprintf(out + n, sizeof(out) - n, "%d", iteration);
+            arg += 3;
+        } else if (strncmp(arg, "{i2}", 4) == 0) {
+            n += snprintf(out + n, sizeof(out) - n, "%02d", iteration % 100);
+            arg += 4;
+        } else {
+            out[n++] = *arg++;
+        }
+    }
+    out[n] = '\0';
+    return strdup(out);
+}
+
+// Split a line into words, the last word of `overlay` takes the rest of the line
+static int split_words(char *line, char **words, int max_words)
+{
+    int count = 0;
+    char *p = line;
+    while (count < max_words) {
+        p += strspn(p, " \t");
+        if (!*p) {
+            break;
+        }
+        const bool rest = (count == 2 && strcmp(words[0], "overlay") == 0);
+        words[count++] = p;
+        if (rest) {
+            p[strcspn(p, "\r\n")] = '\0';
+            break;
+        }
+        p += strcspn(p, " \t");
+        if (*p) {
+            *p++ = '\0';
+        }
+    }
+    return count;
+}
+
+static int load_script(const char *path, step_t *steps, int max_steps)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        ESP_LOGE(TAG, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    char line[MAX_LINE];
+    int line_no = 0;
+    int count = 0;
+    int repeat_start = -1;          // First step of the open `repeat` block
+    int repeat_count = 0;
+    int ret = 0;
+    while (fgets(line, sizeof(line), f) && ret == 0) {
+        line_no++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        char *words[MAX_ARGS + 1];
+        const int nwords = split_words(line, words, MAX_ARGS + 1);
+        if (nwords == 0) {
+            continue;
+        }
+
+        if (strcmp(words[0], "repeat") == 0) {
+            if (repeat_start >= 0 || nwords != 2 || (repeat_count = atoi(words[1])) <= 0) {
+                ESP_LOGE(TAG, "%s:%d: invalid or nested repeat", path, line_no);
+                ret = -1;
+            }
+            repeat_start = count;
+            continue;
+        }
+        if (strcmp(words[0], "end") == 0) {
+            if (repeat_start < 0) {
+                ESP_LOGE(TAG, "%s:%d: end without repeat", path, line_no);
+                ret = -1;
+                continue;
+            }
+            // The block has been stored once with `{i}` unexpanded, duplicate and expand it
+            const int block = count - repeat_start;
+            if (repeat_start + block * repeat_count > max_steps) {
+                ESP_LOGE(TAG, "%s:%d: more than %d steps", path, line_no, max_steps);
+                ret = -1;
+                continue;
+            }
+            for (int it = repeat_count - 1; it >= 0; it--) {
+                for (int s = 0; s < block; s++) {
+                    const step_t *from = &steps[repeat_start + s];
+                    step_t *to = &steps[repeat_start + it * block + s];
+                    step_t copy = *from;
+                    for (int a = 0; a < from->argc; a++) {
+                        copy.args[a] = expand(from->args[a], it);
+                    }
+                    if (it == 0) {
+                        for (int a = 0; a < from->argc; a++) {
+                            free(from->args[a]);
+                        }
+                    }
+                    *to = copy;
+                }
+            }
+            count = repeat_start + block * repeat_count;
+            repeat_start = -1;
+            continue;
+        }
+
+        if (count >= max_steps) {
+            ESP_LOGE(TAG, "%s:%d: more than %d steps", path, line_no, max_steps);
+            ret = -1;
+            continue;
+        }
+        step_t *step = &steps[count];
+        memset(step, 0, sizeof(*step));
+        if (!parse_type(words[0], &step->type)) {
+            ESP_LOGE(TAG, "%s:%d: unknown step '%s'", path, line_no, words[0]);
+            ret = -1;
+            continue;
+        }
+        step->line = line_no;
+        step->argc = nwords - 1;
+        for (int a = 0; a < step->argc; a++) {
+            step->args[a] = strdup(words[a + 1]);
+        }
+        count++;
+    }
+    fclose(f);
+    if (ret == 0 && repeat_start >= 0) {
+        ESP_LOGE(TAG, "%s: repeat without end", path);
+        ret = -1;
+    }
+    return (ret == 0) ? count : -1;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+/* Photos */
+
+static lv_img_dsc_t *photo_pattern(const char *name, int w, int h)
+{
+    lv_color_t *px = malloc((size_t)w * h * sizeof(lv_color_t));
+    lv_img_dsc_t *dsc = calloc(1, sizeof(*dsc));
+    if (!px || !dsc) {
+        free(px);
+        free(dsc);
+        return NULL;
+    }
+    uint32_t seed = 12345;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            lv_color_t c;
+            if (strcmp(name, "bars") == 0) {
+                static const uint32_t bars[] = { 0xffffff, 0xffff00, 0x00ffff, 0x00ff00, 0xff00ff, 0xff0000, 0x0000ff, 0x000000 };
+                c = lv_color_hex(bars[x * 8 / w]);
+            } else if (strcmp(name, "checker") == 0) {
+                c = (((x / 40) + (y / 40)) & 1) ? lv_color_white() : lv_color_make(0x20, 0x40, 0x80);
+            } else if (strcmp(name, "noise") == 0) {
+                seed = seed * 1103515245u + 12345u;
+                c = lv_color_hex(seed >> 8);
+            } else {
+                c = lv_color_make(x * 255 / w, y * 255 / h, 255 - x * 255 / w);
+            }
+            px[y * w + x] = c;
+        }
+    }
+    dsc->header.cf = LV_IMG_CF_TRUE_COLOR;
+    dsc->header.w = w;
+    dsc->header.h = h;
+    dsc->data = (const uint8_t *)px;
+    dsc->data_size = (uint32_t)w * h * sizeof(lv_color_t);
+    return dsc;
+}
+
+static lv_img_dsc_t *photo_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "%s: %s", path, strerror(errno));
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = (size > 0) ? malloc(size) : NULL;
+    lv_img_dsc_t *dsc = calloc(1, sizeof(*dsc));
+    if (!buf || !dsc || fread(buf, 1, size, f) != (size_t)size) {
+        ESP_LOGE(TAG, "%s: read failed", path);
+        fclose(f);
+        free(buf);
+        free(dsc);
+        return NULL;
+    }
+    fclose(f);
+    dsc->header.cf = LV_IMG_CF_RAW; // Same as the preloaded slides, the JPEG/PNG decoders pick it up
+    dsc->data = buf;
+    dsc->data_size = (uint32_t)size;
+    return dsc;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+/* Steps, run in the LVGL task */
+
+static uint32_t dirty_px(lv_disp_t *disp)
+{
+    uint32_t px = 0;
+    for (int i = 0; i < disp->inv_p; i++) {
+        if (!disp->inv_area_joined[i]) {
+            px += lv_area_get_size(&disp->inv_areas[i]);
+        }
+    }
+    return px;
+}
+
+static void step_run(const lvgl_port_cmd_t *cmd)
+{
+    step_t *step = cmd->user_data;
+
+    switch (step->type) {
+    case STEP_PHOTO:
+        photo_display_show(step->photo);
+        break;
+    case STEP_PHOTO_OPA: {
+        static lv_obj_t *parent = NULL;
+        if (!parent) {
+            parent = lv_obj_create(lv_scr_act());
+            lv_obj_remove_style_all(parent);
+            lv_obj_set_size(parent, LV_PCT(100), LV_PCT(100));
+            lv_obj_clear_flag(parent, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+            lv_obj_move_background(parent);
+        }
+        const lv_opa_t opa = (step->argc > 0) ? (lv_opa_t)atoi(step->args[0]) : LV_OPA_COVER;
+        lv_obj_t *photo = photo_display_get_obj();
+        lv_obj_set_parent(photo, (opa >= LV_OPA_MAX) ? lv_scr_act() : parent);
+        lv_obj_move_background(photo);
+        lv_obj_set_style_opa(parent, opa, 0);
+        break;
+    }
+    case STEP_FRAME: {
+        lv_disp_t *disp = lv_disp_get_default();
+        step->dirty_px = dirty_px(disp);
+        const int64_t start_us = esp_timer_get_time();
+        lv_refr_now(disp);
+        step->render_us = esp_timer_get_time() - start_us;
+        memcpy(s_capture, mem_panel_get_front(s_panel), (size_t)s_h_res * s_v_res * sizeof(uint16_t));
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void step_done(const lvgl_port_cmd_t *cmd)
+{
+    xSemaphoreGive(s_step_done);
+}
+
+// Post one step, returns the number of completions to wait for
+static int step_post(step_t *step)
+{
+    esp_err_t ret = ESP_OK;
+    int pending = 0;
+
+    switch (step->type) {
+    case STEP_PHOTO:
+    case STEP_PHOTO_OPA:
+    case STEP_FRAME:
+        ret = ui_cmd_run(step_run, step, step_done);
+        pending = (ret == ESP_OK);
+        break;
+    case STEP_OVERLAY:
+        ret = ui_cmd_show_overlay(step->argc > 1 ? step->args[1] : "", step->argc > 0 ? atoi(step->args[0]) : 0);
+        break;
+    case STEP_HIDE_OVERLAY:
+        ret = ui_cmd_hide_overlay();
+        break;
+    case STEP_BRIGHTNESS:
+        ret = ui_cmd_set_brightness(step->argc > 0 ? (uint8_t)atoi(step->args[0]) : 255);
+        break;
+    default:
+        break;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "line %d: post failed (%s)", step->line, esp_err_to_name(ret));
+    }
+    return pending;
+}
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+/* Golden images, binary PPM so they can be looked at with any image viewer */
+
+static void rgb565_to_rgb888(uint16_t c, uint8_t *rgb)
+{
+    const uint8_t r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+static uint16_t rgb888_to_rgb565(const uint8_t *rgb)
+{
+    return ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+}
+
+static int mkdirs(const char *path)
+{
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(tmp, 0755);
+            *p = '/';
+        }
+    }
+    return (mkdir(tmp, 0755) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+static int ppm_write(const char *path, const uint16_t *px, const uint16_t *ref)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", s_h_res, s_v_res);
+    for (int i = 0; i < s_h_res * s_v_res; i++) {
+        uint8_t rgb[3];
+        rgb565_to_rgb888(px[i], rgb);
+        if (ref && ref[i] != px[i]) {
+            rgb[0] = 0xff; rgb[1] = 0; rgb[2] = 0;          // Diff image: mismatches in red
+        } else if (ref) {
+            rgb[0] /= 4; rgb[1] /= 4; rgb[2] /= 4;          // Diff image: matching pixels dimmed
+        }
+        fwrite(rgb, 1, 3, f);
+    }
+    fclose(f);
+    return 0;
+}
+
+static uint16_t *ppm_read(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    int w = 0, h = 0, max = 0;
+    uint16_t *px = NULL;
+    if (fscanf(f, "P6 %d %d %d", &w, &h, &max) == 3 && fgetc(f) != EOF && w == s_h_res && h == s_v_res && max == 255) {
+        px = malloc((size_t)w * h * sizeof(uint16_t));
+        for (int i = 0; px && i < w * h; i++) {
+            uint8_t rgb[3];
+            if (fread(rgb, 1, 3, f) != 3) {
+                free(px);
+                px = NULL;
+                break;
+            }
+            px[i] = rgb888_to_rgb565(rgb);
+        }
+    }
+    fclose(f);
+    return px;
+}
+
+// Compare the captured frame with its golden image, returns the result column of the report
+static const char *frame_check(const char *scenario, const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", s_config.golden_dir, scenario);
+    if (s_config.update) {
+        mkdirs(path);
+        snprintf(path, sizeof(path), "%s/%s/%s.ppm", s_config.golden_dir, scenario, name);
+        return ppm_write(path, s_capture, NULL) == 0 ? "updated" : "error";
+    }
+
+    snprintf(path, sizeof(path), "%s/%s/%s.ppm", s_config.golden_dir, scenario, name);
+    uint16_t *golden = ppm_read(path);
+    if (!golden) {
+        return "missing";
+    }
+    uint32_t diff = 0;
+    for (int i = 0; i < s_h_res * s_v_res; i++) {
+        diff += (golden[i] != s_capture[i]);
+    }
+    if (diff > s_config.tolerance_px) {
+        mkdirs(s_config.out_dir);
+        snprintf(path, sizeof(path), "%s/%s_%s.actual.ppm", s_config.out_dir, scenario, name);
+        ppm_write(path, s_capture, NULL);
+        snprintf(path, sizeof(path), "%s/%s_%s.diff.ppm", s_config.out_dir, scenario, name);
+        ppm_write(path, s_capture, golden);
+        ESP_LOGE(TAG, "%s/%s: %lu pixels differ, see %s", scenario, name, (unsigned long)diff, path);
+    }
+    free(golden);
+    return (diff > s_config.tolerance_px) ? "FAIL" : "ok";
+}
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+
+static int compare_i64(const void *a, const void *b)
+{
+    const int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report_times(int64_t *times, int n)
+{
+    if (n == 0) {
+        return;
+    }
+    int64_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += times[i];
+    }
+    qsort(times, n, sizeof(times[0]), compare_i64);
+    printf("# frames %d, render_us min %lld avg %lld p50 %lld p95 %lld max %lld\n", n, (long long)times[0],
+           (long long)(sum / n), (long long)times[n / 2], (long long)times[(n * 95 - 1) / 100], (long long)times[n - 1]);
+}
+
+static int run_scenario(const char *path, FILE *csv)
+{
+    static step_t steps[MAX_STEPS];
+    static int64_t times[MAX_STEPS];
+    const int count = load_script(path, steps, MAX_STEPS);
+    if (count < 0) {
+        return -1;
+    }
+
+    // Scenario name: file name without directory and extension
+    char scenario[128];
+    const char *base = strrchr(path, '/');
+    snprintf(scenario, sizeof(scenario), "%s", base ? base + 1 : path);
+    scenario[strcspn(scenario, ".")] = '\0';
+
+    int failures = 0;
+    int frames = 0;
+    int i = 0;
+    while (i < count) {
+        step_t *step = &steps[i];
+        if (step->type == STEP_WAIT) {
+            vTaskDelay(pdMS_TO_TICKS(step->argc ? atoi(step->args[0]) : 0));
+            i++;
+            continue;
+        }
+
+        // Post the steps up to the next frame while holding the LVGL task, so the frame renders all of them at once
+        int pending = 0;
+        int posted = 0;
+        lvgl_port_lock(-1);
+        while (i < count && steps[i].type != STEP_WAIT && posted < BATCH_MAX_CMDS) {
+            step = &steps[i++];
+            if (step->type == STEP_PHOTO && !step->photo) {
+                step->photo = (step->argc > 1 && strcmp(step->args[0], "file") == 0) ?
+                              photo_file(step->args[1]) : photo_pattern(step->argc ? step->args[0] : "", s_h_res, s_v_res);
+                if (!step->photo) {
+                    failures++;
+                    continue;
+                }
+            }
+            pending += step_post(step);
+            posted++;
+            if (step->type == STEP_FRAME) {
+                break;
+            }
+        }
+        lvgl_port_unlock();
+        while (pending--) {
+            xSemaphoreTake(s_step_done, portMAX_DELAY);
+        }
+
+        if (step->type == STEP_FRAME) {
+            const char *result = (step->argc > 0) ? frame_check(scenario, step->args[0]) : "-";
+            failures += (strcmp(result, "FAIL") == 0 || strcmp(result, "missing") == 0 || strcmp(result, "error") == 0);
+            times[frames++] = step->render_us;
+            printf("%-16s %5d %-16s %10lld %9lu %s\n", scenario, step->line, step->argc ? step->args[0] : "-",
+                   (long long)step->render_us, (unsigned long)step->dirty_px, result);
+            if (csv) {
+                fprintf(csv, "%s,%d,%s,%lld,%lu,%s\n", scenario, step->line, step->argc ? step->args[0] : "",
+                        (long long)step->render_us, (unsigned long)step->dirty_px, result);
+            }
+        }
+    }
+    report_times(times, frames);
+    return failures;
+}
+
+static bool panel_on_vsync(void *user_ctx)
+{
+    return lvgl_port_notify_rgb_vsync();
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] scenario.scn...\n"
+            "  -g, --golden DIR       golden images (default: golden)\n"
+            "  -o, --out DIR          where mismatching frames are written (default: .)\n"
+            "  -u, --update           write the golden images instead of comparing\n"
+            "  -t, --tolerance PX     differing pixels accepted per frame (default: 0)\n"
+            "  -v, --vsync-us US      VSYNC period of the memory panel (default: 50, 16667 for 60 Hz pacing)\n"
+            "  -c, --csv FILE         also write the per-frame results as CSV\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "golden", required_argument, NULL, 'g' },
+        { "out", required_argument, NULL, 'o' },
+        { "update", no_argument, NULL, 'u' },
+        { "tolerance", required_argument, NULL, 't' },
+        { "vsync-us", required_argument, NULL, 'v' },
+        { "csv", required_argument, NULL, 'c' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "g:o:ut:v:c:", options, NULL)) != -1) {
+        switch (opt) {
+        case 'g': s_config.golden_dir = optarg; break;
+        case 'o': s_config.out_dir = optarg; break;
+        case 'u': s_config.update = true; break;
+        case 't': s_config.tolerance_px = strtoul(optarg, NULL, 0); break;
+        case 'v': s_config.vsync_us = strtoul(optarg, NULL, 0); break;
+        case 'c': s_config.csv_path = optarg; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Same order as app_main(): arena and monitor first, then the panel and the LVGL port
+    ESP_ERROR_CHECK(image_arena_init());
+    perf_monitor_init();
+
+    s_h_res = LVGL_PORT_H_RES;
+    s_v_res = LVGL_PORT_V_RES;
+    const mem_panel_config_t panel_config = {
+        .h_res = s_h_res,
+        .v_res = s_v_res,
+        .num_fbs = LVGL_PORT_LCD_RGB_BUFFER_NUMS,
+        .vsync_period_us = s_config.vsync_us,
+        .on_vsync = panel_on_vsync,
+    };
+    ESP_ERROR_CHECK(mem_panel_create(&panel_config, &s_panel));
+    s_capture = malloc((size_t)s_h_res * s_v_res * sizeof(uint16_t));
+    s_step_done = xSemaphoreCreateCounting(MAX_STEPS, 0);
+    assert(s_capture && s_step_done);
+    ESP_ERROR_CHECK(lvgl_port_init(s_panel, NULL));
+
+    FILE *csv = NULL;
+    if (s_config.csv_path) {
+        csv = fopen(s_config.csv_path, "w");
+        if (csv) {
+            fprintf(csv, "scenario,line,frame,render_us,dirty_px,result\n");
+        }
+    }
+
+    printf("%-16s %5s %-16s %10s %9s %s\n", "scenario", "line", "frame", "render_us", "dirty_px", "result");
+    int failures = 0;
+    for (int i = optind; i < argc; i++) {
+        const int ret = run_scenario(argv[i], csv);
+        failures += (ret < 0) ? 1 : ret;
+    }
+    if (csv) {
+        fclose(csv);
+    }
+
+    mem_panel_stats_t stats;
+    mem_panel_get_stats(s_panel, &stats);
+    printf("# panel: %lu frame buffer switches, %lu copies (%llu px), %lu vsyncs\n", (unsigned long)stats.fb_switches,
+           (unsigned long)stats.copies, (unsigned long long)stats.copied_px, (unsigned long)stats.vsyncs);
+    perf_monitor_dump();
+    fflush(stdout);
+    _exit(failures ? 1 : 0); // The LVGL, timer and VSYNC threads never return
+}
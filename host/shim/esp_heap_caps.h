@@ -0,0 +1,59 @@
+#pragma once
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* All capabilities map to the host heap */
+#define MALLOC_CAP_EXEC         (1 << 0)
+#define MALLOC_CAP_32BIT        (1 << 1)
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_DMA          (1 << 3)
+#define MALLOC_CAP_SPIRAM       (1 << 10)
+#define MALLOC_CAP_INTERNAL     (1 << 11)
+#define MALLOC_CAP_DEFAULT      (1 << 12)
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+static inline void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return calloc(n, size);
+}
+
+static inline void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return realloc(ptr, size);
+}
+
+static inline void *heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static inline void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+static inline size_t heap_caps_get_allocated_size(void *ptr)
+{
+    return malloc_usable_size(ptr);
+}
+
+static inline size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return 64 * 1024 * 1024;
+}
+
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
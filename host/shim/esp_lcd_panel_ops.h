@@ -0,0 +1,8 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+
+/* Implemented by host/mem_panel.c */
+esp_err_t esp_lcd_panel_draw_bitmap(esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end,
+                                    const void *color_data);
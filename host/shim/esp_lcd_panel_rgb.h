@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+
+/* Implemented by host/mem_panel.c */
+esp_err_t esp_lcd_rgb_panel_get_frame_buffer(esp_lcd_panel_handle_t panel, uint32_t fb_num, void **fb0, ...);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* The harness has no touch controller, `lvgl_port_init()` is called without one */
+typedef struct esp_lcd_touch_s *esp_lcd_touch_handle_t;
+
+static inline esp_err_t esp_lcd_touch_read_data(esp_lcd_touch_handle_t tp)
+{
+    (void)tp;
+    return ESP_OK;
+}
+
+static inline bool esp_lcd_touch_get_coordinates(esp_lcd_touch_handle_t tp, uint16_t *x, uint16_t *y,
+                                                 uint16_t *strength, uint8_t *point_num, uint8_t max_point_num)
+{
+    (void)tp; (void)x; (void)y; (void)strength; (void)max_point_num;
+    *point_num = 0;
+    return false;
+}
+
+static inline esp_err_t esp_lcd_touch_set_swap_xy(esp_lcd_touch_handle_t tp, bool swap)
+{
+    (void)tp; (void)swap;
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_lcd_touch_set_mirror_x(esp_lcd_touch_handle_t tp, bool mirror)
+{
+    (void)tp; (void)mirror;
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_lcd_touch_set_mirror_y(esp_lcd_touch_handle_t tp, bool mirror)
+{
+    (void)tp; (void)mirror;
+    return ESP_OK;
+}
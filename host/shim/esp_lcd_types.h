@@ -0,0 +1,3 @@
+#pragma once
+
+typedef struct esp_lcd_panel_t *esp_lcd_panel_handle_t;
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdio.h>
+
+/* Errors, warnings and infos go to stderr, so the harness output on stdout stays machine readable */
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { (void)(tag); } while (0)
+#define ESP_LOGV(tag, fmt, ...) do { (void)(tag); } while (0)
@@ -0,0 +1,170 @@
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sdkconfig.h"
+
+// An esp_timer: a thread that sleeps until the next expiry and runs the callback, like the esp_timer task
+struct esp_timer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t period_us;             // 0 for one-shot timers
+    int64_t next_us;                // Next expiry, valid while armed
+    bool armed;
+    bool deleted;
+};
+
+static int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t s_boot_ns;           // Origin of esp_timer_get_time()
+
+__attribute__((constructor)) static void esp_shim_boot(void)
+{
+    s_boot_ns = monotonic_ns();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (monotonic_ns() - s_boot_ns) / 1000;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:                    return "ESP_OK";
+    case ESP_FAIL:                  return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+    default:                        return "UNKNOWN ERROR";
+    }
+}
+
+static struct timespec timespec_from_us(int64_t us)
+{
+    const int64_t ns = s_boot_ns + us * 1000;
+    return (struct timespec) { .tv_sec = ns / 1000000000LL, .tv_nsec = ns % 1000000000LL };
+}
+
+static void *timer_thread(void *arg)
+{
+    struct esp_timer *timer = arg;
+
+    pthread_mutex_lock(&timer->lock);
+    while (!timer->deleted) {
+        if (!timer->armed) {
+            pthread_cond_wait(&timer->cond, &timer->lock);
+            continue;
+        }
+        const struct timespec deadline = timespec_from_us(timer->next_us);
+        if (pthread_cond_timedwait(&timer->cond, &timer->lock, &deadline) != ETIMEDOUT) {
+            continue; // Restarted, stopped or deleted meanwhile
+        }
+        if (!timer->armed || esp_timer_get_time() < timer->next_us) {
+            continue;
+        }
+        if (timer->period_us) {
+            timer->next_us += timer->period_us;
+        } else {
+            timer->armed = false;
+        }
+        pthread_mutex_unlock(&timer->lock);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&timer->lock);
+    }
+    pthread_mutex_unlock(&timer->lock);
+    free(timer);
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (!create_args || !create_args->callback || !out_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+    if (!timer) {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_init(&timer->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    if (pthread_create(&timer->thread, NULL, timer_thread, timer) != 0) {
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(timer->thread);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&timer->lock);
+    if (timer->armed) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        timer->period_us = period_us;
+        timer->next_us = esp_timer_get_time() + (int64_t)timeout_us;
+        timer->armed = true;
+        pthread_cond_signal(&timer->cond);
+    }
+    pthread_mutex_unlock(&timer->lock);
+    return ret;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&timer->lock);
+    if (!timer->armed) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return ret;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&timer->lock);
+    timer->deleted = true;
+    timer->armed = false;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return ESP_OK;
+}
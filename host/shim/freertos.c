@@ -0,0 +1,343 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// A FreeRTOS task: a POSIX thread with its notification value
+struct host_task {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t value;
+    bool pending;                   // Notified since the last wait
+    TaskFunction_t fn;
+    void *arg;
+};
+
+// Semaphores and mutexes, `owner`/`depth` are only used by recursive mutexes
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t count;
+    uint32_t max;
+    bool recursive;
+    pthread_t owner;
+    uint32_t depth;
+};
+
+static __thread struct host_task *s_current = NULL;
+
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static struct timespec deadline_after(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t ns = (uint64_t)ticks * 1000000000ULL / configTICK_RATE_HZ;
+    ts.tv_sec += ns / 1000000000ULL;
+    ts.tv_nsec += ns % 1000000000ULL;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+// Wait on `cond` until signalled or `deadline` (NULL: forever), returns false on timeout
+static bool cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline)
+{
+    if (!deadline) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static struct host_task *task_alloc(TaskFunction_t fn, void *arg)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task) {
+        pthread_mutex_init(&task->lock, NULL);
+        cond_init(&task->cond);
+        task->fn = fn;
+        task->arg = arg;
+    }
+    return task;
+}
+
+static void *task_entry(void *arg)
+{
+    s_current = arg;
+    s_current->fn(s_current->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+    (void)priority;
+    (void)core_id;
+    struct host_task *task = task_alloc(fn, arg);
+    if (!task) {
+        return pdFAIL;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // Stack sizes are given for a 32-bit target, leave room for 64-bit pointers
+    pthread_attr_setstacksize(&attr, (stack_depth < 64 * 1024 ? 64 * 1024 : stack_depth) * 2);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (created_task) {
+        *created_task = task; // Visible before the task runs, like on FreeRTOS
+    }
+    const int ret = pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        if (created_task) {
+            *created_task = NULL;
+        }
+        free(task);
+        return pdFAIL;
+    }
+    pthread_setname_np(task->thread, name);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (!task || task == xTaskGetCurrentTaskHandle()) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    const struct timespec deadline = deadline_after(ticks);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)((uint64_t)ts.tv_sec * configTICK_RATE_HZ + (uint64_t)ts.tv_nsec * configTICK_RATE_HZ / 1000000000ULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (!s_current) {
+        // A thread not created through the shim (e.g. main()), give it a notification value too
+        s_current = task_alloc(NULL, NULL);
+        s_current->thread = pthread_self();
+    }
+    return s_current;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    pthread_mutex_lock(&task->lock);
+    switch (action) {
+    case eSetBits:
+        task->value |= value;
+        break;
+    case eIncrement:
+        task->value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->value = value;
+        break;
+    default:
+        break;
+    }
+    task->pending = true;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *need_yield)
+{
+    if (need_yield) {
+        *need_yield = pdFALSE;
+    }
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    const struct timespec deadline = deadline_after(ticks);
+    BaseType_t ret = pdTRUE;
+
+    pthread_mutex_lock(&task->lock);
+    if (!task->pending) {
+        task->value &= ~clear_on_entry;
+    }
+    while (!task->pending && ret == pdTRUE) {
+        if (ticks == 0 || !cond_wait(&task->cond, &task->lock, ticks == portMAX_DELAY ? NULL : &deadline)) {
+            ret = task->pending ? pdTRUE : pdFALSE;
+            break;
+        }
+    }
+    if (value) {
+        *value = task->value;
+    }
+    if (ret == pdTRUE) {
+        task->value &= ~clear_on_exit;
+        task->pending = false;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return ret;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    const struct timespec deadline = deadline_after(ticks);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->value == 0 && ticks != 0) {
+        if (!cond_wait(&task->cond, &task->lock, ticks == portMAX_DELAY ? NULL : &deadline)) {
+            break;
+        }
+    }
+    const uint32_t value = task->value;
+    if (value) {
+        task->value = clear_on_exit ? 0 : value - 1;
+    }
+    task->pending = false;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+uint32_t ulTaskNotifyValueClear(TaskHandle_t task, uint32_t bits)
+{
+    if (!task) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    pthread_mutex_lock(&task->lock);
+    const uint32_t value = task->value;
+    task->value &= ~bits;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+static SemaphoreHandle_t sem_create(uint32_t max, uint32_t initial, bool recursive)
+{
+    struct host_sem *sem = calloc(1, sizeof(*sem));
+    if (sem) {
+        pthread_mutex_init(&sem->lock, NULL);
+        cond_init(&sem->cond);
+        sem->max = max;
+        sem->count = initial;
+        sem->recursive = recursive;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return sem_create(1, 0, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    return sem_create(max_count, initial_count, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return sem_create(1, 1, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return sem_create(1, 1, true);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    if (sem) {
+        pthread_cond_destroy(&sem->cond);
+        pthread_mutex_destroy(&sem->lock);
+        free(sem);
+    }
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    const struct timespec deadline = deadline_after(ticks);
+    BaseType_t ret = pdTRUE;
+
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0) {
+        if (ticks == 0 || !cond_wait(&sem->cond, &sem->lock, ticks == portMAX_DELAY ? NULL : &deadline)) {
+            ret = sem->count ? pdTRUE : pdFALSE;
+            break;
+        }
+    }
+    if (ret == pdTRUE) {
+        sem->count--;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max) {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    pthread_mutex_lock(&sem->lock);
+    if (sem->depth > 0 && pthread_equal(sem->owner, pthread_self())) {
+        sem->depth++;
+        pthread_mutex_unlock(&sem->lock);
+        return pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+
+    if (xSemaphoreTake(sem, ticks) != pdTRUE) {
+        return pdFALSE;
+    }
+    pthread_mutex_lock(&sem->lock);
+    sem->owner = pthread_self();
+    sem->depth = 1;
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    if (sem->depth == 0 || !pthread_equal(sem->owner, pthread_self())) {
+        pthread_mutex_unlock(&sem->lock);
+        return pdFALSE;
+    }
+    const bool release = (--sem->depth == 0);
+    pthread_mutex_unlock(&sem->lock);
+    return release ? xSemaphoreGive(sem) : pdTRUE;
+}
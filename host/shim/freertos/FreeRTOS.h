@@ -0,0 +1,45 @@
+#pragma once
+
+/**
+ * The subset of the FreeRTOS API used by the display stack, on top of POSIX threads (see host/shim/freertos.c).
+ * Priorities and core affinities are ignored, the host scheduler decides.
+ */
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ      CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000U))
+#define tskNO_AFFINITY          ((BaseType_t)0x7fffffff)
+#define portNUM_PROCESSORS      2
+
+// Threads are not pinned, report them all on core 0
+static inline BaseType_t xPortGetCoreID(void)
+{
+    return 0;
+}
+
+typedef struct {
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { .mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP }
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(&(mux)->mutex)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(&(mux)->mutex)
+#define portENTER_CRITICAL_ISR(mux)     portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)      portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(...)         do { } while (0)
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_sem *SemaphoreHandle_t;
+typedef struct { void *unused; } StaticSemaphore_t;    // Static semaphores are allocated like the others
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+#define xSemaphoreCreateBinaryStatic(buf)   ((void)(buf), xSemaphoreCreateBinary())
+#define xSemaphoreCreateMutexStatic(buf)    ((void)(buf), xSemaphoreCreateMutex())
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
+#define xSemaphoreGiveFromISR(sem, need_yield)  xSemaphoreGive(sem)
@@ -0,0 +1,165 @@
+#include "ch422g.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "i2c_bus_mgr.h"
+
+static const char *TAG = "ch422g";
+
+// The CH422G answers its commands on fixed addresses instead of registers
+#define MODE_ADDR           0x24    // System parameters
+#define OUT_ADDR            0x38    // Output levels of EXIO0 to EXIO7
+#define MODE_IO_OE          0x01    // EXIO pins are push-pull outputs
+
+static struct {
+    SemaphoreHandle_t lock;         // Created once, held across the transactions
+    uint32_t refs;
+    i2c_bus_dev_handle_t mode_dev;
+    i2c_bus_dev_handle_t out_dev;
+    bool mode_sent;
+    bool out_valid;                 // `out_sent` is the level of the pins
+    uint8_t shadow;
+    uint8_t out_sent;
+    ch422g_stats_t stats;
+} s_exp = {
+    .shadow = CH422G_OUT_DEFAULT,
+};
+
+// The driver's mutex, created by the first caller whatever task it runs in
+static SemaphoreHandle_t exp_lock(void)
+{
+    static StaticSemaphore_t lock_buf;
+    static uint32_t state;          // 0: not created, 1: being created, 2: ready
+    uint32_t expected = 0;
+    if (__atomic_compare_exchange_n(&state, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        s_exp.lock = xSemaphoreCreateMutexStatic(&lock_buf);
+        __atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2) {
+        vTaskDelay(1);
+    }
+    return s_exp.lock;
+}
+
+// Send the shadow register if the pins differ, with the lock held
+static esp_err_t exp_flush(void)
+{
+    esp_err_t ret = ESP_OK;
+    if (!s_exp.mode_sent) {
+        const uint8_t mode = MODE_IO_OE;
+        ret = i2c_bus_write(s_exp.mode_dev, &mode, 1);
+        s_exp.stats.writes++;
+        if (ret != ESP_OK) {
+            goto err;
+        }
+        s_exp.mode_sent = true;
+    }
+    if (s_exp.out_valid && s_exp.out_sent == s_exp.shadow) {
+        s_exp.stats.skipped++;
+        return ESP_OK;
+    }
+
+    const uint8_t out = s_exp.shadow;
+    ret = i2c_bus_write(s_exp.out_dev, &out, 1);
+    s_exp.stats.writes++;
+    if (ret != ESP_OK) {
+        goto err;
+    }
+    s_exp.out_sent = out;
+    s_exp.out_valid = true;
+    return ESP_OK;
+
+err:
+    // The chip may have been reset: send everything again next time
+    s_exp.stats.errors++;
+    s_exp.mode_sent = false;
+    s_exp.out_valid = false;
+    ESP_LOGE(TAG, "Write failed: %s", esp_err_to_name(ret));
+    return ret;
+}
+
+esp_err_t ch422g_init(void)
+{
+    SemaphoreHandle_t lock = exp_lock();
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (s_exp.refs > 0) {
+        s_exp.refs++;
+        goto out;
+    }
+    ESP_GOTO_ON_ERROR(i2c_bus_acquire(), out, TAG, "I2C bus acquire failed");
+    ret = i2c_bus_add_device("ch422g", MODE_ADDR, 0, &s_exp.mode_dev);
+    if (ret == ESP_OK) {
+        ret = i2c_bus_add_device("ch422g_out", OUT_ADDR, 0, &s_exp.out_dev);
+        if (ret != ESP_OK) {
+            i2c_bus_remove_device(s_exp.mode_dev);
+        }
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Can't add the expander: %s", esp_err_to_name(ret));
+        i2c_bus_release();
+        goto out;
+    }
+    s_exp.refs = 1;
+
+out:
+    xSemaphoreGive(lock);
+    return ret;
+}
+
+void ch422g_deinit(void)
+{
+    SemaphoreHandle_t lock = exp_lock();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (s_exp.refs > 0 && --s_exp.refs == 0) {
+        i2c_bus_remove_device(s_exp.out_dev);
+        i2c_bus_remove_device(s_exp.mode_dev);
+        s_exp.out_dev = s_exp.mode_dev = NULL;
+        i2c_bus_release();              // The chip keeps its mode and outputs, and the shadow register with them
+    }
+    xSemaphoreGive(lock);
+}
+
+esp_err_t ch422g_update(uint8_t set, uint8_t clear)
+{
+    SemaphoreHandle_t lock = exp_lock();
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (s_exp.refs > 0) {
+        __atomic_store_n(&s_exp.shadow, (uint8_t)((s_exp.shadow | set) & ~clear), __ATOMIC_RELAXED);
+        ret = exp_flush();
+    }
+    xSemaphoreGive(lock);
+    return ret;
+}
+
+uint8_t ch422g_get_outputs(void)
+{
+    return __atomic_load_n(&s_exp.shadow, __ATOMIC_RELAXED);
+}
+
+void ch422g_get_stats(ch422g_stats_t *stats, bool reset)
+{
+    SemaphoreHandle_t lock = exp_lock();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *stats = s_exp.stats;
+    if (reset) {
+        s_exp.stats = (ch422g_stats_t){ 0 };
+    }
+    xSemaphoreGive(lock);
+}
+
+void ch422g_log_stats(void)
+{
+    ch422g_stats_t stats;
+    ch422g_get_stats(&stats, false);
+    ESP_LOGI(TAG, "outputs 0x%02x, %lu writes, %lu skipped, %lu errors", ch422g_get_outputs(),
+             (unsigned long)stats.writes, (unsigned long)stats.skipped, (unsigned long)stats.errors);
+}
@@ -0,0 +1,92 @@
+#ifndef CH422G_H
+#define CH422G_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Driver of the CH422G IO expander of the board, on the I2C bus manager.
+ *  - The outputs are kept in a shadow register: callers change their own bits and never overwrite the others', so
+ *    the SD card and the backlight code don't race on the whole byte.
+ *  - A change of several bits is one transaction, a change that leaves the outputs as they are is not sent.
+ *  - The mode byte (push-pull outputs) is sent once, and again after a failed write.
+ */
+
+// Output pins (EXIO1 to EXIO5)
+#define CH422G_IO_TP_RST        (1u << 1)   // Touch controller reset, active low
+#define CH422G_IO_DISP          (1u << 2)   // Backlight
+#define CH422G_IO_LCD_RST       (1u << 3)   // LCD reset, active low
+#define CH422G_IO_SD_CS         (1u << 4)   // SD card chip select, active low
+#define CH422G_IO_USB_SEL       (1u << 5)   // USB / CAN switch
+
+// Outputs before any change: nothing in reset, card not selected, backlight off
+#define CH422G_OUT_DEFAULT      (CH422G_IO_TP_RST | CH422G_IO_LCD_RST | CH422G_IO_SD_CS)
+
+/**
+ * @brief Statistics of the driver
+ */
+typedef struct {
+    uint32_t writes;            // Transactions sent, mode byte included
+    uint32_t skipped;           // Changes that left the outputs as they were
+    uint32_t errors;
+} ch422g_stats_t;
+
+/**
+ * @brief Take a reference on the expander, acquiring the I2C bus on the first call
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - Others: Error of `i2c_bus_acquire()` or `i2c_bus_add_device()`
+ */
+esp_err_t ch422g_init(void);
+
+/**
+ * @brief Drop a reference, the bus is released with the last one. The outputs keep their level.
+ */
+void ch422g_deinit(void);
+
+/**
+ * @brief Set the bits of `set`, then clear the bits of `clear`, in one transaction
+ *
+ * @return
+ *      - ESP_OK: Success, or nothing to change
+ *      - ESP_ERR_INVALID_STATE: Not initialized
+ *      - Others: Error of `i2c_bus_write()`, the shadow register keeps the change and the next call sends it again
+ */
+esp_err_t ch422g_update(uint8_t set, uint8_t clear);
+
+/**
+ * @brief Drive the pins of `mask` high or low
+ */
+static inline esp_err_t ch422g_set_level(uint8_t mask, bool level)
+{
+    return level ? ch422g_update(mask, 0) : ch422g_update(0, mask);
+}
+
+/**
+ * @brief Shadow register, i.e. the outputs once the pending change is sent
+ */
+uint8_t ch422g_get_outputs(void);
+
+/**
+ * @brief Get the statistics
+ *
+ * @param reset Clear them after reading
+ */
+void ch422g_get_stats(ch422g_stats_t *stats, bool reset);
+
+/**
+ * @brief Print the statistics with ESP_LOGI
+ */
+void ch422g_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CH422G_H
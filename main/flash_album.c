@@ -0,0 +1,137 @@
+#include "flash_album.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+static const char *TAG = "flash_album";
+
+#define ALBUM_MAGIC         0x4C415054  // "TPAL"
+#define ALBUM_VERSION       1
+#define ALBUM_MAX_IMAGES    64
+#define ALBUM_MAX_SIDE      2047        // Width and height are 11 bits in lv_img_header_t
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t total_size;        // Header, entries and data
+    uint32_t reserved;
+} album_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t offset;            // From the start of the partition
+    uint32_t size;
+    uint16_t w;                 // Informative for JPEG/PNG, the decoder reads it from the data
+    uint16_t h;
+    uint8_t cf;                 // LV_IMG_CF_RAW (JPEG/PNG/SJPG) or LV_IMG_CF_TRUE_COLOR (RGB565)
+    uint8_t reserved[3];
+    char name[FLASH_ALBUM_NAME_LEN];
+} album_entry_t;
+
+_Static_assert(sizeof(album_header_t) == 16 && sizeof(album_entry_t) == 32, "Must match tools/pack_album.py");
+
+static struct {
+    const uint8_t *base;
+    esp_partition_mmap_handle_t handle;
+    size_t count;
+    lv_img_dsc_t dsc[ALBUM_MAX_IMAGES];
+    const album_entry_t *entries;
+} s_album;
+
+static esp_err_t album_check(const album_header_t *hdr, const album_entry_t *entries, size_t part_size)
+{
+    const size_t table_end = sizeof(*hdr) + hdr->count * sizeof(album_entry_t);
+    if (hdr->total_size > part_size || table_end > hdr->total_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t i = 0; i < hdr->count; i++) {
+        const album_entry_t *e = &entries[i];
+        const bool true_color = (e->cf == LV_IMG_CF_TRUE_COLOR);
+        if ((e->cf != LV_IMG_CF_RAW && !true_color) || e->offset < table_end || e->offset > hdr->total_size ||
+                e->size == 0 || e->size > hdr->total_size - e->offset || e->offset % FLASH_ALBUM_ALIGN != 0 ||
+                !memchr(e->name, '\0', sizeof(e->name)) ||
+                (true_color && (e->w > ALBUM_MAX_SIDE || e->h > ALBUM_MAX_SIDE ||
+                                e->size < (uint32_t)e->w * e->h * sizeof(lv_color_t)))) {
+            ESP_LOGE(TAG, "Bad entry %u", (unsigned)i);
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t flash_album_init(void)
+{
+    if (s_album.base) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           FLASH_ALBUM_PARTITION);
+    if (!part) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Read the header first, then map only the used part: the data MMU space is shared with PSRAM
+    album_header_t hdr;
+    esp_err_t ret = esp_partition_read(part, 0, &hdr, sizeof(hdr));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (hdr.magic != ALBUM_MAGIC || hdr.version != ALBUM_VERSION || hdr.count > ALBUM_MAX_IMAGES) {
+        ESP_LOGW(TAG, "No album in partition \"%s\"", part->label);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (hdr.count == 0) {
+        return ESP_OK;
+    }
+
+    const void *base = NULL;
+    ret = esp_partition_mmap(part, 0, hdr.total_size, ESP_PARTITION_MMAP_DATA, &base, &s_album.handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "mmap of %u bytes failed: %s", (unsigned)hdr.total_size, esp_err_to_name(ret));
+        return ret;
+    }
+    const album_entry_t *entries = (const album_entry_t *)((const uint8_t *)base + sizeof(hdr));
+    ret = album_check(&hdr, entries, part->size);
+    if (ret != ESP_OK) {
+        esp_partition_munmap(s_album.handle);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    s_album.base = base;
+    s_album.entries = entries;
+    for (size_t i = 0; i < hdr.count; i++) {
+        lv_img_dsc_t *dsc = &s_album.dsc[i];
+        memset(dsc, 0, sizeof(*dsc));
+        dsc->header.cf = entries[i].cf;
+        if (entries[i].cf == LV_IMG_CF_TRUE_COLOR) {
+            // Same as images read from the card: the decoder takes the size of JPEG/PNG from the data
+            dsc->header.w = entries[i].w;
+            dsc->header.h = entries[i].h;
+        }
+        dsc->data = s_album.base + entries[i].offset;
+        dsc->data_size = entries[i].size;
+    }
+    s_album.count = hdr.count;
+
+    ESP_LOGI(TAG, "%u images, %u KB mapped", (unsigned)s_album.count, (unsigned)(hdr.total_size / 1024));
+    return ESP_OK;
+}
+
+size_t flash_album_count(void)
+{
+    return s_album.count;
+}
+
+const lv_img_dsc_t *flash_album_get(size_t index)
+{
+    return index < s_album.count ? &s_album.dsc[index] : NULL;
+}
+
+const char *flash_album_name(size_t index)
+{
+    return index < s_album.count ? s_album.entries[index].name : NULL;
+}
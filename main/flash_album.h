@@ -0,0 +1,61 @@
+#ifndef FLASH_ALBUM_H
+#define FLASH_ALBUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Flash album: photos packed by tools/pack_album.py into the "photos" data partition and memory-mapped, so they are
+ * available at boot without the SD card. The image descriptors point straight into the mapped flash: JPEG/PNG data is
+ * decoded from there without a copy, and RGB565 frames are drawn in place.
+ *
+ * Layout of the partition (little endian):
+ *  - header: magic "TPAL", version, image count, total size of the album
+ *  - one entry per image: data offset from the start of the partition, size, width, height, LVGL color format, name
+ *  - image data, each aligned to FLASH_ALBUM_ALIGN
+ */
+
+#define FLASH_ALBUM_PARTITION   "photos"
+#define FLASH_ALBUM_ALIGN       (64)
+#define FLASH_ALBUM_NAME_LEN    (16)    // Including the terminator
+
+/**
+ * @brief Find the partition, check the album and map it
+ *
+ * @return
+ *      - ESP_OK: Success, including an empty album
+ *      - ESP_ERR_INVALID_STATE: Already mapped
+ *      - ESP_ERR_NOT_FOUND: No "photos" partition
+ *      - ESP_ERR_INVALID_VERSION: The partition holds no album, or a corrupted one
+ *      - Others: Errors of esp_partition_mmap()
+ */
+esp_err_t flash_album_init(void);
+
+/**
+ * @brief Number of images, 0 before `flash_album_init()`
+ */
+size_t flash_album_count(void);
+
+/**
+ * @brief Descriptor of an image, valid as long as the album stays mapped
+ *
+ * @return NULL if `index` is out of range
+ */
+const lv_img_dsc_t *flash_album_get(size_t index);
+
+/**
+ * @brief Name of an image, from the packing tool
+ */
+const char *flash_album_name(size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_ALBUM_H
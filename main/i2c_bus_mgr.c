@@ -1,36 +1,415 @@
 #include "i2c_bus_mgr.h"
-#include "driver/i2c.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "i2c_bus_mgr";
+
+#define BUS_PORT            I2C_NUM_0
+#define BUS_FREQ_HZ         (400000)
+#define MAX_XFERS           CONFIG_I2C_BUS_MAX_XFERS
+#define TASK_STACK_SIZE     (3072)
+
+struct i2c_bus_dev_t {
+    i2c_master_dev_handle_t handle;     // NULL while the entry is free
+    const char *name;
+    uint16_t addr;
+    uint32_t timeout_ms;
+    uint32_t refs;
+    uint32_t queued;                    // Transactions submitted and not completed
+    // Protected by `s_bus.lock`
+    uint64_t wait_sum_us;
+    i2c_bus_dev_stats_t stats;
+};
+
+typedef struct i2c_bus_slot_t i2c_bus_slot_t;
+
+struct i2c_bus_slot_t {
+    i2c_bus_xfer_t xfer;
+    i2c_bus_dev_handle_t dev;
+    int64_t submit_us;
+    i2c_bus_slot_t *next;               // Queue or free list
+};
+
+static struct {
+    SemaphoreHandle_t lock;             // Created once, never deleted
+    uint32_t refs;
+    i2c_master_bus_handle_t bus;
+    TaskHandle_t task;
+    SemaphoreHandle_t exited;
+    bool stopping;
+    struct i2c_bus_dev_t devs[I2C_BUS_MAX_DEVICES];
+    i2c_bus_slot_t slots[MAX_XFERS];
+    i2c_bus_slot_t *free;
+    i2c_bus_slot_t *head;               // Run in submission order
+    i2c_bus_slot_t *tail;
+    uint32_t queue_full;
+    uint32_t resets;
+} s_bus;
+
+// The manager's mutex, created by the first caller whatever task it runs in
+static SemaphoreHandle_t bus_lock(void)
+{
+    static StaticSemaphore_t lock_buf;
+    static uint32_t state;              // 0: not created, 1: being created, 2: ready
+    uint32_t expected = 0;
+    if (__atomic_compare_exchange_n(&state, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        s_bus.lock = xSemaphoreCreateMutexStatic(&lock_buf);
+        __atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2) {
+        vTaskDelay(1);
+    }
+    return s_bus.lock;
+}
+
+// Run a transaction on the bus and account it, from the bus task
+static esp_err_t xfer_run(i2c_bus_dev_handle_t dev, const i2c_bus_xfer_t *xfer, int64_t submit_us)
+{
+    const int timeout = (int)dev->timeout_ms;
+    const int64_t start_us = esp_timer_get_time();
+    esp_err_t ret;
+    if (xfer->tx_len && xfer->rx_len) {
+        ret = i2c_master_transmit_receive(dev->handle, xfer->tx, xfer->tx_len, xfer->rx, xfer->rx_len, timeout);
+    } else if (xfer->rx_len) {
+        ret = i2c_master_receive(dev->handle, xfer->rx, xfer->rx_len, timeout);
+    } else {
+        ret = i2c_master_transmit(dev->handle, xfer->tx, xfer->tx_len, timeout);
+    }
+    const int64_t end_us = esp_timer_get_time();
+    if (ret == ESP_ERR_TIMEOUT) {
+        // A slave may still hold SDA low, free the bus for the next device
+        i2c_master_bus_reset(s_bus.bus);
+    }
+
+    const uint32_t bus_us = (uint32_t)(end_us - start_us);
+    const uint32_t wait_us = (uint32_t)(start_us - submit_us);
+    xSemaphoreTake(s_bus.lock, portMAX_DELAY);
+    i2c_bus_dev_stats_t *stats = &dev->stats;
+    stats->transactions++;
+    if (ret != ESP_OK) {
+        stats->errors++;
+        stats->timeouts += (ret == ESP_ERR_TIMEOUT);
+    } else {
+        stats->bytes += xfer->tx_len + xfer->rx_len;
+    }
+    stats->bus_us += bus_us;
+    stats->bus_max_us = (bus_us > stats->bus_max_us) ? bus_us : stats->bus_max_us;
+    stats->wait_max_us = (wait_us > stats->wait_max_us) ? wait_us : stats->wait_max_us;
+    dev->wait_sum_us += wait_us;
+    s_bus.resets += (ret == ESP_ERR_TIMEOUT);
+    xSemaphoreGive(s_bus.lock);
+    return ret;
+}
+
+static void i2c_bus_task(void *arg)
+{
+    while (true) {
+        xSemaphoreTake(s_bus.lock, portMAX_DELAY);
+        i2c_bus_slot_t *slot = s_bus.head;
+        if (slot) {
+            s_bus.head = slot->next;
+            s_bus.tail = s_bus.head ? s_bus.tail : NULL;
+        }
+        const bool stopping = s_bus.stopping;
+        xSemaphoreGive(s_bus.lock);
+
+        if (!slot) {
+            if (stopping) {
+                break;
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
 
-#define TAG "i2c_bus_mgr"
-#define BUS I2C_NUM_0          // fix IO8=SDA, IO9=SCL
+        const esp_err_t ret = xfer_run(slot->dev, &slot->xfer, slot->submit_us);
+        const i2c_bus_xfer_t xfer = slot->xfer;
+        i2c_bus_dev_handle_t dev = slot->dev;
 
-static int ref_cnt = 0;        // reference counter
+        xSemaphoreTake(s_bus.lock, portMAX_DELAY);
+        dev->queued--;
+        slot->next = s_bus.free;
+        s_bus.free = slot;
+        xSemaphoreGive(s_bus.lock);
+
+        if (xfer.done) {
+            xfer.done(dev, ret, xfer.user_data);
+        }
+    }
+
+    xSemaphoreGive(s_bus.exited);
+    vTaskDelete(NULL);
+}
 
 esp_err_t i2c_bus_acquire(void)
 {
-    /* if already installed, just ref++ */
-    if (ref_cnt > 0) { ref_cnt++; return ESP_OK; }
+    SemaphoreHandle_t lock = bus_lock();
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (s_bus.refs > 0) {
+        s_bus.refs++;
+        goto out;
+    }
 
-    /* install driver only for tha first time */
-    i2c_config_t cfg = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = 8,
-        .scl_io_num = 9,
-        .master.clk_speed = 400000
+    const i2c_master_bus_config_t bus_config = {
+        .i2c_port = BUS_PORT,
+        .sda_io_num = CONFIG_STORAGE_I2C_SDA,
+        .scl_io_num = CONFIG_STORAGE_I2C_SCL,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .flags.enable_internal_pullup = true,
     };
-    ESP_RETURN_ON_ERROR(i2c_param_config(BUS, &cfg),  TAG, "");
-    esp_err_t ret = i2c_driver_install(BUS, cfg.mode, 0, 0, 0);
-    if (ret == ESP_ERR_INVALID_STATE) ret = ESP_OK;   // already installed
+    ESP_GOTO_ON_ERROR(i2c_new_master_bus(&bus_config, &s_bus.bus), out, TAG, "Bus creation failed");
 
-    if (ret == ESP_OK) ref_cnt = 1;                   // successfully mounted
+    s_bus.exited = xSemaphoreCreateBinary();
+    s_bus.stopping = false;
+    s_bus.free = NULL;
+    s_bus.head = s_bus.tail = NULL;
+    for (int i = MAX_XFERS - 1; i >= 0; i--) {
+        s_bus.slots[i].next = s_bus.free;
+        s_bus.free = &s_bus.slots[i];
+    }
+    if (!s_bus.exited || xTaskCreatePinnedToCore(i2c_bus_task, "i2c_bus", TASK_STACK_SIZE, NULL,
+                                                 CONFIG_I2C_BUS_TASK_PRIORITY, &s_bus.task,
+                                                 CONFIG_I2C_BUS_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task");
+        if (s_bus.exited) {
+            vSemaphoreDelete(s_bus.exited);
+            s_bus.exited = NULL;
+        }
+        i2c_del_master_bus(s_bus.bus);
+        s_bus.bus = NULL;
+        ret = ESP_ERR_NO_MEM;
+        goto out;
+    }
+    s_bus.refs = 1;
+    ESP_LOGI(TAG, "Bus started, SDA %d SCL %d", CONFIG_STORAGE_I2C_SDA, CONFIG_STORAGE_I2C_SCL);
+
+out:
+    xSemaphoreGive(lock);
     return ret;
 }
 
 void i2c_bus_release(void)
 {
-    if (ref_cnt == 0) return;     // prevent abnormal calls
-    if (--ref_cnt == 0) {
-        i2c_driver_delete(BUS);   // delete when the last user release it
+    SemaphoreHandle_t lock = bus_lock();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (s_bus.refs == 0 || --s_bus.refs > 0) {
+        xSemaphoreGive(lock);
+        return;
+    }
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++) {
+        if (s_bus.devs[i].handle) {
+            ESP_LOGW(TAG, "Device 0x%02x still added, bus kept", s_bus.devs[i].addr);
+            s_bus.refs = 1;
+            xSemaphoreGive(lock);
+            return;
+        }
+    }
+    s_bus.stopping = true;
+    xSemaphoreGive(lock);
+
+    xTaskNotifyGive(s_bus.task);
+    xSemaphoreTake(s_bus.exited, portMAX_DELAY);    // Queued transactions are run first
+    vSemaphoreDelete(s_bus.exited);
+    i2c_del_master_bus(s_bus.bus);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    s_bus.exited = NULL;
+    s_bus.task = NULL;
+    s_bus.bus = NULL;
+    xSemaphoreGive(lock);
+}
+
+i2c_master_bus_handle_t i2c_bus_get_handle(void)
+{
+    return s_bus.bus;
+}
+
+esp_err_t i2c_bus_add_device(const char *name, uint16_t addr, uint32_t timeout_ms, i2c_bus_dev_handle_t *dev)
+{
+    ESP_RETURN_ON_FALSE(dev && name, ESP_ERR_INVALID_ARG, TAG, "Bad arguments");
+    SemaphoreHandle_t lock = bus_lock();
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ESP_GOTO_ON_FALSE(s_bus.refs > 0, ESP_ERR_INVALID_STATE, out, TAG, "Bus not acquired");
+
+    struct i2c_bus_dev_t *entry = NULL;
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++) {
+        struct i2c_bus_dev_t *d = &s_bus.devs[i];
+        if (d->handle && d->addr == addr) {
+            d->refs++;
+            *dev = d;
+            goto out;
+        }
+        entry = (!entry && !d->handle) ? d : entry;
+    }
+    ESP_GOTO_ON_FALSE(entry, ESP_ERR_NO_MEM, out, TAG, "Too many devices");
+
+    const i2c_device_config_t dev_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = addr,
+        .scl_speed_hz = BUS_FREQ_HZ,
+    };
+    ESP_GOTO_ON_ERROR(i2c_master_bus_add_device(s_bus.bus, &dev_config, &entry->handle), out, TAG,
+                      "Can't add device 0x%02x", addr);
+    entry->name = name;
+    entry->addr = addr;
+    entry->timeout_ms = timeout_ms ? timeout_ms : CONFIG_I2C_BUS_TIMEOUT_MS;
+    entry->refs = 1;
+    entry->queued = 0;
+    entry->wait_sum_us = 0;
+    memset(&entry->stats, 0, sizeof(entry->stats));
+    *dev = entry;
+
+out:
+    xSemaphoreGive(lock);
+    return ret;
+}
+
+esp_err_t i2c_bus_remove_device(i2c_bus_dev_handle_t dev)
+{
+    ESP_RETURN_ON_FALSE(dev && dev->handle, ESP_ERR_INVALID_ARG, TAG, "Bad device");
+    SemaphoreHandle_t lock = bus_lock();
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (--dev->refs == 0) {
+        if (dev->queued) {
+            dev->refs = 1;
+            ret = ESP_ERR_INVALID_STATE;    // Transactions still refer to it
+        } else {
+            ret = i2c_master_bus_rm_device(dev->handle);
+            dev->handle = NULL;
+        }
+    }
+    xSemaphoreGive(lock);
+    return ret;
+}
+
+esp_err_t i2c_bus_submit(i2c_bus_dev_handle_t dev, const i2c_bus_xfer_t *xfer)
+{
+    if (!dev || !xfer || xfer->tx_len > I2C_BUS_TX_MAX || (!xfer->tx_len && !xfer->rx_len) ||
+            (xfer->rx_len && !xfer->rx)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_bus.lock, portMAX_DELAY);
+    i2c_bus_slot_t *slot = s_bus.free;
+    if (!slot || !dev->handle) {
+        s_bus.queue_full += (slot == NULL);
+        xSemaphoreGive(s_bus.lock);
+        return slot ? ESP_ERR_INVALID_STATE : ESP_ERR_NO_MEM;
+    }
+    s_bus.free = slot->next;
+    slot->xfer = *xfer;
+    slot->dev = dev;
+    slot->submit_us = esp_timer_get_time();
+    slot->next = NULL;
+    if (s_bus.tail) {
+        s_bus.tail->next = slot;
+    } else {
+        s_bus.head = slot;
+    }
+    s_bus.tail = slot;
+    dev->queued++;
+    xSemaphoreGive(s_bus.lock);
+
+    xTaskNotifyGive(s_bus.task);
+    return ESP_OK;
+}
+
+typedef struct {
+    SemaphoreHandle_t done;
+    esp_err_t status;
+} i2c_bus_wait_t;
+
+static void i2c_bus_wait_done(i2c_bus_dev_handle_t dev, esp_err_t status, void *user_data)
+{
+    i2c_bus_wait_t *wait = user_data;
+    wait->status = status;
+    xSemaphoreGive(wait->done);
+}
+
+esp_err_t i2c_bus_write_read(i2c_bus_dev_handle_t dev, const void *tx, size_t tx_len, void *rx, size_t rx_len)
+{
+    i2c_bus_xfer_t xfer = {
+        .tx_len = tx_len,
+        .rx = rx,
+        .rx_len = rx_len,
+    };
+    if (!dev || tx_len > I2C_BUS_TX_MAX || (tx_len && !tx)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (tx_len) {
+        memcpy(xfer.tx, tx, tx_len);
+    }
+
+    // Waiting for the queue from the bus task would never end
+    if (xTaskGetCurrentTaskHandle() == s_bus.task) {
+        return xfer_run(dev, &xfer, esp_timer_get_time());
+    }
+
+    StaticSemaphore_t sem_buf;
+    i2c_bus_wait_t wait = {
+        .done = xSemaphoreCreateBinaryStatic(&sem_buf),
+    };
+    xfer.done = i2c_bus_wait_done;
+    xfer.user_data = &wait;
+
+    esp_err_t ret = i2c_bus_submit(dev, &xfer);
+    if (ret == ESP_OK) {
+        xSemaphoreTake(wait.done, portMAX_DELAY);
+        ret = wait.status;
+    }
+    vSemaphoreDelete(wait.done);
+    return ret;
+}
+
+esp_err_t i2c_bus_write(i2c_bus_dev_handle_t dev, const void *data, size_t len)
+{
+    return i2c_bus_write_read(dev, data, len, NULL, 0);
+}
+
+esp_err_t i2c_bus_get_dev_stats(i2c_bus_dev_handle_t dev, i2c_bus_dev_stats_t *stats, bool reset)
+{
+    ESP_RETURN_ON_FALSE(dev && stats, ESP_ERR_INVALID_ARG, TAG, "Bad arguments");
+
+    xSemaphoreTake(bus_lock(), portMAX_DELAY);
+    *stats = dev->stats;
+    stats->addr = dev->addr;
+    stats->name = dev->name;
+    stats->wait_avg_us = dev->stats.transactions ? (uint32_t)(dev->wait_sum_us / dev->stats.transactions) : 0;
+    if (reset) {
+        memset(&dev->stats, 0, sizeof(dev->stats));
+        dev->wait_sum_us = 0;
+    }
+    xSemaphoreGive(s_bus.lock);
+    return ESP_OK;
+}
+
+void i2c_bus_log_stats(void)
+{
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++) {
+        i2c_bus_dev_stats_t stats;
+        if (!s_bus.devs[i].handle || i2c_bus_get_dev_stats(&s_bus.devs[i], &stats, false) != ESP_OK) {
+            continue;
+        }
+        ESP_LOGI(TAG, "0x%02x %-10s %lu transactions, %lu errors (%lu timeouts), %llu bytes, bus %llu us "
+                 "(max %lu), wait avg %lu us, max %lu us", stats.addr, stats.name,
+                 (unsigned long)stats.transactions, (unsigned long)stats.errors, (unsigned long)stats.timeouts,
+                 (unsigned long long)stats.bytes, (unsigned long long)stats.bus_us, (unsigned long)stats.bus_max_us,
+                 (unsigned long)stats.wait_avg_us, (unsigned long)stats.wait_max_us);
     }
+    ESP_LOGI(TAG, "queue full %lu, bus resets %lu", (unsigned long)s_bus.queue_full, (unsigned long)s_bus.resets);
 }
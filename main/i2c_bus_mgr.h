@@ -1,13 +1,143 @@
 #pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_err.h"
+#include "driver/i2c_master.h"
 
 #ifdef __cplusplus
 extern "C" {
-    #endif
+#endif
+
+/**
+ * Manager of the shared I2C bus (CH422G expander, touch, sensors) on the i2c_master driver.
+ *  - One task owns the transactions of the manager and runs them in submission order, each with the timeout of its
+ *    device, so a device that doesn't answer delays the others by its own timeout only.
+ *  - Transactions are submitted without waiting and completed through a callback, or run synchronously.
+ *  - Each device accounts its transactions, errors, bytes, time on the bus and time waiting in the queue.
+ *  - Drivers talking to the bus directly (the touch panel IO through `i2c_bus_get_handle()`) are serialized with the
+ *    manager by the driver's bus lock, but not accounted.
+ */
+
+#define I2C_BUS_TX_MAX          (16)    // Bytes written by a transaction, copied on submit
+#define I2C_BUS_MAX_DEVICES     (8)
+
+typedef struct i2c_bus_dev_t *i2c_bus_dev_handle_t;
+
+/**
+ * @brief Completion callback, called from the bus task
+ *
+ * @param status ESP_OK, ESP_ERR_TIMEOUT, ESP_ERR_INVALID_RESPONSE (NACK) or another error of the driver
+ */
+typedef void (*i2c_bus_done_cb_t)(i2c_bus_dev_handle_t dev, esp_err_t status, void *user_data);
+
+typedef struct {
+    uint8_t tx[I2C_BUS_TX_MAX];     // Bytes to write first
+    size_t tx_len;
+    void *rx;                       // Then bytes to read, after a repeated start. Must stay valid until completion.
+    size_t rx_len;
+    i2c_bus_done_cb_t done;         // Can be NULL
+    void *user_data;
+} i2c_bus_xfer_t;
+
+/**
+ * @brief Statistics of a device
+ */
+typedef struct {
+    uint16_t addr;
+    const char *name;
+    uint32_t transactions;
+    uint32_t errors;                // Including timeouts
+    uint32_t timeouts;
+    uint64_t bytes;                 // Written and read
+    uint64_t bus_us;                // Time on the bus
+    uint32_t bus_max_us;            // Longest transaction
+    uint32_t wait_avg_us;           // Time from submit to the start of the transaction
+    uint32_t wait_max_us;
+} i2c_bus_dev_stats_t;
+
+/**
+ * @brief Take a reference on the bus, creating it and the bus task on the first call
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_NO_MEM: Can't create the task
+ *      - Others: Error of `i2c_new_master_bus()`
+ */
+esp_err_t i2c_bus_acquire(void);
 
-    esp_err_t i2c_bus_acquire(void);   // acquire i2c driver（install and ref++）
-    void      i2c_bus_release(void);   // ref--、delete when ref = 0
+/**
+ * @brief Drop a reference, the bus is deleted with the last one once all devices are removed
+ */
+void i2c_bus_release(void);
 
-    #ifdef __cplusplus
+/**
+ * @brief Handle of the bus, for drivers creating their own devices on it (e.g. `esp_lcd_new_panel_io_i2c()`)
+ *
+ * @return The handle, NULL if the bus is not acquired
+ */
+i2c_master_bus_handle_t i2c_bus_get_handle(void);
+
+/**
+ * @brief Add a device. Adding an address again returns the same handle, which must be removed as many times.
+ *
+ * @param name Used in the statistics, must stay valid
+ * @param timeout_ms Timeout of each transaction, 0 for CONFIG_I2C_BUS_TIMEOUT_MS
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: The bus is not acquired
+ *      - ESP_ERR_NO_MEM: I2C_BUS_MAX_DEVICES devices already
+ *      - Others: Error of `i2c_master_bus_add_device()`
+ */
+esp_err_t i2c_bus_add_device(const char *name, uint16_t addr, uint32_t timeout_ms, i2c_bus_dev_handle_t *dev);
+
+/**
+ * @brief Remove a device
+ *
+ * @return
+ *      - ESP_OK: Success, or references remain
+ *      - ESP_ERR_INVALID_STATE: Transactions of the device are still queued
+ */
+esp_err_t i2c_bus_remove_device(i2c_bus_dev_handle_t dev);
+
+/**
+ * @brief Queue a transaction without waiting
+ *
+ * @return
+ *      - ESP_OK: Queued, `done` will be called exactly once
+ *      - ESP_ERR_INVALID_ARG: Nothing to transfer, or more than I2C_BUS_TX_MAX bytes to write
+ *      - ESP_ERR_NO_MEM: All CONFIG_I2C_BUS_MAX_XFERS transactions are in use
+ *      - ESP_ERR_INVALID_STATE: The device was removed
+ */
+esp_err_t i2c_bus_submit(i2c_bus_dev_handle_t dev, const i2c_bus_xfer_t *xfer);
+
+/**
+ * @brief Write, then read if `rx_len` is not 0, and wait for the result. From a completion callback, the
+ *        transaction is run at once instead of being queued behind the others.
+ *
+ * @return Same status as the completion callback, or an error of `i2c_bus_submit()`
+ */
+esp_err_t i2c_bus_write_read(i2c_bus_dev_handle_t dev, const void *tx, size_t tx_len, void *rx, size_t rx_len);
+
+/**
+ * @brief `i2c_bus_write_read()` without reading
+ */
+esp_err_t i2c_bus_write(i2c_bus_dev_handle_t dev, const void *data, size_t len);
+
+/**
+ * @brief Get the statistics of a device
+ *
+ * @param reset Clear them after reading
+ */
+esp_err_t i2c_bus_get_dev_stats(i2c_bus_dev_handle_t dev, i2c_bus_dev_stats_t *stats, bool reset);
+
+/**
+ * @brief Print the statistics of all devices with ESP_LOGI
+ */
+void i2c_bus_log_stats(void);
+
+#ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,295 @@
+#include "image_arena.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#define RING_SIZE       ((size_t)CONFIG_IMAGE_ARENA_RING_KB * 1024)
+#define SLOT_SIZE       (((size_t)CONFIG_IMAGE_ARENA_SLOT_KB * 1024 + IMAGE_ARENA_ALIGN - 1) & ~(size_t)(IMAGE_ARENA_ALIGN - 1))
+#define SLOT_COUNT      (CONFIG_IMAGE_ARENA_SLOTS)
+#define BLOCK_HDR_SIZE  (IMAGE_ARENA_ALIGN)     // Keeps the payload aligned
+#define NO_BLOCK        (UINT32_MAX)
+
+static const char *TAG = "arena";
+
+_Static_assert(SLOT_COUNT <= 32, "Slots are tracked in a 32-bit mask");
+
+// Header at the start of every ring block
+typedef struct {
+    uint32_t size;                              // Whole block, header included
+    uint32_t freed;                             // Freed, waiting to become the oldest or the newest block
+    uint32_t prev;                              // Offset of the block allocated before, NO_BLOCK if none
+} block_hdr_t;
+
+/**
+ * Ring state. Pinned blocks are in [0, floor) and stay until they are freed or the ring is reset, the other blocks
+ * cycle above them. Not wrapped: those blocks are in [tail, head). Wrapped: they are in [tail, data_end) and
+ * [floor, head), and the free space is [head, tail).
+ */
+static struct {
+    uint8_t *base;                              // Whole reservation: ring, then slots
+    size_t floor;
+    size_t head;
+    size_t tail;
+    size_t data_end;
+    size_t newest;                              // Offset of the newest block, valid while there is one
+    bool wrapped;
+    uint32_t pinned_blocks;
+    uint8_t *slots;
+    uint32_t slot_mask;                         // Bit n set while slot n is acquired
+    image_arena_usage_t usage;
+} s_arena;
+
+static portMUX_TYPE s_arena_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t image_arena_init(void)
+{
+    if (s_arena.base) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const size_t total = RING_SIZE + SLOT_SIZE * SLOT_COUNT;
+    s_arena.base = heap_caps_aligned_alloc(IMAGE_ARENA_ALIGN, total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_arena.base) {
+        ESP_LOGE(TAG, "Failed to reserve %u bytes of PSRAM", (unsigned)total);
+        return ESP_ERR_NO_MEM;
+    }
+    s_arena.slots = s_arena.base + RING_SIZE;
+    s_arena.usage.ring_size = RING_SIZE;
+    s_arena.usage.slot_size = SLOT_SIZE;
+    s_arena.usage.slots = SLOT_COUNT;
+    image_arena_reset();
+
+    ESP_LOGI(TAG, "Reserved %u KB ring + %d x %u KB slots", (unsigned)(RING_SIZE / 1024), SLOT_COUNT,
+             (unsigned)(SLOT_SIZE / 1024));
+    return ESP_OK;
+}
+
+// Blocks above the floor
+static uint32_t ring_blocks(void)
+{
+    return s_arena.usage.ring_blocks - s_arena.pinned_blocks;
+}
+
+// Empty the part above the floor, and drop the floor once no pinned block is left
+static void ring_clear(void)
+{
+    if (s_arena.pinned_blocks == 0) {
+        s_arena.floor = 0;
+        s_arena.usage.ring_pinned = 0;
+    }
+    s_arena.head = s_arena.floor;
+    s_arena.tail = s_arena.floor;
+    s_arena.data_end = RING_SIZE;
+    s_arena.wrapped = false;
+}
+
+size_t image_arena_block_size(size_t size)
+{
+    return (size + BLOCK_HDR_SIZE + IMAGE_ARENA_ALIGN - 1) & ~(size_t)(IMAGE_ARENA_ALIGN - 1);
+}
+
+void *image_arena_alloc(size_t size)
+{
+    if (!s_arena.base || size == 0 || size > RING_SIZE) {
+        return NULL;
+    }
+    const size_t need = image_arena_block_size(size);
+    size_t offset = SIZE_MAX;
+
+    portENTER_CRITICAL(&s_arena_lock);
+    if (ring_blocks() == 0) {
+        ring_clear();
+    }
+    if (!s_arena.wrapped) {
+        if (RING_SIZE - s_arena.head >= need) {
+            offset = s_arena.head;
+        } else if (s_arena.tail - s_arena.floor >= need) {
+            // Wrap around, the end of the ring stays unused until the tail passes it
+            s_arena.data_end = s_arena.head;
+            s_arena.wrapped = true;
+            offset = s_arena.floor;
+        }
+    } else if (s_arena.tail - s_arena.head >= need) {
+        offset = s_arena.head;
+    }
+
+    if (offset == SIZE_MAX) {
+        s_arena.usage.ring_failures++;
+        portEXIT_CRITICAL(&s_arena_lock);
+        return NULL;
+    }
+    block_hdr_t *hdr = (block_hdr_t *)(s_arena.base + offset);
+    hdr->size = need;
+    hdr->freed = 0;
+    hdr->prev = ring_blocks() > 0 ? s_arena.newest : NO_BLOCK;
+    s_arena.newest = offset;
+    s_arena.head = offset + need;
+    s_arena.usage.ring_blocks++;
+    s_arena.usage.ring_allocs++;
+    s_arena.usage.ring_used += need;
+    if (s_arena.usage.ring_used > s_arena.usage.ring_peak) {
+        s_arena.usage.ring_peak = s_arena.usage.ring_used;
+    }
+    portEXIT_CRITICAL(&s_arena_lock);
+
+    return (uint8_t *)hdr + BLOCK_HDR_SIZE;
+}
+
+// Drop freed blocks from the tail, they are reclaimed in allocation order
+static void ring_reclaim_tail(void)
+{
+    while (ring_blocks() > 0) {
+        block_hdr_t *hdr = (block_hdr_t *)(s_arena.base + s_arena.tail);
+        if (!hdr->freed) {
+            break;
+        }
+        s_arena.tail += hdr->size;
+        s_arena.usage.ring_blocks--;
+        if (s_arena.wrapped && s_arena.tail == s_arena.data_end) {
+            s_arena.tail = s_arena.floor;
+            s_arena.data_end = RING_SIZE;
+            s_arena.wrapped = false;
+        }
+    }
+    if (ring_blocks() == 0) {
+        ring_clear();
+    }
+}
+
+// Drop freed blocks from the head, newest first, e.g. a load that failed halfway and the blocks freed before it
+static void ring_reclaim_head(void)
+{
+    while (ring_blocks() > 0) {
+        block_hdr_t *hdr = (block_hdr_t *)(s_arena.base + s_arena.newest);
+        if (!hdr->freed) {
+            break;
+        }
+        s_arena.head = s_arena.newest;
+        s_arena.usage.ring_blocks--;
+        if (s_arena.wrapped && s_arena.newest == s_arena.floor) {
+            s_arena.head = s_arena.data_end;
+            s_arena.data_end = RING_SIZE;
+            s_arena.wrapped = false;
+        }
+        s_arena.newest = hdr->prev;
+    }
+    if (ring_blocks() == 0) {
+        ring_clear();
+    }
+}
+
+void image_arena_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    uint8_t *block = (uint8_t *)ptr - BLOCK_HDR_SIZE;
+    assert(block >= s_arena.base && block < s_arena.base + RING_SIZE);
+    block_hdr_t *hdr = (block_hdr_t *)block;
+    const size_t offset = block - s_arena.base;
+
+    portENTER_CRITICAL(&s_arena_lock);
+    assert(!hdr->freed);
+    hdr->freed = 1;
+    s_arena.usage.ring_used -= hdr->size;
+    if (offset < s_arena.floor) {
+        // Pinned: its space comes back with the floor, once all pinned blocks are gone
+        s_arena.pinned_blocks--;
+        s_arena.usage.ring_blocks--;
+        if (s_arena.pinned_blocks == 0 && ring_blocks() == 0) {
+            ring_clear();
+        }
+    } else if (offset == s_arena.tail) {
+        ring_reclaim_tail();
+    } else if (offset == s_arena.newest) {
+        ring_reclaim_head();
+    }
+    portEXIT_CRITICAL(&s_arena_lock);
+}
+
+esp_err_t image_arena_pin(void)
+{
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&s_arena_lock);
+    if (s_arena.wrapped) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (ring_blocks() > 0) {
+        s_arena.floor = s_arena.head;
+        s_arena.pinned_blocks = s_arena.usage.ring_blocks;
+        s_arena.usage.ring_pinned = s_arena.floor;
+        ring_clear();
+    }
+    portEXIT_CRITICAL(&s_arena_lock);
+    return ret;
+}
+
+void *image_arena_slot_acquire(int *slot)
+{
+    assert(slot);
+    void *buf = NULL;
+
+    portENTER_CRITICAL(&s_arena_lock);
+    for (int i = 0; i < SLOT_COUNT && s_arena.base; i++) {
+        if (!(s_arena.slot_mask & (1UL << i))) {
+            s_arena.slot_mask |= 1UL << i;
+            s_arena.usage.slots_used++;
+            *slot = i;
+            buf = s_arena.slots + SLOT_SIZE * i;
+            break;
+        }
+    }
+    if (!buf) {
+        s_arena.usage.slot_failures++;
+    }
+    portEXIT_CRITICAL(&s_arena_lock);
+    return buf;
+}
+
+void image_arena_slot_release(int slot)
+{
+    if (slot < 0 || slot >= SLOT_COUNT) {
+        return;
+    }
+    portENTER_CRITICAL(&s_arena_lock);
+    if (s_arena.slot_mask & (1UL << slot)) {
+        s_arena.slot_mask &= ~(1UL << slot);
+        s_arena.usage.slots_used--;
+    }
+    portEXIT_CRITICAL(&s_arena_lock);
+}
+
+void image_arena_reset(void)
+{
+    // Slots stay with their owners, e.g. the frame on screen, and are released by them
+    portENTER_CRITICAL(&s_arena_lock);
+    s_arena.pinned_blocks = 0;
+    ring_clear();
+    s_arena.usage.ring_used = 0;
+    s_arena.usage.ring_peak = 0;
+    s_arena.usage.ring_blocks = 0;
+    portEXIT_CRITICAL(&s_arena_lock);
+}
+
+void image_arena_get_usage(image_arena_usage_t *usage)
+{
+    assert(usage);
+    portENTER_CRITICAL(&s_arena_lock);
+    *usage = s_arena.usage;
+    portEXIT_CRITICAL(&s_arena_lock);
+}
+
+void image_arena_log_usage(void)
+{
+    image_arena_usage_t usage;
+    image_arena_get_usage(&usage);
+    ESP_LOGI(TAG, "ring %u/%u KB (%u KB pinned, peak %u KB, %lu blocks, %lu failures), slots %lu/%lu (%lu failures)",
+             (unsigned)(usage.ring_used / 1024), (unsigned)(usage.ring_size / 1024), (unsigned)(usage.ring_pinned / 1024),
+             (unsigned)(usage.ring_peak / 1024), (unsigned long)usage.ring_blocks, (unsigned long)usage.ring_failures,
+             (unsigned long)usage.slots_used, (unsigned long)usage.slots, (unsigned long)usage.slot_failures);
+}
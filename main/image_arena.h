@@ -0,0 +1,120 @@
+#ifndef IMAGE_ARENA_H
+#define IMAGE_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Image arena: one PSRAM region reserved at startup for slide data, so that loading albums never fragments the heap.
+ *  - ring: variable size blocks for compressed files (JPG/PNG), allocated in order and normally freed in order.
+ *    Blocks freed out of order are reclaimed once they become the oldest or the newest block. `image_arena_pin()`
+ *    keeps the blocks allocated so far, e.g. the preloaded slides, below the part that cycles, so that they don't hold
+ *    back the blocks allocated after them.
+ *  - slots: fixed size buffers for decoded frames.
+ * `image_arena_reset()` drops all ring blocks at once, e.g. on an album change.
+ */
+
+#define IMAGE_ARENA_ALIGN       (64)    // Alignment of all buffers, a PSRAM cache line / DMA friendly
+
+/**
+ * @brief Occupancy of the arena
+ */
+typedef struct {
+    size_t ring_size;           // Capacity of the ring
+    size_t ring_pinned;         // Space below the blocks that cycle, kept by pinned blocks, see `image_arena_pin()`
+    size_t ring_used;           // Bytes held by live blocks, headers included
+    size_t ring_peak;           // Largest `ring_used` since the last reset
+    uint32_t ring_blocks;       // Live blocks
+    uint32_t ring_allocs;       // Blocks allocated since boot
+    uint32_t ring_failures;     // Allocations that did not fit
+    size_t slot_size;           // Size of one decoded frame slot
+    uint32_t slots;             // Number of slots
+    uint32_t slots_used;        // Slots currently acquired
+    uint32_t slot_failures;     // Acquisitions with no free slot
+} image_arena_usage_t;
+
+/**
+ * @brief Reserve the arena in PSRAM
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: Already initialized
+ *      - ESP_ERR_NO_MEM: Not enough PSRAM
+ */
+esp_err_t image_arena_init(void);
+
+/**
+ * @brief Allocate a block for compressed data from the ring
+ *
+ * @return Pointer aligned to IMAGE_ARENA_ALIGN, or NULL if the ring is full
+ */
+void *image_arena_alloc(size_t size);
+
+/**
+ * @brief Free a block returned by `image_arena_alloc()`
+ */
+void image_arena_free(void *ptr);
+
+/**
+ * @brief Ring space taken by a block of `size` bytes, header and alignment included
+ *
+ * @note A block fits once the blocks allocated before it are freed if this is at most
+ *       `usage.ring_size - usage.ring_pinned`.
+ */
+size_t image_arena_block_size(size_t size);
+
+/**
+ * @brief Pin the live ring blocks: later blocks cycle in the space above them
+ *
+ * @note Pinned blocks are freed as usual, their space comes back once all of them are freed and the part above
+ *       them is empty, or with `image_arena_reset()`.
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: The ring is wrapped, the live blocks are not in one piece
+ */
+esp_err_t image_arena_pin(void);
+
+/**
+ * @brief Acquire a slot for a decoded frame
+ *
+ * @param[out] slot: Index of the slot, for `image_arena_slot_release()`
+ *
+ * @return Buffer of `usage.slot_size` bytes, or NULL if all slots are in use
+ */
+void *image_arena_slot_acquire(int *slot);
+
+/**
+ * @brief Release a slot acquired with `image_arena_slot_acquire()`
+ */
+void image_arena_slot_release(int slot);
+
+/**
+ * @brief Free all ring blocks at once
+ *
+ * @note Every block returned by `image_arena_alloc()` becomes invalid, nothing may still be decoding from it.
+ *       Acquired slots are kept until `image_arena_slot_release()`, so the frame on screen stays valid.
+ */
+void image_arena_reset(void);
+
+/**
+ * @brief Get the occupancy of the arena
+ */
+void image_arena_get_usage(image_arena_usage_t *usage);
+
+/**
+ * @brief Log the occupancy of the arena
+ */
+void image_arena_log_usage(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMAGE_ARENA_H
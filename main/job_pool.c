@@ -0,0 +1,357 @@
+#include "job_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "job_pool";
+
+#define MAX_LOOPS           CONFIG_JOB_POOL_MAX_LOOPS
+#define DEQUE_LEN           (32)        // Ranges per deque, a power of two. Halving 2^32 rows needs 32.
+#define TASK_STACK_SIZE     (4096)
+
+// A loop in flight, owned by the task that called `job_pool_parallel_for()`
+typedef struct {
+    job_pool_fn_t fn;
+    void *arg;
+    uint32_t grain;
+    uint32_t pending;               // Ranges not finished yet, atomic
+    SemaphoreHandle_t done;         // Given when `pending` drops to 0
+    bool busy;                      // Protected by `s_pool.loops_lock`
+} job_loop_t;
+
+typedef struct {
+    job_loop_t *loop;
+    uint32_t begin;
+    uint32_t end;
+} job_range_t;
+
+// Ranges of a core: its own tasks push and pop at the bottom, other cores steal at the top
+typedef struct {
+    portMUX_TYPE lock;
+    uint32_t top;
+    uint32_t bottom;
+    job_range_t ranges[DEQUE_LEN];
+} job_deque_t;
+
+static struct {
+    size_t workers;
+    job_deque_t deques[JOB_POOL_MAX_WORKERS];
+    TaskHandle_t tasks[JOB_POOL_MAX_WORKERS];
+    uint32_t idle;                  // Bit per worker waiting for its notification, atomic
+    bool stopping;
+    SemaphoreHandle_t exited;
+    portMUX_TYPE loops_lock;
+    job_loop_t loops[MAX_LOOPS];
+    job_pool_stats_t stats;         // Updated with atomics
+} s_pool = {
+    .loops_lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+#define STAT_ADD(field, n)  __atomic_fetch_add(&s_pool.stats.field, (n), __ATOMIC_RELAXED)
+
+static bool deque_push(job_deque_t *dq, const job_range_t *range)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&dq->lock);
+    if (dq->bottom - dq->top < DEQUE_LEN) {
+        dq->ranges[dq->bottom % DEQUE_LEN] = *range;
+        dq->bottom++;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&dq->lock);
+    return ok;
+}
+
+static bool deque_pop(job_deque_t *dq, job_range_t *range)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&dq->lock);
+    if (dq->bottom != dq->top) {
+        dq->bottom--;
+        *range = dq->ranges[dq->bottom % DEQUE_LEN];
+        ok = true;
+    }
+    portEXIT_CRITICAL(&dq->lock);
+    return ok;
+}
+
+static bool deque_steal(job_deque_t *dq, job_range_t *range)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&dq->lock);
+    if (dq->bottom != dq->top) {
+        *range = dq->ranges[dq->top % DEQUE_LEN];
+        dq->top++;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&dq->lock);
+    return ok;
+}
+
+// Wake one idle worker for a range just pushed. A worker sets its idle bit before its last look at the deques,
+// so either it sees the range or the pusher sees the bit.
+static void wake_worker(void)
+{
+    uint32_t idle = __atomic_load_n(&s_pool.idle, __ATOMIC_SEQ_CST);
+    while (idle) {
+        const uint32_t bit = idle & -idle;
+        if (__atomic_fetch_and(&s_pool.idle, ~bit, __ATOMIC_SEQ_CST) & bit) {
+            xTaskNotifyGive(s_pool.tasks[__builtin_ctz(bit)]);
+            return;
+        }
+        idle = __atomic_load_n(&s_pool.idle, __ATOMIC_SEQ_CST);
+    }
+}
+
+// Worker index of the calling task, or -1
+static int worker_index(void)
+{
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (size_t i = 0; i < s_pool.workers; i++) {
+        if (s_pool.tasks[i] == self) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Deque used by the calling task: its own for a worker, the one of the core it runs on otherwise
+static size_t home_deque(int worker)
+{
+    return (worker >= 0) ? (size_t)worker : (size_t)xPortGetCoreID() % s_pool.workers;
+}
+
+static void loop_finish(job_loop_t *loop, uint32_t n)
+{
+    if (__atomic_sub_fetch(&loop->pending, n, __ATOMIC_ACQ_REL) == 0) {
+        xSemaphoreGive(loop->done);
+    }
+}
+
+// Split off upper halves for the other cores until the grain, then run what is left
+static void run_range(job_range_t range, size_t home, int worker)
+{
+    job_loop_t *loop = range.loop;
+    while (range.end - range.begin > loop->grain) {
+        const uint32_t mid = range.begin + (range.end - range.begin) / 2;
+        const job_range_t upper = { .loop = loop, .begin = mid, .end = range.end };
+        __atomic_fetch_add(&loop->pending, 1, __ATOMIC_RELAXED);   // Before a thief can finish it
+        if (!deque_push(&s_pool.deques[home], &upper)) {
+            __atomic_fetch_sub(&loop->pending, 1, __ATOMIC_RELAXED);
+            STAT_ADD(deque_full, 1);
+            break;
+        }
+        wake_worker();
+        range.end = mid;
+    }
+
+    const int64_t start = esp_timer_get_time();
+    loop->fn(range.begin, range.end, loop->arg);
+    STAT_ADD(ranges, 1);
+    if (worker >= 0) {
+        STAT_ADD(worker_ranges[worker], 1);
+        STAT_ADD(worker_busy_us[worker], (uint64_t)(esp_timer_get_time() - start));
+    }
+    loop_finish(loop, 1);
+}
+
+// Run one queued range, from the home deque first, returns false if all deques are empty
+static bool run_one(size_t home, int worker)
+{
+    job_range_t range;
+    if (deque_pop(&s_pool.deques[home], &range)) {
+        run_range(range, home, worker);
+        return true;
+    }
+    for (size_t i = 1; i < s_pool.workers; i++) {
+        if (deque_steal(&s_pool.deques[(home + i) % s_pool.workers], &range)) {
+            STAT_ADD(steals, 1);
+            run_range(range, home, worker);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void worker_task(void *arg)
+{
+    const int index = (int)(intptr_t)arg;
+    const uint32_t bit = 1UL << index;
+
+    while (!__atomic_load_n(&s_pool.stopping, __ATOMIC_ACQUIRE)) {
+        if (run_one(index, index)) {
+            continue;
+        }
+        __atomic_fetch_or(&s_pool.idle, bit, __ATOMIC_SEQ_CST);
+        if (run_one(index, index)) {
+            __atomic_fetch_and(&s_pool.idle, ~bit, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(s_pool.exited);
+    vTaskDelete(NULL);
+}
+
+static job_loop_t *loop_acquire(void)
+{
+    job_loop_t *loop = NULL;
+    portENTER_CRITICAL(&s_pool.loops_lock);
+    for (size_t i = 0; i < MAX_LOOPS && s_pool.workers; i++) {
+        if (!s_pool.loops[i].busy) {
+            loop = &s_pool.loops[i];
+            loop->busy = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_pool.loops_lock);
+    return loop;
+}
+
+static void loop_release(job_loop_t *loop)
+{
+    portENTER_CRITICAL(&s_pool.loops_lock);
+    loop->busy = false;
+    portEXIT_CRITICAL(&s_pool.loops_lock);
+}
+
+void job_pool_parallel_for(uint32_t begin, uint32_t end, uint32_t grain, job_pool_fn_t fn, void *arg)
+{
+    if (begin >= end) {
+        return;
+    }
+    STAT_ADD(loops, 1);
+    grain = grain ? grain : 1;
+
+    job_loop_t *loop = (end - begin > grain) ? loop_acquire() : NULL;
+    if (!loop) {
+        STAT_ADD(serial, 1);
+        fn(begin, end, arg);
+        return;
+    }
+
+    loop->fn = fn;
+    loop->arg = arg;
+    loop->grain = grain;
+    __atomic_store_n(&loop->pending, 1, __ATOMIC_RELAXED);
+
+    const int worker = worker_index();
+    const size_t home = home_deque(worker);
+    const job_range_t range = { .loop = loop, .begin = begin, .end = end };
+    run_range(range, home, worker);
+
+    // Help with whatever is queued rather than sleeping while other cores finish
+    while (__atomic_load_n(&loop->pending, __ATOMIC_ACQUIRE) != 0 && run_one(home, worker)) {
+    }
+    xSemaphoreTake(loop->done, portMAX_DELAY);
+    loop_release(loop);
+}
+
+esp_err_t job_pool_init(size_t workers)
+{
+    if (s_pool.workers) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    workers = workers ? workers : portNUM_PROCESSORS;
+    if (workers > JOB_POOL_MAX_WORKERS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_pool.exited = xSemaphoreCreateCounting(JOB_POOL_MAX_WORKERS, 0);
+    if (!s_pool.exited) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < MAX_LOOPS; i++) {
+        s_pool.loops[i].done = xSemaphoreCreateBinary();
+        if (!s_pool.loops[i].done) {
+            job_pool_deinit();
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    for (size_t i = 0; i < workers; i++) {
+        s_pool.deques[i] = (job_deque_t) {
+            .lock = portMUX_INITIALIZER_UNLOCKED,
+        };
+    }
+    s_pool.stopping = false;
+    s_pool.idle = 0;
+    memset(&s_pool.stats, 0, sizeof(s_pool.stats));
+
+    // Workers only look at `s_pool.workers` deques and tasks, publish both before starting them
+    s_pool.workers = workers;
+    for (size_t i = 0; i < workers; i++) {
+        char name[8];
+        snprintf(name, sizeof(name), "jobs%u", (unsigned)i);
+        if (xTaskCreatePinnedToCore(worker_task, name, TASK_STACK_SIZE, (void *)(intptr_t)i,
+                                    CONFIG_JOB_POOL_TASK_PRIORITY, &s_pool.tasks[i], i % portNUM_PROCESSORS) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create worker %u", (unsigned)i);
+            job_pool_deinit();
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    ESP_LOGI(TAG, "Started, %u workers", (unsigned)workers);
+    return ESP_OK;
+}
+
+void job_pool_deinit(void)
+{
+    size_t started = 0;
+    for (size_t i = 0; i < s_pool.workers; i++) {
+        started += (s_pool.tasks[i] != NULL);
+    }
+
+    __atomic_store_n(&s_pool.stopping, true, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < s_pool.workers; i++) {
+        if (s_pool.tasks[i]) {
+            xTaskNotifyGive(s_pool.tasks[i]);
+        }
+    }
+    for (size_t i = 0; i < started; i++) {
+        xSemaphoreTake(s_pool.exited, portMAX_DELAY);
+    }
+
+    for (size_t i = 0; i < MAX_LOOPS; i++) {
+        if (s_pool.loops[i].done) {
+            vSemaphoreDelete(s_pool.loops[i].done);
+            s_pool.loops[i].done = NULL;
+        }
+    }
+    if (s_pool.exited) {
+        vSemaphoreDelete(s_pool.exited);
+        s_pool.exited = NULL;
+    }
+    memset(s_pool.tasks, 0, sizeof(s_pool.tasks));
+    s_pool.workers = 0;
+}
+
+void job_pool_get_stats(job_pool_stats_t *stats, bool reset)
+{
+    // The counters are updated without a lock, a snapshot taken during a loop can be off by its last ranges
+    *stats = s_pool.stats;
+    if (reset) {
+        memset(&s_pool.stats, 0, sizeof(s_pool.stats));
+    }
+    stats->workers = s_pool.workers;
+}
+
+void job_pool_log_stats(void)
+{
+    job_pool_stats_t stats;
+    job_pool_get_stats(&stats, false);
+    ESP_LOGI(TAG, "%u loops (%u serial), %u ranges, %u stolen, %u unsplit",
+             (unsigned)stats.loops, (unsigned)stats.serial, (unsigned)stats.ranges, (unsigned)stats.steals,
+             (unsigned)stats.deque_full);
+    for (size_t i = 0; i < stats.workers; i++) {
+        ESP_LOGI(TAG, "  worker %u: %u ranges, busy %llu ms", (unsigned)i, (unsigned)stats.worker_ranges[i],
+                 (unsigned long long)(stats.worker_busy_us[i] / 1000));
+    }
+}
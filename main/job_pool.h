@@ -0,0 +1,87 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Job pool for data parallel image kernels (resizing, pixel conversion, ...) working on independent rows or tiles.
+ *  - One worker task per core, each with its own deque of ranges. `job_pool_parallel_for()` splits its range in
+ *    halves down to the grain, pushing the upper halves on the deque of the calling core and running the lower
+ *    ones, so a core always works on the cache-friendly end of its own range.
+ *  - Idle workers steal the oldest, i.e. the largest, ranges from the other deques.
+ *  - The calling task takes part in the loop and returns once the whole range is done. While it waits, it runs
+ *    queued ranges, so loops can be nested in a kernel and called from any task, including a worker.
+ *  - Without the pool (not started, or all CONFIG_JOB_POOL_MAX_LOOPS loops in flight) the caller runs the range
+ *    alone, a kernel doesn't need to care.
+ */
+
+#define JOB_POOL_MAX_WORKERS    (8)     // Host builds can start more workers than cores
+
+/**
+ * @brief Kernel run on rows (or tiles, ...) `begin` to `end - 1`, from the calling task or a worker
+ */
+typedef void (*job_pool_fn_t)(uint32_t begin, uint32_t end, void *arg);
+
+/**
+ * @brief Statistics of the pool
+ */
+typedef struct {
+    uint32_t loops;             // Calls to `job_pool_parallel_for()`
+    uint32_t serial;            // Loops run by the caller alone
+    uint32_t ranges;            // Ranges run, after splitting
+    uint32_t steals;            // Ranges taken from the deque of another core
+    uint32_t deque_full;        // Splits refused because the deque was full, the range is run unsplit
+    uint32_t workers;
+    uint32_t worker_ranges[JOB_POOL_MAX_WORKERS];
+    uint64_t worker_busy_us[JOB_POOL_MAX_WORKERS];  // Time spent in kernels
+} job_pool_stats_t;
+
+/**
+ * @brief Start the workers
+ *
+ * @param workers Number of workers, 0 for one per core. Worker `i` is pinned to core `i % portNUM_PROCESSORS`.
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: Already started
+ *      - ESP_ERR_INVALID_ARG: More than JOB_POOL_MAX_WORKERS workers
+ *      - ESP_ERR_NO_MEM: Can't create the tasks
+ */
+esp_err_t job_pool_init(size_t workers);
+
+/**
+ * @brief Stop the workers. No loop may be running.
+ */
+void job_pool_deinit(void);
+
+/**
+ * @brief Run `fn` over `begin` to `end - 1` on all cores and wait until it is done
+ *
+ * @param grain Smallest range worth handing to another core, at least 1
+ */
+void job_pool_parallel_for(uint32_t begin, uint32_t end, uint32_t grain, job_pool_fn_t fn, void *arg);
+
+/**
+ * @brief Get the statistics
+ *
+ * @param reset Clear them after reading
+ */
+void job_pool_get_stats(job_pool_stats_t *stats, bool reset);
+
+/**
+ * @brief Print the statistics with ESP_LOGI
+ */
+void job_pool_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JOB_POOL_H
@@ -0,0 +1,292 @@
+#include "lvgl_mem.h"
+
+#if CONFIG_EXAMPLE_LVGL_MEM_POOLS
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "multi_heap.h"
+
+#define LVGL_MEM_SRAM_POOL_SIZE     (CONFIG_EXAMPLE_LVGL_MEM_SRAM_POOL_KB * 1024)
+#define LVGL_MEM_PSRAM_POOL_SIZE    (CONFIG_EXAMPLE_LVGL_MEM_PSRAM_POOL_KB * 1024)
+#define LVGL_MEM_SMALL_MAX          (CONFIG_EXAMPLE_LVGL_MEM_SMALL_MAX)     // Largest allocation placed in SRAM
+#define LVGL_MEM_LARGE_MIN          (CONFIG_EXAMPLE_LVGL_MEM_LARGE_MIN)     // Smallest allocation kept out of the pools
+
+static const char *TAG = "lv_mem";
+
+/**
+ * One TLSF pool (the multi_heap allocator of ESP-IDF) on a region reserved at startup, or the PSRAM heap itself.
+ * Counters are updated from the LVGL task or with the LVGL mutex held, the pool lock only protects multi_heap.
+ */
+typedef struct {
+    multi_heap_handle_t heap;           // NULL for LVGL_MEM_POOL_HEAP
+    uint8_t *start;
+    size_t size;
+    portMUX_TYPE lock;
+    size_t heap_used;                   // LVGL_MEM_POOL_HEAP only, the others ask multi_heap
+    size_t heap_high_water;
+    uint32_t heap_blocks;
+    uint32_t allocs;
+    uint32_t failures;
+} lvgl_mem_pool_ctx_t;
+
+static lvgl_mem_pool_ctx_t s_pools[LVGL_MEM_POOL_MAX] = {
+    [LVGL_MEM_POOL_SRAM] = { .lock = portMUX_INITIALIZER_UNLOCKED },
+    [LVGL_MEM_POOL_PSRAM] = { .lock = portMUX_INITIALIZER_UNLOCKED },
+};
+
+static const char *const s_pool_names[LVGL_MEM_POOL_MAX] = {
+    [LVGL_MEM_POOL_SRAM]  = "sram",
+    [LVGL_MEM_POOL_PSRAM] = "psram",
+    [LVGL_MEM_POOL_HEAP]  = "heap",
+};
+
+static bool pool_create(lvgl_mem_pool_t pool, size_t size, uint32_t caps)
+{
+    lvgl_mem_pool_ctx_t *ctx = &s_pools[pool];
+    ctx->start = heap_caps_malloc(size, caps);
+    if (!ctx->start) {
+        ESP_LOGE(TAG, "Failed to reserve %u bytes for the %s pool", (unsigned)size, s_pool_names[pool]);
+        return false;
+    }
+    ctx->heap = multi_heap_register(ctx->start, size);
+    if (!ctx->heap) {
+        heap_caps_free(ctx->start);
+        ctx->start = NULL;
+        return false;
+    }
+    multi_heap_set_lock(ctx->heap, &ctx->lock);
+    ctx->size = size;
+    return true;
+}
+
+bool lvgl_mem_init(void)
+{
+    bool ok = pool_create(LVGL_MEM_POOL_SRAM, LVGL_MEM_SRAM_POOL_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ok &= pool_create(LVGL_MEM_POOL_PSRAM, LVGL_MEM_PSRAM_POOL_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    ESP_LOGI(TAG, "LVGL pools: %u KB SRAM, %u KB PSRAM", (unsigned)(s_pools[LVGL_MEM_POOL_SRAM].size / 1024),
+             (unsigned)(s_pools[LVGL_MEM_POOL_PSRAM].size / 1024));
+    return ok;
+}
+
+static lvgl_mem_pool_t pool_of(const void *ptr)
+{
+    for (int i = 0; i < LVGL_MEM_POOL_HEAP; i++) {
+        const lvgl_mem_pool_ctx_t *ctx = &s_pools[i];
+        if (ctx->heap && (const uint8_t *)ptr >= ctx->start && (const uint8_t *)ptr < ctx->start + ctx->size) {
+            return i;
+        }
+    }
+    return LVGL_MEM_POOL_HEAP;
+}
+
+// Pool an allocation of `size` bytes belongs to when there is room
+static lvgl_mem_pool_t pool_for(size_t size)
+{
+    if (size <= LVGL_MEM_SMALL_MAX) {
+        return LVGL_MEM_POOL_SRAM;
+    }
+    return (size < LVGL_MEM_LARGE_MIN) ? LVGL_MEM_POOL_PSRAM : LVGL_MEM_POOL_HEAP;
+}
+
+static void *pool_alloc(lvgl_mem_pool_t pool, size_t size)
+{
+    lvgl_mem_pool_ctx_t *ctx = &s_pools[pool];
+    if (!ctx->heap) {
+        return NULL;
+    }
+    void *ptr = multi_heap_malloc(ctx->heap, size);
+    if (ptr) {
+        ctx->allocs++;
+    } else {
+        ctx->failures++;
+    }
+    return ptr;
+}
+
+static void heap_account(lvgl_mem_pool_ctx_t *ctx, size_t freed, size_t allocated)
+{
+    ctx->heap_used = ctx->heap_used - freed + allocated;
+    if (ctx->heap_used > ctx->heap_high_water) {
+        ctx->heap_high_water = ctx->heap_used;
+    }
+}
+
+static void *heap_alloc(size_t size)
+{
+    lvgl_mem_pool_ctx_t *ctx = &s_pools[LVGL_MEM_POOL_HEAP];
+    void *ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ptr) {
+        ptr = heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+    }
+    if (!ptr) {
+        ctx->failures++;
+        return NULL;
+    }
+    ctx->allocs++;
+    ctx->heap_blocks++;
+    heap_account(ctx, 0, heap_caps_get_allocated_size(ptr));
+    return ptr;
+}
+
+void *lvgl_mem_alloc(size_t size)
+{
+    const lvgl_mem_pool_t pool = pool_for(size);
+    void *ptr = NULL;
+
+    if (pool == LVGL_MEM_POOL_SRAM) {
+        ptr = pool_alloc(LVGL_MEM_POOL_SRAM, size);
+    }
+    if (!ptr && pool != LVGL_MEM_POOL_HEAP) {
+        ptr = pool_alloc(LVGL_MEM_POOL_PSRAM, size); // Spill over when SRAM is full
+    }
+    if (!ptr) {
+        ptr = heap_alloc(size);
+    }
+    return ptr;
+}
+
+void lvgl_mem_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    const lvgl_mem_pool_t pool = pool_of(ptr);
+    lvgl_mem_pool_ctx_t *ctx = &s_pools[pool];
+    if (pool == LVGL_MEM_POOL_HEAP) {
+        ctx->heap_blocks--;
+        heap_account(ctx, heap_caps_get_allocated_size(ptr), 0);
+        heap_caps_free(ptr);
+    } else {
+        multi_heap_free(ctx->heap, ptr);
+    }
+}
+
+void *lvgl_mem_realloc(void *ptr, size_t size)
+{
+    if (!ptr) {
+        return lvgl_mem_alloc(size);
+    }
+    if (size == 0) {
+        lvgl_mem_free(ptr);
+        return NULL;
+    }
+
+    const lvgl_mem_pool_t pool = pool_of(ptr);
+    lvgl_mem_pool_ctx_t *ctx = &s_pools[pool];
+    size_t old_size = 0;
+    if (pool == LVGL_MEM_POOL_HEAP) {
+        old_size = heap_caps_get_allocated_size(ptr);
+    } else {
+        old_size = multi_heap_get_allocated_size(ctx->heap, ptr);
+    }
+
+    // Resize in place while the block stays in the pool its new size belongs to
+    if (pool == pool_for(size)) {
+        void *new_ptr = NULL;
+        if (pool == LVGL_MEM_POOL_HEAP) {
+            new_ptr = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            if (new_ptr) {
+                heap_account(ctx, old_size, heap_caps_get_allocated_size(new_ptr));
+            }
+        } else {
+            new_ptr = multi_heap_realloc(ctx->heap, ptr, size);
+        }
+        if (new_ptr) {
+            return new_ptr;
+        }
+    }
+
+    void *new_ptr = lvgl_mem_alloc(size);
+    if (new_ptr) {
+        memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+        lvgl_mem_free(ptr);
+    }
+    return new_ptr;
+}
+
+void lvgl_mem_get_stats(lvgl_mem_pool_t pool, lvgl_mem_stats_t *stats)
+{
+    assert(pool < LVGL_MEM_POOL_MAX && stats);
+
+    const lvgl_mem_pool_ctx_t *ctx = &s_pools[pool];
+    memset(stats, 0, sizeof(*stats));
+    stats->allocs = ctx->allocs;
+    stats->failures = ctx->failures;
+    if (pool == LVGL_MEM_POOL_HEAP) {
+        stats->used = ctx->heap_used;
+        stats->high_water = ctx->heap_high_water;
+        stats->blocks = ctx->heap_blocks;
+        return;
+    }
+    if (!ctx->heap) {
+        return;
+    }
+
+    multi_heap_info_t info;
+    multi_heap_get_info(ctx->heap, &info);
+    stats->size = ctx->size;
+    stats->used = info.total_allocated_bytes;
+    stats->high_water = ctx->size - info.minimum_free_bytes;   // Includes the TLSF block headers
+    stats->largest_free = info.largest_free_block;
+    stats->frag_pct = info.total_free_bytes ? 100 - (uint32_t)(info.largest_free_block * 100 / info.total_free_bytes) : 0;
+    stats->blocks = info.allocated_blocks;
+}
+
+void lvgl_mem_snapshot(lvgl_mem_snapshot_t *snapshot)
+{
+    assert(snapshot);
+
+    lvgl_mem_stats_t stats;
+    for (int i = 0; i < LVGL_MEM_POOL_MAX; i++) {
+        lvgl_mem_get_stats(i, &stats);
+        snapshot->blocks[i] = stats.blocks;
+        snapshot->bytes[i] = stats.used;
+    }
+}
+
+int lvgl_mem_report_leaks(const lvgl_mem_snapshot_t *snapshot, const char *name)
+{
+    assert(snapshot && name);
+
+    lvgl_mem_snapshot_t now;
+    lvgl_mem_snapshot(&now);
+
+    int leaked = 0;
+    for (int i = 0; i < LVGL_MEM_POOL_MAX; i++) {
+        leaked += (int)now.blocks[i] - (int)snapshot->blocks[i];
+    }
+    if (leaked <= 0) {
+        ESP_LOGI(TAG, "%s: no leak", name);
+        return 0;
+    }
+
+    ESP_LOGW(TAG, "%s: %d blocks still held", name, leaked);
+    for (int i = 0; i < LVGL_MEM_POOL_MAX; i++) {
+        if (now.blocks[i] != snapshot->blocks[i]) {
+            ESP_LOGW(TAG, "  %-5s %+d blocks, %+d bytes", s_pool_names[i], (int)now.blocks[i] - (int)snapshot->blocks[i],
+                     (int)now.bytes[i] - (int)snapshot->bytes[i]);
+        }
+    }
+    return leaked;
+}
+
+void lvgl_mem_dump(void)
+{
+    lvgl_mem_stats_t stats;
+
+    printf("%-6s %9s %9s %9s %9s %5s %7s %9s %8s\n", "pool", "size", "used", "peak", "max_free", "frag",
+           "blocks", "allocs", "failures");
+    for (int i = 0; i < LVGL_MEM_POOL_MAX; i++) {
+        lvgl_mem_get_stats(i, &stats);
+        printf("%-6s %9u %9u %9u %9u %4lu%% %7lu %9lu %8lu\n", s_pool_names[i], (unsigned)stats.size,
+               (unsigned)stats.used, (unsigned)stats.high_water, (unsigned)stats.largest_free,
+               (unsigned long)stats.frag_pct, (unsigned long)stats.blocks, (unsigned long)stats.allocs,
+               (unsigned long)stats.failures);
+    }
+}
+
+#endif /* CONFIG_EXAMPLE_LVGL_MEM_POOLS */
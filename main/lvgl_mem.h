@@ -0,0 +1,95 @@
+#ifndef LVGL_MEM_H
+#define LVGL_MEM_H
+
+/**
+ * Memory pools for LVGL. This header is also included by LVGL itself through CONFIG_LV_MEM_CUSTOM_INCLUDE, so it must
+ * not include lvgl.h. When CONFIG_EXAMPLE_LVGL_MEM_POOLS is enabled, main/CMakeLists.txt points LV_MEM_CUSTOM_ALLOC,
+ * LV_MEM_CUSTOM_FREE and LV_MEM_CUSTOM_REALLOC to the functions below, otherwise LVGL keeps using the C library.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Pools used for LVGL allocations
+ */
+typedef enum {
+    LVGL_MEM_POOL_SRAM,         // Small, hot objects: widgets, styles, timers, ...
+    LVGL_MEM_POOL_PSRAM,        // Larger buffers, and small objects once the SRAM pool is full
+    LVGL_MEM_POOL_HEAP,         // Buffers above CONFIG_EXAMPLE_LVGL_MEM_LARGE_MIN and pool overflows, from the PSRAM heap
+    LVGL_MEM_POOL_MAX,
+} lvgl_mem_pool_t;
+
+/**
+ * @brief Statistics of one pool
+ */
+typedef struct {
+    size_t size;                // Size of the pool, 0 for LVGL_MEM_POOL_HEAP
+    size_t used;                // Bytes currently allocated
+    size_t high_water;          // Largest number of bytes allocated at once
+    size_t largest_free;        // Largest free block, 0 for LVGL_MEM_POOL_HEAP
+    uint32_t frag_pct;          // Free memory not usable by the largest allocation, in [%]
+    uint32_t blocks;            // Blocks currently allocated
+    uint32_t allocs;            // Allocations served since boot
+    uint32_t failures;          // Allocations this pool could not serve
+} lvgl_mem_stats_t;
+
+/**
+ * @brief Allocated blocks and bytes of all pools at one point in time, see `lvgl_mem_report_leaks()`
+ */
+typedef struct {
+    uint32_t blocks[LVGL_MEM_POOL_MAX];
+    size_t bytes[LVGL_MEM_POOL_MAX];
+} lvgl_mem_snapshot_t;
+
+#if CONFIG_EXAMPLE_LVGL_MEM_POOLS
+/**
+ * @brief Create the pools, must be called before `lv_init()`
+ *
+ * @return
+ *      - true: Success
+ *      - false: The pools could not be reserved, LVGL allocations go to the heap
+ */
+bool lvgl_mem_init(void);
+
+void *lvgl_mem_alloc(size_t size);
+void lvgl_mem_free(void *ptr);
+void *lvgl_mem_realloc(void *ptr, size_t size);
+
+/**
+ * @brief Get the statistics of one pool
+ */
+void lvgl_mem_get_stats(lvgl_mem_pool_t pool, lvgl_mem_stats_t *stats);
+
+/**
+ * @brief Record the allocations currently held by LVGL
+ */
+void lvgl_mem_snapshot(lvgl_mem_snapshot_t *snapshot);
+
+/**
+ * @brief Log the blocks that were allocated since `snapshot` and are still held
+ *
+ * @param[in] snapshot: Baseline, e.g. taken before the UI part that was torn down was created
+ * @param[in] name: Name of the UI part, for the log
+ *
+ * @return Number of blocks still held
+ */
+int lvgl_mem_report_leaks(const lvgl_mem_snapshot_t *snapshot, const char *name);
+
+/**
+ * @brief Print the statistics of all pools to the console
+ */
+void lvgl_mem_dump(void);
+#endif /* CONFIG_EXAMPLE_LVGL_MEM_POOLS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LVGL_MEM_H
@@ -4,7 +4,6 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include "extra/libs/fsdrv/lv_fsdrv.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
@@ -13,13 +12,43 @@
 #include "esp_lcd_touch.h"
 #include "esp_timer.h"
 #include "esp_log.h"
+#include <string.h>
 #include "lvgl.h"
 #include "lvgl_port.h"
+#include "lvgl_mem.h"
+#include "perf_monitor.h"
 
 static const char *TAG = "lv_port";                      // Tag for logging
 static SemaphoreHandle_t lvgl_mux;                       // LVGL mutex for synchronization
 static TaskHandle_t lvgl_task_handle = NULL;             // Handle for the LVGL task
 
+/**
+ * Bits of the LVGL task notification value. The task blocks on its notification both while waiting for the
+ * next LVGL timer to be due and while waiting for VSYNC inside the flush callback, so the sources are kept apart.
+ */
+#define LVGL_PORT_NOTIFY_VSYNC      (1UL << 0)           // The RGB frame buffer has been transmitted
+#define LVGL_PORT_NOTIFY_WAKE       (1UL << 1)           // New work for LVGL (UI change, input, command, ...)
+
+#if LVGL_PORT_AVOID_TEAR_ENABLE
+static volatile bool flush_vsync_pending = false;        // Set while the flush callback waits for VSYNC
+
+// Block the LVGL task until the RGB driver reports that the current frame buffer has been transmitted
+static void flush_wait_vsync(void)
+{
+    uint32_t notify_bits = 0;                            // Notification value seen by the last wait
+
+    PERF_STAGE_BEGIN(vsync);
+    flush_vsync_pending = true;
+    ulTaskNotifyValueClear(NULL, LVGL_PORT_NOTIFY_VSYNC); // Drop a VSYNC left over from the previous frame
+    while (!(notify_bits & LVGL_PORT_NOTIFY_VSYNC)) {
+        // Only consume the VSYNC bit, wake requests stay pending for `lvgl_port_task()`
+        xTaskNotifyWait(0, LVGL_PORT_NOTIFY_VSYNC, &notify_bits, portMAX_DELAY);
+    }
+    flush_vsync_pending = false;
+    PERF_STAGE_END(vsync, PERF_STAGE_VSYNC_WAIT);
+}
+#endif /* LVGL_PORT_AVOID_TEAR_ENABLE */
+
 #if EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0
 // Function to get the next frame buffer for double buffering
 static void *get_next_frame_buffer(esp_lcd_panel_handle_t panel_handle)
@@ -43,6 +72,7 @@ IRAM_ATTR static void rotate_copy_pixel(const uint16_t *from, uint16_t *to, uint
     int to_index = 0;                                     // Index for destination buffer
     int to_index_const = 0;                               // Constant index for destination buffer
 
+    PERF_STAGE_BEGIN(copy);
     switch (rotation) {
         case 90:
             to_index_const = (w - x_start - 1) * h;          // Calculate constant index for 90-degree rotation
@@ -83,6 +113,7 @@ IRAM_ATTR static void rotate_copy_pixel(const uint16_t *from, uint16_t *to, uint
         default:
             break;                                             // Do nothing for unsupported rotation angles
     }
+    PERF_STAGE_END(copy, PERF_STAGE_COPY);
 }
 #endif /* EXAMPLE_LVGL_PORT_ROTATION_DEGREE */
 
@@ -219,8 +250,7 @@ static void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t
             esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, next_fb);
 
             /* Wait for the current frame buffer to complete transmission */
-            ulTaskNotifyValueClear(NULL, ULONG_MAX);
-            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            flush_wait_vsync();
 
             /* Synchronously update the dirty area for another frame buffer */
             flush_dirty_copy(flush_get_next_buf(panel_handle), color_map, &dirty_area);
@@ -250,8 +280,7 @@ static void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t
                 esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, next_fb);
 
                 /* Wait for the current frame buffer to complete transmission */
-                ulTaskNotifyValueClear(NULL, ULONG_MAX);
-                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                flush_wait_vsync();
 
                 if (probe_result == FLUSH_PROBE_PART_COPY) {
                     /* Synchronously update the dirty area for another frame buffer */
@@ -282,8 +311,7 @@ static void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t
         esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, color_map);
 
         /* Wait for the last frame buffer to complete transmission */
-        ulTaskNotifyValueClear(NULL, ULONG_MAX);
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        flush_wait_vsync();
     }
 
     lv_disp_flush_ready(drv); // Mark the display flush as complete
@@ -304,8 +332,7 @@ static void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t
     esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, color_map);
 
     /* Wait for the last frame buffer to complete transmission */
-    ulTaskNotifyValueClear(NULL, ULONG_MAX);
-    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    flush_wait_vsync();
 
     lv_disp_flush_ready(drv); // Mark the display flush as complete
 }
@@ -367,6 +394,232 @@ void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color
 
 #endif /* LVGL_PORT_AVOID_TEAR_ENABLE */
 
+#if CONFIG_PERF_MONITOR_ENABLE
+// Record the duration of every flush, whatever the flush implementation selected above
+static void flush_callback_timed(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_map)
+{
+    PERF_STAGE_BEGIN(flush);
+    flush_callback(drv, area, color_map);
+    PERF_STAGE_END(flush, PERF_STAGE_FLUSH);
+}
+#endif
+
+#if LVGL_PORT_PARALLEL_DRAW
+/**
+ * Parallel drawing: large blends and image copies are split into two horizontal bands, the upper one is drawn by a
+ * worker task on the other core while the LVGL task draws the lower one, and both are joined before LVGL goes on.
+ * The bands only differ by their clip area, so they write disjoint rows of the draw buffer.
+ */
+typedef void (*draw_band_cb_t)(void *arg, lv_coord_t y1, lv_coord_t y2);
+
+static TaskHandle_t draw_worker_handle = NULL;          // Worker on the core not running LVGL
+static SemaphoreHandle_t draw_worker_done = NULL;        // Given by the worker when its band is drawn
+static struct {
+    draw_band_cb_t cb;
+    void *arg;
+    lv_coord_t y1;
+    lv_coord_t y2;
+} draw_worker_job;                                        // Band of the worker, written before it is notified
+static void (*draw_sw_blend)(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc); // LVGL software blend
+
+static void draw_worker_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        draw_worker_job.cb(draw_worker_job.arg, draw_worker_job.y1, draw_worker_job.y2);
+        xSemaphoreGive(draw_worker_done);
+    }
+}
+
+static esp_err_t draw_worker_init(void)
+{
+    draw_worker_done = xSemaphoreCreateBinary();
+    if (!draw_worker_done) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Same priority as the LVGL task, which is blocked while the worker draws
+    BaseType_t core_id = (LVGL_PORT_TASK_CORE < 0) ? tskNO_AFFINITY : !LVGL_PORT_TASK_CORE;
+    if (xTaskCreatePinnedToCore(draw_worker_task, "lvgl_draw", LVGL_PORT_PARALLEL_DRAW_STACK_SIZE, NULL,
+                                LVGL_PORT_TASK_PRIORITY, &draw_worker_handle, core_id) != pdPASS) {
+        vSemaphoreDelete(draw_worker_done);
+        draw_worker_done = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Draw rows `y1..y2` with `cb`, on both cores if the area is large enough to be worth the hand-over
+static void draw_bands(draw_band_cb_t cb, void *arg, lv_coord_t y1, lv_coord_t y2, uint32_t px_count)
+{
+    if (!draw_worker_handle || px_count < LVGL_PORT_PARALLEL_DRAW_MIN_PX || y2 <= y1) {
+        cb(arg, y1, y2);
+        return;
+    }
+
+    const lv_coord_t mid = y1 + (y2 - y1 + 1) / 2;
+    draw_worker_job.cb = cb;
+    draw_worker_job.arg = arg;
+    draw_worker_job.y1 = y1;
+    draw_worker_job.y2 = mid - 1;
+    xTaskNotifyGive(draw_worker_handle);
+    cb(arg, mid, y2);
+    xSemaphoreTake(draw_worker_done, portMAX_DELAY);
+    perf_monitor_count(PERF_COUNTER_DRAW_SPLIT, 1);
+}
+
+typedef struct {
+    lv_draw_ctx_t *draw_ctx;
+    const lv_draw_sw_blend_dsc_t *dsc;
+} draw_blend_job_t;
+
+static void draw_blend_band(void *arg, lv_coord_t y1, lv_coord_t y2)
+{
+    const draw_blend_job_t *job = (const draw_blend_job_t *)arg;
+
+    // The software blend only draws inside the clip area, so a private context with a narrower clip is a band
+    lv_draw_sw_ctx_t band_ctx = *(lv_draw_sw_ctx_t *)job->draw_ctx;
+    lv_area_t clip = *job->draw_ctx->clip_area;
+    clip.y1 = y1;
+    clip.y2 = y2;
+    band_ctx.base_draw.clip_area = &clip;
+    draw_sw_blend(&band_ctx.base_draw, job->dsc);
+}
+
+// Fills, software image blends, ... all end up here with the whole area to blend
+static void draw_blend(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc)
+{
+    lv_area_t area;
+    if (!_lv_area_intersect(&area, dsc->blend_area, draw_ctx->clip_area)) {
+        return;
+    }
+
+    draw_blend_job_t job = {
+        .draw_ctx = draw_ctx,
+        .dsc = dsc,
+    };
+    draw_bands(draw_blend_band, &job, area.y1, area.y2, lv_area_get_size(&area));
+}
+#endif /* LVGL_PORT_PARALLEL_DRAW */
+
+#if LVGL_PORT_FAST_IMG_BLIT
+/**
+ * @brief Whether a decoded image can be copied into the draw buffer as is
+ *
+ * @note Only an opaque RGB565 image without transformation, recoloring, blending mode or mask qualifies, which is
+ *       the case of a photo. Everything else goes through the generic software renderer.
+ *
+ * @note The draw buffer must be plain RGB565 too: while LVGL renders into a layer with alpha (`screen_transp`, e.g.
+ *       a parent with an opacity below cover), its pixels carry an alpha byte and the rows can't be copied.
+ *
+ */
+static bool draw_img_is_plain_copy(const lv_draw_img_dsc_t *draw_dsc, const lv_area_t *area, lv_img_cf_t cf)
+{
+    if (cf != LV_IMG_CF_TRUE_COLOR || draw_dsc->angle != 0 || draw_dsc->zoom != LV_IMG_ZOOM_NONE ||
+            draw_dsc->opa < LV_OPA_MAX || draw_dsc->recolor_opa > LV_OPA_MIN ||
+            draw_dsc->blend_mode != LV_BLEND_MODE_NORMAL) {
+        return false;
+    }
+    lv_disp_t *disp = _lv_refr_get_disp_refreshing();
+    if (!disp || disp->driver->screen_transp) {
+        return false;
+    }
+    #if LV_DRAW_COMPLEX
+    if (lv_draw_mask_is_any(area)) {
+        return false;
+    }
+    #endif
+    return true;
+}
+
+typedef struct {
+    lv_draw_ctx_t *draw_ctx;
+    const lv_area_t *coords;                              // Area of the whole image
+    const lv_area_t *area;                                // Visible part of the image
+    const lv_color_t *src;
+} draw_img_job_t;
+
+// Copy rows `y1..y2` of the visible part, the stride of the source and the destination differ unless both are full width
+static void draw_img_copy_rows(void *arg, lv_coord_t y1, lv_coord_t y2)
+{
+    const draw_img_job_t *job = (const draw_img_job_t *)arg;
+    const lv_area_t *buf_area = job->draw_ctx->buf_area;
+    const lv_coord_t src_stride = lv_area_get_width(job->coords);
+    const lv_coord_t dst_stride = lv_area_get_width(buf_area);
+    const lv_coord_t w = lv_area_get_width(job->area);
+    lv_coord_t h = y2 - y1 + 1;
+
+    const lv_color_t *src = job->src + (int32_t)(y1 - job->coords->y1) * src_stride + (job->area->x1 - job->coords->x1);
+    lv_color_t *dst = (lv_color_t *)job->draw_ctx->buf;
+    dst += (int32_t)(y1 - buf_area->y1) * dst_stride + (job->area->x1 - buf_area->x1);
+
+    if (w == src_stride && w == dst_stride) {
+        // Contiguous on both sides, e.g. a full-screen photo: one large copy
+        memcpy(dst, src, (size_t)w * h * sizeof(lv_color_t));
+        return;
+    }
+    // newlib's memcpy moves aligned 32-bit words once source and destination share the same alignment
+    while (h-- > 0) {
+        memcpy(dst, src, (size_t)w * sizeof(lv_color_t));
+        src += src_stride;
+        dst += dst_stride;
+    }
+}
+
+static void draw_img_decoded(lv_draw_ctx_t *draw_ctx, const lv_draw_img_dsc_t *draw_dsc, const lv_area_t *coords,
+                             const uint8_t *src_buf, lv_img_cf_t cf)
+{
+    lv_area_t area;
+    if (!_lv_area_intersect(&area, coords, draw_ctx->clip_area)) {
+        return;
+    }
+
+    PERF_STAGE_BEGIN(img_draw);
+    if (draw_img_is_plain_copy(draw_dsc, &area, cf)) {
+        draw_img_job_t job = {
+            .draw_ctx = draw_ctx,
+            .coords = coords,
+            .area = &area,
+            .src = (const lv_color_t *)src_buf,
+        };
+        #if LVGL_PORT_PARALLEL_DRAW
+        draw_bands(draw_img_copy_rows, &job, area.y1, area.y2, lv_area_get_size(&area));
+        #else
+        draw_img_copy_rows(&job, area.y1, area.y2);
+        #endif
+    } else {
+        lv_draw_sw_img_decoded(draw_ctx, draw_dsc, coords, src_buf, cf);
+    }
+    PERF_STAGE_END(img_draw, PERF_STAGE_IMG_DRAW);
+}
+#elif CONFIG_PERF_MONITOR_ENABLE
+// Same timing point as the fast path, to compare both on the same image
+static void draw_img_decoded(lv_draw_ctx_t *draw_ctx, const lv_draw_img_dsc_t *draw_dsc, const lv_area_t *coords,
+                             const uint8_t *src_buf, lv_img_cf_t cf)
+{
+    PERF_STAGE_BEGIN(img_draw);
+    lv_draw_sw_img_decoded(draw_ctx, draw_dsc, coords, src_buf, cf);
+    PERF_STAGE_END(img_draw, PERF_STAGE_IMG_DRAW);
+}
+#endif /* LVGL_PORT_FAST_IMG_BLIT */
+
+#define LVGL_PORT_CUSTOM_DRAW_CTX   (LVGL_PORT_FAST_IMG_BLIT || LVGL_PORT_PARALLEL_DRAW || CONFIG_PERF_MONITOR_ENABLE)
+
+#if LVGL_PORT_CUSTOM_DRAW_CTX
+// Software draw context with the port's fast paths, installed through `lv_disp_drv_t::draw_ctx_init`
+static void draw_ctx_init(lv_disp_drv_t *drv, lv_draw_ctx_t *draw_ctx)
+{
+    lv_draw_sw_init_ctx(drv, draw_ctx);
+    #if LVGL_PORT_FAST_IMG_BLIT || CONFIG_PERF_MONITOR_ENABLE
+    draw_ctx->draw_img_decoded = draw_img_decoded;
+    #endif
+    #if LVGL_PORT_PARALLEL_DRAW
+    lv_draw_sw_ctx_t *sw_ctx = (lv_draw_sw_ctx_t *)draw_ctx;
+    draw_sw_blend = sw_ctx->blend;
+    sw_ctx->blend = draw_blend;
+    #endif
+}
+#endif
+
 static lv_disp_t *display_init(esp_lcd_panel_handle_t panel_handle)
 {
     assert(panel_handle); // Ensure the panel handle is valid
@@ -416,8 +669,16 @@ static lv_disp_t *display_init(esp_lcd_panel_handle_t panel_handle)
     disp_drv.hor_res = LVGL_PORT_H_RES; // Set horizontal resolution
     disp_drv.ver_res = LVGL_PORT_V_RES; // Set vertical resolution
     #endif
+    #if CONFIG_PERF_MONITOR_ENABLE
+    disp_drv.flush_cb = flush_callback_timed; // Set the flush callback, with timing
+    #else
     disp_drv.flush_cb = flush_callback; // Set the flush callback
+    #endif
     disp_drv.draw_buf = &disp_buf; // Set the draw buffer
+    #if LVGL_PORT_CUSTOM_DRAW_CTX
+    disp_drv.draw_ctx_init = draw_ctx_init; // Software renderer with the port's fast paths and/or timing
+    disp_drv.draw_ctx_size = sizeof(lv_draw_sw_ctx_t);
+    #endif
     disp_drv.user_data = panel_handle; // Set user data to panel handle
     #if LVGL_PORT_FULL_REFRESH
     disp_drv.full_refresh = 1; // Enable full refresh
@@ -466,10 +727,39 @@ static lv_indev_t *indev_init(esp_lcd_touch_handle_t tp)
     return lv_indev_drv_register(&indev_drv_tp); // Register the input device driver
 }
 
+static esp_timer_handle_t lvgl_tick_timer = NULL;       // Periodic LVGL tick timer
+static bool lvgl_tick_running = false;                   // Whether the periodic tick timer is started
+static int64_t lvgl_tick_last_us = 0;                    // Time already reported to LVGL, in [us]
+static portMUX_TYPE lvgl_tick_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static lvgl_port_activity_t lvgl_activity = { 0 };       // Counters for `lvgl_port_get_activity()`, `lvgl_tick_spinlock` held
+static int64_t lvgl_activity_start_us = 0;               // Start of the current activity measurement
+
+/**
+ * @brief Tell LVGL how many milliseconds have elapsed since the last call
+ *
+ * @note LVGL time is derived from `esp_timer_get_time()`, so it stays correct while the periodic tick is stopped.
+ *       The remainder below 1 ms is carried over to the next call.
+ *
+ */
+static void tick_sync(void)
+{
+    portENTER_CRITICAL(&lvgl_tick_spinlock); // Called from both the esp_timer task and the LVGL task
+    const int64_t now_us = esp_timer_get_time();
+    const uint32_t elapsed_ms = (uint32_t)((now_us - lvgl_tick_last_us) / 1000);
+    if (elapsed_ms > 0) {
+        lvgl_tick_last_us += (int64_t)elapsed_ms * 1000;
+        lv_tick_inc(elapsed_ms); // Increment the LVGL tick count
+    }
+    portEXIT_CRITICAL(&lvgl_tick_spinlock);
+}
+
 static void tick_increment(void *arg)
 {
-    /* Tell LVGL how many milliseconds have elapsed */
-    lv_tick_inc(LVGL_PORT_TICK_PERIOD_MS); // Increment the LVGL tick count
+    portENTER_CRITICAL(&lvgl_tick_spinlock); // `lvgl_port_get_activity()` may reset the counters from another task
+    lvgl_activity.tick_count++;
+    portEXIT_CRITICAL(&lvgl_tick_spinlock);
+    tick_sync();
 }
 
 static esp_err_t tick_init(void)
@@ -479,38 +769,230 @@ static esp_err_t tick_init(void)
         .callback = &tick_increment, // Set the callback function for the timer
         .name = "LVGL tick" // Name of the timer
     };
-    esp_timer_handle_t lvgl_tick_timer = NULL; // Timer handle
     ESP_ERROR_CHECK(esp_timer_create(&lvgl_tick_timer_args, &lvgl_tick_timer)); // Create the timer
+    lvgl_tick_last_us = esp_timer_get_time();
+    lvgl_activity_start_us = lvgl_tick_last_us;
+    lvgl_tick_running = true;
     return esp_timer_start_periodic(lvgl_tick_timer, LVGL_PORT_TICK_PERIOD_MS * 1000); // Start the timer
 }
 
+// Start or stop the periodic tick, LVGL time is kept up to date by `tick_sync()` in both cases
+static void tick_set_running(bool running)
+{
+    if (running == lvgl_tick_running) {
+        return;
+    }
+    if (running) {
+        tick_sync();
+        ESP_ERROR_CHECK(esp_timer_start_periodic(lvgl_tick_timer, LVGL_PORT_TICK_PERIOD_MS * 1000));
+    } else {
+        esp_timer_stop(lvgl_tick_timer); // May fail harmlessly if the callback is just running
+    }
+    lvgl_tick_running = running;
+    ESP_LOGD(TAG, "LVGL tick %s", running ? "resumed" : "stopped");
+}
+
+#if LVGL_PORT_TICK_IDLE_STOP
+// The scene is static when no animation runs and the next LVGL timer is far away
+static bool lvgl_port_is_idle(uint32_t task_delay_ms)
+{
+    return (task_delay_ms >= LVGL_PORT_TICK_IDLE_THRESHOLD_MS) && (lv_anim_count_running() == 0);
+}
+#endif
+
+/**
+ * Command queue into the LVGL task: a bounded MPSC ring where every cell carries a sequence number. A producer claims
+ * position `pos` with a CAS on `cmd_enqueue_pos` when the cell sequence equals `pos`, copies the command and publishes
+ * it by setting the sequence to `pos + 1`. The LVGL task consumes published cells in order and frees them by setting
+ * the sequence to `pos + LEN`. No producer ever takes a lock, so posting works from any task or ISR during rendering.
+ */
+_Static_assert((LVGL_PORT_CMD_QUEUE_LEN & (LVGL_PORT_CMD_QUEUE_LEN - 1)) == 0, "LVGL_PORT_CMD_QUEUE_LEN must be a power of two");
+#define LVGL_PORT_CMD_QUEUE_MASK    (LVGL_PORT_CMD_QUEUE_LEN - 1)
+
+typedef struct {
+    uint32_t seq;                                        // Position this cell is free for, or published at (+1)
+    lvgl_port_cmd_t cmd;
+} lvgl_port_cmd_cell_t;
+
+static lvgl_port_cmd_cell_t cmd_cells[LVGL_PORT_CMD_QUEUE_LEN];
+static uint32_t cmd_enqueue_pos = 0;                     // Next position claimed by a producer
+static uint32_t cmd_dequeue_pos = 0;                     // Next position consumed by the LVGL task
+static bool cmd_queue_ready = false;                     // Set once the cells are initialized
+static lvgl_port_cmd_stats_t cmd_stats = { 0 };          // Counters for `lvgl_port_get_cmd_stats()`
+static uint64_t cmd_latency_sum_us = 0;                  // Sum of the latencies of `cmd_stats.executed` commands
+
+static void cmd_queue_init(void)
+{
+    for (uint32_t i = 0; i < LVGL_PORT_CMD_QUEUE_LEN; i++) {
+        cmd_cells[i].seq = i;
+    }
+    __atomic_store_n(&cmd_queue_ready, true, __ATOMIC_RELEASE);
+}
+
+// In IRAM: also called from ISRs, which may run while the flash cache is disabled
+IRAM_ATTR static bool cmd_queue_push(const lvgl_port_cmd_t *cmd)
+{
+    uint32_t pos = __atomic_load_n(&cmd_enqueue_pos, __ATOMIC_RELAXED);
+    lvgl_port_cmd_cell_t *cell = NULL;
+
+    while (1) {
+        cell = &cmd_cells[pos & LVGL_PORT_CMD_QUEUE_MASK];
+        const int32_t diff = (int32_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            // On failure `pos` is reloaded with the position claimed by the other producer
+            if (__atomic_compare_exchange_n(&cmd_enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&cmd_stats.dropped, 1, __ATOMIC_RELAXED);
+            return false; // The cell of the previous lap is not consumed yet, the queue is full
+        } else {
+            pos = __atomic_load_n(&cmd_enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->cmd = *cmd;
+    cell->cmd.post_us = esp_timer_get_time();
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE); // Publish the command
+    __atomic_fetch_add(&cmd_stats.posted, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+// Run the commands posted so far, at most one lap of the ring so a busy producer can't starve rendering
+static void cmd_queue_drain(void)
+{
+    uint32_t count = 0;
+
+    while (count < LVGL_PORT_CMD_QUEUE_LEN) {
+        lvgl_port_cmd_cell_t *cell = &cmd_cells[cmd_dequeue_pos & LVGL_PORT_CMD_QUEUE_MASK];
+        if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != cmd_dequeue_pos + 1) {
+            break; // Empty, or the producer of this cell has not published it yet and will wake the task when it does
+        }
+        lvgl_port_cmd_t cmd = cell->cmd;
+        __atomic_store_n(&cell->seq, cmd_dequeue_pos + LVGL_PORT_CMD_QUEUE_LEN, __ATOMIC_RELEASE); // Free the cell
+        cmd_dequeue_pos++;
+
+        const uint32_t latency_us = (uint32_t)(esp_timer_get_time() - cmd.post_us);
+        PERF_STAGE_RECORD_US(PERF_STAGE_UI_CMD, latency_us);
+        cmd.run(&cmd);
+        if (cmd.done) {
+            cmd.done(&cmd);
+        }
+
+        cmd_stats.executed++;
+        cmd_latency_sum_us += latency_us;
+        if (latency_us > cmd_stats.max_latency_us) {
+            cmd_stats.max_latency_us = latency_us;
+        }
+        count++;
+    }
+
+    if (count > cmd_stats.max_depth) {
+        cmd_stats.max_depth = count;
+    }
+}
+
+#if LVGL_PORT_ACTIVITY_LOG_PERIOD_MS > 0
+static void lvgl_port_log_activity(void)
+{
+    lvgl_port_activity_t activity;
+    lvgl_port_get_activity(&activity, false);
+    if (activity.elapsed_us < (uint64_t)LVGL_PORT_ACTIVITY_LOG_PERIOD_MS * 1000) {
+        return;
+    }
+    lvgl_port_get_activity(&activity, true);
+
+    // Rates in 1/100 per second, so that a static scene with a few wake-ups per minute still shows up
+    const uint32_t elapsed_ms = (uint32_t)(activity.elapsed_us / 1000);
+    const uint32_t wakeups_c = (uint32_t)((uint64_t)activity.wakeup_count * 100000 / elapsed_ms);
+    const uint32_t ticks_c = (uint32_t)((uint64_t)activity.tick_count * 100000 / elapsed_ms);
+    ESP_LOGI(TAG, "LVGL load %lu.%02lu%%, %lu.%02lu wakeups/s, %lu.%02lu ticks/s over %lu ms, tick %s",
+             (unsigned long)(activity.busy_us * 100 / activity.elapsed_us),
+             (unsigned long)(activity.busy_us * 10000 / activity.elapsed_us % 100),
+             (unsigned long)(wakeups_c / 100), (unsigned long)(wakeups_c % 100),
+             (unsigned long)(ticks_c / 100), (unsigned long)(ticks_c % 100),
+             (unsigned long)elapsed_ms, activity.tick_stopped ? "stopped" : "running");
+
+    lvgl_port_cmd_stats_t stats;
+    lvgl_port_get_cmd_stats(&stats, true);
+    if (stats.posted || stats.dropped) {
+        ESP_LOGI(TAG, "Commands: %lu posted, %lu dropped, latency avg %lu us max %lu us, depth max %lu",
+                 (unsigned long)stats.posted, (unsigned long)stats.dropped, (unsigned long)stats.avg_latency_us,
+                 (unsigned long)stats.max_latency_us, (unsigned long)stats.max_depth);
+    }
+}
+#endif
+
+static TickType_t lvgl_port_task_timeout(uint32_t task_delay_ms)
+{
+    #if LVGL_PORT_TASK_EVENT_DRIVEN
+    // Nothing scheduled, sleep until somebody wakes the task up
+    if (task_delay_ms == LV_NO_TIMER_READY) {
+        return portMAX_DELAY;
+    }
+    #else
+    if (task_delay_ms > LVGL_PORT_TASK_MAX_DELAY_MS) {
+        task_delay_ms = LVGL_PORT_TASK_MAX_DELAY_MS;
+    }
+    #endif
+    // Ensure the delay time is within limits, so lower priority tasks are never starved
+    if (task_delay_ms < LVGL_PORT_TASK_MIN_DELAY_MS) {
+        task_delay_ms = LVGL_PORT_TASK_MIN_DELAY_MS;
+    }
+    return pdMS_TO_TICKS(task_delay_ms);
+}
+
 static void lvgl_port_task(void *arg)
 {
     ESP_LOGD(TAG, "Starting LVGL task"); // Log the task start
 
     uint32_t task_delay_ms = LVGL_PORT_TASK_MAX_DELAY_MS; // Set initial task delay
     while (1) {
+        portENTER_CRITICAL(&lvgl_tick_spinlock);
+        lvgl_activity.wakeup_count++;
+        portEXIT_CRITICAL(&lvgl_tick_spinlock);
+        tick_set_running(true); // Keep LVGL time moving while timers and rendering run
+
+        const int64_t busy_start_us = esp_timer_get_time();
         if (lvgl_port_lock(-1)) { // Try to lock the LVGL mutex
+            cmd_queue_drain(); // Apply the commands posted by other tasks before rendering
+            PERF_STAGE_BEGIN(render);
             task_delay_ms = lv_timer_handler(); // Handle LVGL timer events
+            PERF_STAGE_END(render, PERF_STAGE_RENDER);
             lvgl_port_unlock(); // Unlock the mutex
         }
-        // Ensure the delay time is within limits
-        if (task_delay_ms > LVGL_PORT_TASK_MAX_DELAY_MS) {
-            task_delay_ms = LVGL_PORT_TASK_MAX_DELAY_MS;
-        } else if (task_delay_ms < LVGL_PORT_TASK_MIN_DELAY_MS) {
-            task_delay_ms = LVGL_PORT_TASK_MIN_DELAY_MS;
+        const int64_t busy_us = esp_timer_get_time() - busy_start_us;
+        portENTER_CRITICAL(&lvgl_tick_spinlock);
+        lvgl_activity.busy_us += busy_us;
+        portEXIT_CRITICAL(&lvgl_tick_spinlock);
+
+        #if LVGL_PORT_TICK_IDLE_STOP
+        /* Nothing moves on screen, LVGL time is caught up from `esp_timer_get_time()` on the next wake-up */
+        if (lvgl_port_is_idle(task_delay_ms)) {
+            tick_set_running(false);
+        }
+        #endif
+        #if LVGL_PORT_ACTIVITY_LOG_PERIOD_MS > 0
+        lvgl_port_log_activity();
+        #endif
+
+        /* A wake request that arrived while rendering has to be serviced right away */
+        if (ulTaskNotifyValueClear(NULL, LVGL_PORT_NOTIFY_WAKE) & LVGL_PORT_NOTIFY_WAKE) {
+            continue;
         }
-        vTaskDelay(pdMS_TO_TICKS(task_delay_ms)); // Delay the task for the calculated time
+        /* Sleep until the next LVGL timer is due or until the task is woken up */
+        xTaskNotifyWait(0, ULONG_MAX, NULL, lvgl_port_task_timeout(task_delay_ms));
     }
 }
 
 esp_err_t lvgl_port_init(esp_lcd_panel_handle_t lcd_handle, esp_lcd_touch_handle_t tp_handle)
 {
+    #if CONFIG_EXAMPLE_LVGL_MEM_POOLS
+    lvgl_mem_init(); // LVGL allocates from its pools from `lv_init()` on, falls back to the heap on failure
+    #endif
     lv_init(); // Initialize LVGL
     ESP_ERROR_CHECK(tick_init()); // Initialize the tick timer
 
-    lv_fs_stdio_init(); // Initialize file system driver
-
     lv_disp_t *disp = display_init(lcd_handle); // Initialize the display
     assert(disp); // Ensure the display initialization was successful
 
@@ -533,6 +1015,13 @@ esp_err_t lvgl_port_init(esp_lcd_panel_handle_t lcd_handle, esp_lcd_touch_handle
 
     lvgl_mux = xSemaphoreCreateRecursiveMutex(); // Create a recursive mutex for LVGL
     assert(lvgl_mux); // Ensure mutex creation was successful
+    cmd_queue_init(); // Commands may be posted as soon as the LVGL task exists
+
+    #if LVGL_PORT_PARALLEL_DRAW
+    if (draw_worker_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Parallel drawing disabled, failed to create the worker"); // Everything is drawn by the LVGL task
+    }
+    #endif
 
     ESP_LOGI(TAG, "Create LVGL task"); // Log task creation
     BaseType_t core_id = (LVGL_PORT_TASK_CORE < 0) ? tskNO_AFFINITY : LVGL_PORT_TASK_CORE; // Determine core ID for the task
@@ -558,6 +1047,91 @@ void lvgl_port_unlock(void)
 {
     assert(lvgl_mux && "lvgl_port_init must be called first"); // Ensure the mutex is initialized
     xSemaphoreGiveRecursive(lvgl_mux); // Release the mutex
+
+    // Changes made from other tasks may have scheduled new LVGL work
+    if (xTaskGetCurrentTaskHandle() != lvgl_task_handle) {
+        lvgl_port_wake();
+    }
+}
+
+esp_err_t lvgl_port_post(const lvgl_port_cmd_t *cmd)
+{
+    if (!cmd || !cmd->run) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!__atomic_load_n(&cmd_queue_ready, __ATOMIC_ACQUIRE)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!cmd_queue_push(cmd)) {
+        return ESP_ERR_NO_MEM;
+    }
+    lvgl_port_wake();
+    return ESP_OK;
+}
+
+IRAM_ATTR esp_err_t lvgl_port_post_from_isr(const lvgl_port_cmd_t *cmd, bool *need_yield)
+{
+    if (need_yield) {
+        *need_yield = false;
+    }
+    if (!cmd || !cmd->run) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!__atomic_load_n(&cmd_queue_ready, __ATOMIC_ACQUIRE)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!cmd_queue_push(cmd)) {
+        return ESP_ERR_NO_MEM;
+    }
+    const bool yield = lvgl_port_wake_from_isr();
+    if (need_yield) {
+        *need_yield = yield;
+    }
+    return ESP_OK;
+}
+
+void lvgl_port_get_cmd_stats(lvgl_port_cmd_stats_t *stats, bool reset)
+{
+    assert(stats);
+
+    *stats = cmd_stats;
+    stats->avg_latency_us = stats->executed ? (uint32_t)(cmd_latency_sum_us / stats->executed) : 0;
+    if (reset) {
+        memset(&cmd_stats, 0, sizeof(cmd_stats));
+        cmd_latency_sum_us = 0;
+    }
+}
+
+void lvgl_port_get_activity(lvgl_port_activity_t *activity, bool reset)
+{
+    assert(activity);
+
+    portENTER_CRITICAL(&lvgl_tick_spinlock); // The counters are updated from the esp_timer task and the LVGL task
+    const int64_t now_us = esp_timer_get_time();
+    *activity = lvgl_activity;
+    activity->elapsed_us = now_us - lvgl_activity_start_us;
+    if (reset) {
+        memset(&lvgl_activity, 0, sizeof(lvgl_activity));
+        lvgl_activity_start_us = now_us;
+    }
+    portEXIT_CRITICAL(&lvgl_tick_spinlock);
+    activity->tick_stopped = !lvgl_tick_running;
+}
+
+void lvgl_port_wake(void)
+{
+    if (lvgl_task_handle) {
+        xTaskNotify(lvgl_task_handle, LVGL_PORT_NOTIFY_WAKE, eSetBits); // Wake the LVGL task
+    }
+}
+
+IRAM_ATTR bool lvgl_port_wake_from_isr(void)
+{
+    BaseType_t need_yield = pdFALSE; // Flag to check if a yield is needed
+    if (lvgl_task_handle) {
+        xTaskNotifyFromISR(lvgl_task_handle, LVGL_PORT_NOTIFY_WAKE, eSetBits, &need_yield); // Wake the LVGL task
+    }
+    return (need_yield == pdTRUE); // Return whether a yield is needed
 }
 
 bool lvgl_port_notify_rgb_vsync(void)
@@ -569,8 +1143,10 @@ bool lvgl_port_notify_rgb_vsync(void)
         lvgl_port_rgb_last_buf = lvgl_port_rgb_next_buf; // Update the last buffer
     }
     #elif LVGL_PORT_AVOID_TEAR_ENABLE
-    // Notify that the current RGB frame buffer has been transmitted
-    xTaskNotifyFromISR(lvgl_task_handle, ULONG_MAX, eNoAction, &need_yield); // Notify the LVGL task
+    // Notify that the current RGB frame buffer has been transmitted, only if the flush callback is waiting for it
+    if (flush_vsync_pending) {
+        xTaskNotifyFromISR(lvgl_task_handle, LVGL_PORT_NOTIFY_VSYNC, eSetBits, &need_yield); // Notify the LVGL task
+    }
     #endif
     return (need_yield == pdTRUE); // Return whether a yield is needed
 }
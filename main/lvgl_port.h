@@ -24,6 +24,26 @@ extern "C" {
     #define LVGL_PORT_H_RES             (800)
     #define LVGL_PORT_V_RES             (480)
     #define LVGL_PORT_TICK_PERIOD_MS    (CONFIG_EXAMPLE_LVGL_PORT_TICK)
+    #ifdef CONFIG_EXAMPLE_LVGL_PORT_TICK_IDLE_STOP
+    #define LVGL_PORT_TICK_IDLE_STOP            (1)     // Stop the periodic tick while the scene is static
+    #define LVGL_PORT_TICK_IDLE_THRESHOLD_MS    (CONFIG_EXAMPLE_LVGL_PORT_TICK_IDLE_THRESHOLD_MS)   // Minimum time to the next LVGL timer to be idle
+    #else
+    #define LVGL_PORT_TICK_IDLE_STOP            (0)
+    #endif
+    #define LVGL_PORT_ACTIVITY_LOG_PERIOD_MS    (CONFIG_EXAMPLE_LVGL_PORT_ACTIVITY_LOG_PERIOD_MS)    // `0` disables the activity log
+    #define LVGL_PORT_CMD_QUEUE_LEN     (CONFIG_EXAMPLE_LVGL_PORT_CMD_QUEUE_LEN)       // Depth of the command queue, power of two
+    #ifdef CONFIG_EXAMPLE_LVGL_PORT_FAST_IMG_BLIT
+    #define LVGL_PORT_FAST_IMG_BLIT     (1)     // Copy opaque, untransformed RGB565 images without the generic blend
+    #else
+    #define LVGL_PORT_FAST_IMG_BLIT     (0)
+    #endif
+    #ifdef CONFIG_EXAMPLE_LVGL_PORT_PARALLEL_DRAW
+    #define LVGL_PORT_PARALLEL_DRAW             (1)     // Split large blends and image copies with a worker on the other core
+    #define LVGL_PORT_PARALLEL_DRAW_MIN_PX      (CONFIG_EXAMPLE_LVGL_PORT_PARALLEL_DRAW_MIN_PX) // Smaller areas are drawn by the LVGL task alone
+    #define LVGL_PORT_PARALLEL_DRAW_STACK_SIZE  (3 * 1024)
+    #else
+    #define LVGL_PORT_PARALLEL_DRAW             (0)
+    #endif
 
     /**
      * LVGL timer handle task related parameters, can be adjusted by users
@@ -35,6 +55,11 @@ extern "C" {
     #define LVGL_PORT_TASK_PRIORITY     (CONFIG_EXAMPLE_LVGL_PORT_TASK_PRIORITY)        // The priority of the LVGL timer task
     #define LVGL_PORT_TASK_CORE         (CONFIG_EXAMPLE_LVGL_PORT_TASK_CORE)            // The core of the LVGL timer task,
     // `-1` means the don't specify the core
+    #ifdef CONFIG_EXAMPLE_LVGL_PORT_TASK_EVENT_DRIVEN
+    #define LVGL_PORT_TASK_EVENT_DRIVEN (1)     // Sleep until the next LVGL timer is due or the task is woken up
+    #else
+    #define LVGL_PORT_TASK_EVENT_DRIVEN (0)     // Poll LVGL with a delay clamped to [MIN_DELAY_MS, MAX_DELAY_MS]
+    #endif
     /**
      *
      * LVGL buffer related parameters, can be adjusted by users:
@@ -115,6 +140,56 @@ extern "C" {
     #define LVGL_PORT_DIRECT_MODE           (0)
     #endif /* LVGL_PORT_AVOID_TEAR_ENABLE */
 
+    /**
+     * @brief Activity of the LVGL task, used to measure idle CPU load and wake-ups
+     *
+     */
+    typedef struct {
+        uint32_t wakeup_count;      // Number of times the LVGL task woke up
+        uint32_t tick_count;        // Number of periodic LVGL tick callbacks
+        uint64_t busy_us;           // Time spent in `lv_timer_handler()`, in [us]
+        uint64_t elapsed_us;        // Length of the measurement, in [us]
+        bool tick_stopped;          // Whether the periodic tick is currently stopped
+    } lvgl_port_activity_t;
+
+    typedef struct lvgl_port_cmd_t lvgl_port_cmd_t;
+
+    /**
+     * @brief Callback of a command, called from the LVGL task with the LVGL mutex held
+     *
+     */
+    typedef void (*lvgl_port_cmd_cb_t)(const lvgl_port_cmd_t *cmd);
+
+    /**
+     * @brief Command for the LVGL task, copied into the queue by `lvgl_port_post()`
+     *
+     * @note The meaning of `obj`, `data` and `value` is defined by `run`. Anything they point to must stay valid until
+     *       `done` is called.
+     *
+     */
+    struct lvgl_port_cmd_t {
+        lvgl_port_cmd_cb_t run;     // Applies the command to the UI
+        lvgl_port_cmd_cb_t done;    // Completion callback, called right after `run`, can be NULL
+        void *obj;                  // Target of the command, e.g. an LVGL object
+        const void *data;           // Command payload, e.g. an image source
+        intptr_t value;             // Scalar argument
+        void *user_data;            // Free for the producer, e.g. to find its context in `done`
+        int64_t post_us;            // Set by `lvgl_port_post()`
+    };
+
+    /**
+     * @brief Statistics of the command queue since the last reset
+     *
+     */
+    typedef struct {
+        uint32_t posted;            // Commands accepted by the queue
+        uint32_t dropped;           // Commands rejected because the queue was full
+        uint32_t executed;          // Commands run by the LVGL task
+        uint32_t max_depth;         // Largest number of commands handled in one pass of the LVGL task
+        uint32_t avg_latency_us;    // Average time from posting to running a command
+        uint32_t max_latency_us;    // Longest time from posting to running a command
+    } lvgl_port_cmd_stats_t;
+
     /**
      * @brief Initialize LVGL port
      *
@@ -128,9 +203,55 @@ extern "C" {
      */
     esp_err_t lvgl_port_init(esp_lcd_panel_handle_t lcd_handle, esp_lcd_touch_handle_t tp_handle);
 
+    /**
+     * @brief Post a command to the LVGL task without blocking
+     *
+     * @note This is the preferred way to change the UI from other tasks and ISRs: the producer never waits for
+     *       rendering, unlike with `lvgl_port_lock()`. Commands are run in posting order (per producer) at the start
+     *       of the next pass of the LVGL task.
+     *
+     * @param[in] cmd: Command, copied into the queue
+     *
+     * @return
+     *      - ESP_OK: Success
+     *      - ESP_ERR_INVALID_ARG: Invalid argument
+     *      - ESP_ERR_INVALID_STATE: `lvgl_port_init()` has not been called
+     *      - ESP_ERR_NO_MEM: The queue is full
+     */
+    esp_err_t lvgl_port_post(const lvgl_port_cmd_t *cmd);
+
+    /**
+     * @brief Post a command from an ISR, see `lvgl_port_post()`
+     *
+     * @note Placed in IRAM, so it can be called while the flash cache is disabled as long as `cmd` and the data
+     *       it points to are in internal RAM.
+     *
+     * @param[in] cmd: Command, copied into the queue
+     * @param[out] need_yield: Set to true if the tasks need to be re-scheduled
+     *
+     * @return
+     *      - ESP_OK: Success
+     *      - ESP_ERR_INVALID_ARG: Invalid argument
+     *      - ESP_ERR_INVALID_STATE: `lvgl_port_init()` has not been called
+     *      - ESP_ERR_NO_MEM: The queue is full
+     */
+    esp_err_t lvgl_port_post_from_isr(const lvgl_port_cmd_t *cmd, bool *need_yield);
+
+    /**
+     * @brief Get the statistics of the command queue
+     *
+     * @param[out] stats: Statistics
+     * @param[in] reset: Start a new measurement after reading the statistics
+     *
+     */
+    void lvgl_port_get_cmd_stats(lvgl_port_cmd_stats_t *stats, bool reset);
+
     /**
      * @brief Take LVGL mutex
      *
+     * @note Kept for initialization code and compatibility. The caller blocks while the LVGL task renders, use
+     *       `lvgl_port_post()` to change the UI from tasks that must not stall.
+     *
      * @param[in] timeout_ms: Timeout in [ms]. 0 will block indefinitely.
      *
      * @return
@@ -145,6 +266,34 @@ extern "C" {
      */
     void lvgl_port_unlock(void);
 
+    /**
+     * @brief Get the activity of the LVGL task since the last reset
+     *
+     * @param[out] activity: Activity counters
+     * @param[in] reset: Start a new measurement after reading the counters
+     *
+     */
+    void lvgl_port_get_activity(lvgl_port_activity_t *activity, bool reset);
+
+    /**
+     * @brief Wake the LVGL task so that pending LVGL work is handled immediately
+     *
+     * @note The LVGL task sleeps until the next LVGL timer is due. `lvgl_port_unlock()` already wakes it up when
+     *       called from another task, so this is only needed for events that don't go through the LVGL mutex
+     *       (e.g. new input data).
+     *
+     */
+    void lvgl_port_wake(void);
+
+    /**
+     * @brief Wake the LVGL task from an ISR, see `lvgl_port_wake()`
+     *
+     * @return
+     *      - true:  The tasks need to be re-scheduled
+     *      - false: The tasks don't need to be re-scheduled
+     */
+    bool lvgl_port_wake_from_isr(void);
+
     /**
      * @brief Notifies the LVGL task when the transmission of the RGB frame buffer is completed.
      *
@@ -8,6 +8,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 
 #include <stdio.h>
@@ -20,6 +21,18 @@
 #include "waveshare_rgb_lcd_port.h"
 #include "lvgl_port.h"
 #include "storage_manager.h"
+#include "image_arena.h"
+#include "job_pool.h"
+#include "i2c_bus_mgr.h"
+#include "ch422g.h"
+#include "flash_album.h"
+#include "slide_index.h"
+#include "photo_display.h"
+#include "photo_display_fs.h"
+#include "perf_monitor.h"
+#include "pipeline.h"
+#include "sd_io.h"
+#include "ui_cmd.h"
 #include "widgets/lv_img.h"
 #include "lvgl.h"
 #include "esp_heap_caps.h"
@@ -33,6 +46,11 @@
 #define SLIDE_INTERVAL_MS     10000          // 切替間隔(ms)
 #define MAX_IMAGES            64            // 読み込む最大枚数
 #define TOTAL_PRELOAD_LIMIT   (16 * 1024 * 1024) // 先読み合計上限(16MB)
+#define PRELOAD_RESERVE       (1024 * 1024) // 先読みで残すアリーナ容量（表示時に読む画像用）
+#define SLIDE_SETTLE_MS       1000          // 切替後、低リフレッシュに戻すまでの時間(ms)
+#define SLIDE_JOBS            2             // パイプライン内のスライド数（表示中のフレーム＋これだけスロットを使う）
+#define SLOT_RETRY_MS         50            // フレームスロットが空くまでの再試行間隔(ms)
+#define SLOT_WAIT_MS          (2 * SLIDE_INTERVAL_MS) // スロット待ちの上限、超えたら未デコードで表示
 
 typedef struct {
     bool ok;
@@ -40,18 +58,55 @@ typedef struct {
 } sd_evt_t;
 
 static QueueHandle_t ui_evt_q = NULL;
-static lv_obj_t *img_obj = NULL;
+static lv_timer_t *settle_timer = NULL;   // 静止表示へ戻すタイマー
 
 typedef struct {
-    uint8_t     *buf;   // 画像のRAWバイト(JPG/PNG)
+    uint8_t     *buf;   // 画像のRAWバイト(JPG/PNG)、NULLなら表示時に読む
     size_t       size;  // バイト数
     lv_img_dsc_t dsc;   // LVGLに渡す記述子
     char         name[64]; // ログ用ファイル名(一部のみ)
+    char         path[SD_IO_PATH_MAX]; // 先読みしていない画像の読み出し元
 } image_t;
 
+/* スライドショーで回すアルバム（SDの先読み結果、またはフラッシュ） */
+typedef struct {
+    const image_t *images;
+    size_t         count;
+} album_t;
+
+/* パイプラインを流れる1枚分（read → decode → scale → present） */
+typedef struct {
+    const album_t *album;   // indexの参照先（切替後も流れている分は元のアルバム）
+    size_t       index;     // album->imagesの番号
+    void        *block;     // 表示時に読んだRAWバイト（アリーナ）、先読み済みならNULL
+    lv_img_dsc_t src;       // デコード元
+    photo_display_frame_t frame; // デコード結果
+} slide_job_t;
+
 static image_t g_images[MAX_IMAGES];
 static size_t  g_image_count = 0;
-static size_t  g_current = 0;
+static size_t  g_on_demand = 0;     // 先読みしていない枚数
+static bool    g_preload_stopped = false; // 1枚入らなかったら以後は列挙だけ
+static album_t g_card_album;        // SDの画像（g_imagesを指す）
+static album_t g_flash_album;       // フラッシュの画像（表はPSRAM）
+static const album_t *g_album = NULL;       // 表示中（presentタスクが切り替える）
+static const album_t *g_album_next = NULL;  // 用意ができて切替待ち
+static slide_job_t g_jobs[SLIDE_JOBS];
+static pipeline_t *g_slides = NULL;
+static size_t  g_next = 0;          // 次にパイプラインへ入れる画像
+static lv_coord_t g_screen_w, g_screen_h;
+static SemaphoreHandle_t g_present_done = NULL;
+
+/* 未デコードで表示中の、表示時に読んだ画像（次の画像を表示するまでブロックを保持、LVGLタスクのみ） */
+typedef struct {
+    void        *block;
+    lv_img_dsc_t dsc;   // LVGLが参照する記述子（ジョブは次の画像に使い回すので写しを持つ）
+} raw_shown_t;
+static raw_shown_t g_raw_shown[2];
+static int     g_raw_cur = 0;       // 表示中のg_raw_shown（blockがNULLなら無し）
+#if CONFIG_STORAGE_READ_BENCH
+static char    g_first_path[sizeof(SLIDE_DIR) + 1 + 256];  // 速度比較に使う1枚目
+#endif
 
 /* 拡張子判定 */
 static bool has_image_ext(const char *name) {
@@ -63,38 +118,28 @@ static bool has_image_ext(const char *name) {
     return strcmp(ext, "jpg") == 0 || strcmp(ext, "jpeg") == 0 || strcmp(ext, "png") == 0;
 }
 
-/* 1枚読み込み（PSRAM） */
-static bool load_file_to_psram(const char *path, image_t *out) {
+/* 1枚読み込み（PSRAM）。読み出しはSD I/Oタスク経由
+ * 1バイト多く読んでサイズも確かめる（索引が古いとszが実際と違う）。ESP_ERR_NOT_FOUNDかESP_ERR_INVALID_SIZEなら索引が古い */
+static esp_err_t load_file_to_psram(const char *path, size_t sz, sd_io_prio_t prio, image_t *out) {
     memset(out, 0, sizeof(*out));
 
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        ESP_LOGE(TAG, "fopen failed: %s", path);
-        return false;
-    }
-    fseek(f, 0, SEEK_END);
-    long sz = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    if (sz <= 0) {
-        fclose(f);
-        ESP_LOGE(TAG, "invalid size: %s", path);
-        return false;
-    }
-
-    out->buf = (uint8_t *)heap_caps_malloc((size_t)sz + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    // アリーナから確保（ヒープを断片化させない）
+    out->buf = (uint8_t *)image_arena_alloc(sz + 1);
     if (!out->buf) {
-        fclose(f);
-        ESP_LOGE(TAG, "malloc failed for %ld bytes: %s", sz, path);
-        return false;
+        ESP_LOGE(TAG, "arena full for %u bytes: %s", (unsigned)sz, path);
+        return ESP_ERR_NO_MEM;
     }
 
-    size_t rd = fread(out->buf, 1, (size_t)sz, f);
-    fclose(f);
-    if (rd != (size_t)sz) {
-        ESP_LOGE(TAG, "fread short %zu/%ld: %s", rd, sz, path);
-        heap_caps_free(out->buf);
+    size_t rd = 0;
+    esp_err_t ret = sd_io_read(path, 0, out->buf, sz + 1, prio, &rd);
+    if (ret == ESP_OK && rd != sz) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "read failed %u/%u (%s): %s", (unsigned)rd, (unsigned)sz, esp_err_to_name(ret), path);
+        image_arena_free(out->buf);     // 直前の確保なのでその場で返却される
         memset(out, 0, sizeof(*out));
-        return false;
+        return ret;
     }
 
     out->buf[sz] = 0;       // 安全のため終端
@@ -112,12 +157,72 @@ static bool load_file_to_psram(const char *path, image_t *out) {
     const char *slash = strrchr(path, '/');
     snprintf(out->name, sizeof(out->name), "%s", slash ? slash + 1 : path);
 
-    ESP_LOGI(TAG, "Preloaded %s (%u bytes)", out->name, (unsigned)out->size);
+    ESP_LOGI(TAG, "Loaded %s (%u bytes)", out->name, (unsigned)out->size);
+    return ESP_OK;
+}
+
+/* 1枚を先読み。最初に入らなかった画像から先は表示時にreadステージで読む
+ * ファイルが無いかサイズが違えば登録せずにエラーを返す（索引からの列挙なら索引が古い） */
+static esp_err_t preload_one(const char *full, size_t sz, const char *name, size_t *total) {
+    image_arena_usage_t usage;
+    image_arena_get_usage(&usage);
+    const bool fits = !g_preload_stopped && (*total + sz <= TOTAL_PRELOAD_LIMIT) &&
+                      (usage.ring_used + sz + PRELOAD_RESERVE <= usage.ring_size);
+
+    // 最初の1枚は表示待ちなので最優先
+    sd_io_prio_t prio = (g_image_count == 0) ? SD_IO_PRIO_CURRENT : SD_IO_PRIO_PREFETCH;
+    image_t *img = &g_images[g_image_count];
+    const esp_err_t ret = fits ? load_file_to_psram(full, sz, prio, img) : ESP_ERR_NO_MEM;
+    if (ret == ESP_ERR_NOT_FOUND || ret == ESP_ERR_INVALID_SIZE) {
+        return ret;
+    }
+    if (ret == ESP_OK) {
+#if CONFIG_STORAGE_READ_BENCH
+        if (!g_first_path[0]) {
+            snprintf(g_first_path, sizeof(g_first_path), "%s", full);
+        }
+#endif
+        *total += sz;
+    } else {
+        // 後ろの小さい画像で隙間を埋めず、以後はすべて表示時に読む
+        g_preload_stopped = true;
+        if (strlen(full) >= sizeof(img->path)) {
+            return ESP_OK;
+        }
+        // 先読み分は固定されるので、表示時に読む画像はその上の残りに入らなければ読めない
+        if (image_arena_block_size(sz + 1) > usage.ring_size - usage.ring_used) {
+            ESP_LOGW(TAG, "Skipped %s (%u bytes): larger than the arena space left", name, (unsigned)sz);
+            return ESP_OK;
+        }
+        memset(img, 0, sizeof(*img));
+        img->size = sz;
+        g_on_demand++;
+    }
+    snprintf(img->name, sizeof(img->name), "%s", name);    // 索引があれば長いファイル名
+    snprintf(img->path, sizeof(img->path), "%s", full);
+    g_image_count++;
+    return ESP_OK;
+}
+
+/* 索引（長いファイル名）から列挙。readdir/statは不要
+ * 索引のサイズは先読みで読むときに確かめ、合わなければfalse（写真を入れ替えて索引を作り直していない） */
+static bool preload_from_index(const slide_index_t *index, size_t *total) {
+    slide_index_entry_t ent;
+    for (size_t i = 0; slide_index_get(index, i, &ent) && g_image_count < MAX_IMAGES; i++) {
+        if (ent.size == 0 || !has_image_ext(ent.name)) continue;
+
+        char full[sizeof(SLIDE_DIR) + 1 + SLIDE_INDEX_SHORT_LEN];
+        snprintf(full, sizeof(full), "%s/%s", SLIDE_DIR, ent.short_name);
+        if (preload_one(full, ent.size, ent.name, total) != ESP_OK) {
+            ESP_LOGW(TAG, "Slide index out of date at %s, listing the directory", ent.name);
+            return false;
+        }
+    }
     return true;
 }
 
-/* 画像を列挙して先読み（合計上限あり） */
-static void preload_all_images(void) {
+/* ディレクトリを列挙（8.3名のみ見える） */
+static void preload_from_dir(size_t *total) {
     DIR *dir = opendir(SLIDE_DIR);
     if (!dir) {
         ESP_LOGE(TAG, "opendir failed: %s", SLIDE_DIR);
@@ -125,60 +230,118 @@ static void preload_all_images(void) {
     }
 
     struct dirent *ent;
-    size_t total = 0;
-    g_image_count = 0;
-
     while ((ent = readdir(dir)) && g_image_count < MAX_IMAGES) {
         if (ent->d_type == DT_DIR) continue;
         if (!has_image_ext(ent->d_name)) continue;
 
-        // フルパスを動的に構築（切り詰め警告回避）
-        size_t need = strlen(SLIDE_DIR) + 1 /*'/'*/ + strlen(ent->d_name) + 1 /*'\0'*/;
-        char *full = (char *)heap_caps_malloc(need, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        if (!full) {
-            ESP_LOGE(TAG, "malloc failed for full path need=%u", (unsigned)need);
-            continue;
-        }
-        int n = snprintf(full, need, "%s/%s", SLIDE_DIR, ent->d_name);
-        if (n < 0 || (size_t)n >= need) {
-            ESP_LOGE(TAG, "snprintf truncated? need=%u n=%d", (unsigned)need, n);
-            heap_caps_free(full);
+        // フルパスはスタック上に構築（ヒープを使わない）
+        char full[sizeof(SLIDE_DIR) + 1 + sizeof(ent->d_name)];
+        int n = snprintf(full, sizeof(full), "%s/%s", SLIDE_DIR, ent->d_name);
+        if (n < 0 || (size_t)n >= sizeof(full)) {
+            ESP_LOGE(TAG, "snprintf truncated? n=%d", n);
             continue;
         }
 
         struct stat st;
         if (stat(full, &st) != 0 || st.st_size <= 0) {
-            heap_caps_free(full);
             continue;
         }
-        if (total + (size_t)st.st_size > TOTAL_PRELOAD_LIMIT) {
-            ESP_LOGW(TAG, "Preload limit reached (%u/%u). Stop.",
-                     (unsigned)total, (unsigned)TOTAL_PRELOAD_LIMIT);
-            heap_caps_free(full);
-            break;
-        }
+        preload_one(full, (size_t)st.st_size, ent->d_name, total);
+    }
+
+    closedir(dir);
+}
+
+/* 先読みの状態を空にする */
+static void preload_reset(size_t *total) {
+    *total = 0;
+    g_image_count = 0;
+    g_on_demand = 0;
+    g_preload_stopped = false;
+    image_arena_reset();    // アルバム切替時は前の画像をまとめて破棄
+}
+
+/* 画像を列挙して先読み（合計上限あり） */
+static void preload_all_images(void) {
+    size_t total;
+    preload_reset(&total);
+
+    // tools/make_slide_index.pyで作った索引があれば優先
+    slide_index_t *index = NULL;
+    bool listed = false;
+    if (slide_index_load(SLIDE_DIR, &index) == ESP_OK) {
+        listed = preload_from_index(index, &total);
+        slide_index_free(index);
+    }
+    if (!listed) {
+        // 索引が無いか古い。索引から読んだ分は捨てて列挙し直す
+        preload_reset(&total);
+        preload_from_dir(&total);
+    }
+    // 先読みした画像はアルバム切替まで残る。表示時に読む画像はその上でリングとして回す
+    if (image_arena_pin() != ESP_OK) {
+        ESP_LOGW(TAG, "Arena pin failed, on-demand reads share the ring with preloaded images");
+    }
 
-        if (load_file_to_psram(full, &g_images[g_image_count])) {
-            total += (size_t)st.st_size;
-            g_image_count++;
+    ESP_LOGI(TAG, "Preloaded %u images, total=%u bytes, %u read on demand",
+             (unsigned)(g_image_count - g_on_demand), (unsigned)total, (unsigned)g_on_demand);
+    image_arena_log_usage();
+    sd_io_log_stats();
+    storage_log_telemetry();
+
+#if CONFIG_STORAGE_READ_BENCH
+    // 先読み直後はSDが空いているので、fread経路と一括読み出し経路の速度を比較
+    if (g_image_count > g_on_demand) {
+        storage_read_bench_t bench;
+        if (storage_bench_read(g_first_path, &bench) != ESP_OK) {
+            ESP_LOGW(TAG, "Read bench failed: %s", g_first_path);
         }
-        heap_caps_free(full);
     }
+#endif
+}
 
-    closedir(dir);
-    ESP_LOGI(TAG, "Preloaded %u images, total=%u bytes",
-             (unsigned)g_image_count, (unsigned)total);
+/* フラッシュのアルバムを用意（mmapなのでSDを待たずにすぐ表示できる） */
+static bool use_flash_album(void) {
+    esp_err_t ret = flash_album_init();
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "No flash album (%s)", esp_err_to_name(ret));
+        return false;
+    }
+
+    const size_t count = flash_album_count() < MAX_IMAGES ? flash_album_count() : MAX_IMAGES;
+    image_t *images = count ? heap_caps_calloc(count, sizeof(image_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : NULL;
+    if (!images) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        image_t *img = &images[i];
+        img->dsc = *flash_album_get(i);     // データはフラッシュを直接指す
+        img->size = img->dsc.data_size;
+        snprintf(img->name, sizeof(img->name), "flash:%s", flash_album_name(i));
+    }
+    g_flash_album.images = images;
+    g_flash_album.count = count;
+    ESP_LOGI(TAG, "Flash album: %u images", (unsigned)count);
+    return true;
 }
 
-/* SDマウントして先読み（LCD起動前に完了させる） */
+/* SDマウントして先読み。arg != NULLならフラッシュのアルバムを表示中で、終わったら切替を予約する */
 static void sd_mount_task(void *arg) {
+    const bool flash_shown = (arg != NULL);
     sd_evt_t evt = { .ok = false };
 
     for (int attempt = 1; attempt <= SD_MOUNT_RETRIES; ++attempt) {
         vTaskDelay(pdMS_TO_TICKS(SD_RETRY_DELAY_MS));
         esp_err_t ret = storage_mount_sdcard();
         if (ret == ESP_OK) {
+            // 以後のSD読み出しはI/Oタスクが一括で担当
+            ret = sd_io_init();
+            if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+                ESP_LOGE(TAG, "SD I/O init failed (%s)", esp_err_to_name(ret));
+            }
             preload_all_images();
+            g_card_album.images = g_images;
+            g_card_album.count = g_image_count;
             if (g_image_count > 0) {
                 evt.ok = true;
                 snprintf(evt.msg, sizeof(evt.msg), "SD mounted (%d)", attempt);
@@ -195,36 +358,247 @@ static void sd_mount_task(void *arg) {
         snprintf(evt.msg, sizeof(evt.msg), "SD mount failed");
     }
 
-    xQueueSend(ui_evt_q, &evt, portMAX_DELAY);
+    if (flash_shown) {
+        // 表示中のスライドが終わったところでpresentタスクが切り替える
+        ESP_LOGI(TAG, "SD done: %s", evt.msg);
+        if (evt.ok) {
+            __atomic_store_n(&g_album_next, &g_card_album, __ATOMIC_RELEASE);
+        }
+    } else {
+        xQueueSend(ui_evt_q, &evt, portMAX_DELAY);
+    }
     vTaskDelete(NULL);
 }
 
-/* 表示ロジック（LVGLロック中で呼ぶ） */
-static void show_image_locked(size_t idx) {
-    if (idx >= g_image_count) return;
+/* 切替が落ち着いたらリフレッシュレートを下げる */
+static void slide_settle_cb(lv_timer_t *t) {
+    lv_timer_pause(t);
+    waveshare_rgb_lcd_set_refresh(WAVESHARE_RGB_LCD_REFRESH_LOW);
+}
+
+/* 表示コマンド（LVGLタスク内、ロック保持中） */
+static void present_cmd(const lvgl_port_cmd_t *cmd) {
+    slide_job_t *job = (slide_job_t *)cmd->user_data;
+    const image_t *img = &job->album->images[job->index];
+
+    // 切替中は通常のリフレッシュレート
+    waveshare_rgb_lcd_set_refresh(WAVESHARE_RGB_LCD_REFRESH_NORMAL);
+    if (!settle_timer) {
+        settle_timer = lv_timer_create(slide_settle_cb, SLIDE_SETTLE_MS, NULL);
+    }
+    lv_timer_reset(settle_timer);
+    lv_timer_resume(settle_timer);
+
+    // デコード済みフレームを背景として保持（オーバーレイ更新時に再デコードしない）
+    // フレームが無いときは読んだデータをそのまま表示（フラッシュのRGB565、またはデコードできなかった画像）
+    const void *src = &img->dsc;
+    raw_shown_t *prev = &g_raw_shown[g_raw_cur];
+    if (job->frame.slot < 0 && job->block) {
+        // 表示時に読んだ画像は表示中ずっとLVGLが読むので、ブロックをジョブから引き取る
+        g_raw_cur ^= 1;
+        g_raw_shown[g_raw_cur].block = job->block;
+        g_raw_shown[g_raw_cur].dsc = job->src;
+        src = &g_raw_shown[g_raw_cur].dsc;
+        job->block = NULL;
+    }
+    photo_display_present(&job->frame, src);
+    if (prev->block && prev != &g_raw_shown[g_raw_cur]) {
+        lv_img_cache_invalidate_src(&prev->dsc);
+        image_arena_free(prev->block);
+        prev->block = NULL;
+    }
+    ESP_LOGI(TAG, "Shown: %s (%u bytes)", img->name, (unsigned)img->size);
+}
+
+static void present_cmd_done(const lvgl_port_cmd_t *cmd) {
+    (void)cmd;
+    xSemaphoreGive(g_present_done);
+}
+
+/* read: RAWバイトをメモリに用意（先読み済みならそのまま） */
+static esp_err_t read_stage(void *item, void *ctx) {
+    slide_job_t *job = item;
+    const image_t *img = &job->album->images[job->index];
+    if (img->dsc.data) {
+        job->src = img->dsc;
+        return ESP_OK;
+    }
+
+    image_t loaded;
+    esp_err_t ret = load_file_to_psram(img->path, img->size, SD_IO_PRIO_PREFETCH, &loaded);
+    if (ret != ESP_OK) {
+        return ret;     // サイズ違いは索引を作り直すまで飛ばす
+    }
+    job->block = loaded.buf;
+    job->src = loaded.dsc;
+    return ESP_OK;
+}
+
+/* decode: フレームスロットへ展開（LVGLタスクとは別コア） */
+static esp_err_t decode_stage(void *item, void *ctx) {
+    slide_job_t *job = item;
+    if (photo_display_is_plain(&job->src)) {
+        return ESP_OK;      // RGB565はその場で表示
+    }
+
+    esp_err_t ret;
+    // スロットは次の画像を表示したときに空く（表示中＋表示待ちで塞がっていても1間隔で空く）
+    uint32_t waited_ms = 0;
+    while ((ret = photo_display_decode(&job->src, &job->frame)) == ESP_ERR_NOT_FOUND && waited_ms < SLOT_WAIT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(SLOT_RETRY_MS));
+        waited_ms += SLOT_RETRY_MS;
+    }
+    if (ret != ESP_OK) {
+        // 未キャッシュで表示（再描画のたびにデコード）、表示時に読んだ画像もブロックを表示中保持する
+        ESP_LOGW(TAG, "Decode failed (%s), shown undecoded: %s", esp_err_to_name(ret),
+                 job->album->images[job->index].name);
+    }
+    return ESP_OK;
+}
+
+/* scale: 画面より大きいフレームを縮小 */
+static esp_err_t scale_stage(void *item, void *ctx) {
+    slide_job_t *job = item;
+    if (job->frame.slot < 0) {
+        return ESP_OK;
+    }
+    return photo_display_scale(&job->frame, g_screen_w, g_screen_h);
+}
+
+/* present: 切替時刻まで待ってLVGLタスクで表示 */
+static esp_err_t present_stage(void *item, void *ctx) {
+    static TickType_t last_shown;
+    static bool shown_once = false;
+    slide_job_t *job = item;
+
+    if (shown_once) {
+        xTaskDelayUntil(&last_shown, pdMS_TO_TICKS(SLIDE_INTERVAL_MS));
+    } else {
+        last_shown = xTaskGetTickCount();
+        shown_once = true;
+    }
+
+    lvgl_port_cmd_t cmd = {
+        .run = present_cmd,
+        .done = present_cmd_done,
+        .user_data = job,
+    };
+    while (lvgl_port_post(&cmd) != ESP_OK) {
+        vTaskDelay(pdMS_TO_TICKS(SLOT_RETRY_MS));   // コマンドキューが満杯
+    }
+    xSemaphoreTake(g_present_done, portMAX_DELAY);  // フレームは表示側に渡った
+    return ESP_OK;
+}
 
-    if (!img_obj) {
-        img_obj = lv_img_create(lv_scr_act());
-        lv_obj_align(img_obj, LV_ALIGN_CENTER, 0, 0);
+/* SDのアルバムに切り替えたら"S:"ドライバも使えるようにする（LVGLタスク内） */
+static void card_ready_cmd(const lvgl_port_cmd_t *cmd) {
+    if (photo_display_fs_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Photo FS init failed");
     }
-    lv_img_set_src(img_obj, &g_images[idx].dsc);
-    ESP_LOGI(TAG, "Shown: %s (%u bytes)", g_images[idx].name, (unsigned)g_images[idx].size);
 }
 
-/* タイマーコールバック */
-static void slide_timer_cb(lv_timer_t *t) {
-    (void)t;
-    if (g_image_count == 0) return;
+/* 1枚が抜けたら後始末して次の画像を入れる（presentステージのタスク内） */
+static void slide_done(void *item, esp_err_t status, void *ctx) {
+    slide_job_t *job = item;
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Skipped %s (%s)", job->album->images[job->index].name, esp_err_to_name(status));
+        vTaskDelay(pdMS_TO_TICKS(SLOT_RETRY_MS));   // 全部読めなくても空回りしない
+    }
+    photo_display_frame_release(&job->frame);   // 表示したフレームは表示側が持っている
+    if (job->block) {
+        image_arena_free(job->block);           // 先読み分の上のリングに確保順で返る
+        job->block = NULL;
+    }
+    if (job->index == job->album->count - 1) {
+        pipeline_log_stats(g_slides);           // 1周ごと
+        job_pool_log_stats();
+        i2c_bus_log_stats();
+        ch422g_log_stats();
+        ui_cmd_log_mem();                       // 1周目が基準、以降は増えたブロックを報告
+    }
+
+    // SDの準備ができたらフラッシュから切り替える（もう1枚は元のアルバムのまま流れる）
+    const album_t *next = __atomic_exchange_n(&g_album_next, NULL, __ATOMIC_ACQ_REL);
+    if (next) {
+        g_album = next;
+        g_next = 0;
+        ui_cmd_run(card_ready_cmd, NULL, NULL);
+        ESP_LOGI(TAG, "Switched to the SD album (%u images)", (unsigned)next->count);
+    }
+
+    job->album = g_album;
+    job->index = g_next;
+    g_next = (g_next + 1) % g_album->count;
+    if (pipeline_submit(g_slides, job) != ESP_OK) {
+        ESP_LOGE(TAG, "Slide pipeline refused %u", (unsigned)job->index);
+    }
+}
+
+static const pipeline_stage_config_t slide_stages[] = {
+    // name         run             ctx   depth stack priority core
+    { "sl_read",    read_stage,     NULL, SLIDE_JOBS, 4096, 2, 0 },   // SD I/Oタスクの完了待ち
+    { "sl_decode",  decode_stage,   NULL, 1,    6144, 1, 0 },         // LVGLタスク(コア1)と並行
+    { "sl_scale",   scale_stage,    NULL, 1,    3072, 1, 0 },
+    { "sl_present", present_stage,  NULL, 1,    4096, 2, 1 },         // 切替時刻まで待つだけ
+};
+
+/* スライドショーのパイプラインを起動 */
+static esp_err_t start_slideshow(void) {
+    g_screen_w = lv_disp_get_hor_res(NULL);
+    g_screen_h = lv_disp_get_ver_res(NULL);
+    g_present_done = xSemaphoreCreateBinary();
+    if (!g_present_done) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const pipeline_config_t cfg = {
+        .stages = slide_stages,
+        .n_stages = sizeof(slide_stages) / sizeof(slide_stages[0]),
+        .done = slide_done,
+    };
+    esp_err_t ret = pipeline_create(&cfg, &g_slides);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    const size_t jobs = g_album->count < SLIDE_JOBS ? g_album->count : SLIDE_JOBS;
+    for (size_t i = 0; i < jobs; i++) {
+        memset(&g_jobs[i], 0, sizeof(g_jobs[i]));
+        g_jobs[i].frame.slot = -1;
+        g_jobs[i].album = g_album;
+        g_jobs[i].index = g_next;
+        g_next = (g_next + 1) % g_album->count;
+        pipeline_submit(g_slides, &g_jobs[i]);
+    }
+    return ESP_OK;
+}
+
+/* 初期画面（コマンドとしてLVGLタスク内で実行、g_album = 最初に表示するアルバム） */
+static void start_ui_cmd(const lvgl_port_cmd_t *cmd) {
+    // "S:" ドライバ（SD I/Oタスク経由のブロックキャッシュ）
+    if (g_album == &g_card_album) {
+        card_ready_cmd(cmd);
+    }
 
-    if (lvgl_port_lock(-1)) {
-        show_image_locked(g_current);
-        g_current = (g_current + 1) % g_image_count;
-        lvgl_port_unlock();
+    esp_err_t ret = ESP_FAIL;
+    if (g_album && g_album->count > 0) {
+        // 1枚目はすぐ表示、以後SLIDE_INTERVAL_MSごと
+        ret = start_slideshow();
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Slideshow start failed (%s)", esp_err_to_name(ret));
+        }
+    }
+    if (ret != ESP_OK) {
+        lv_obj_t *lbl = lv_label_create(lv_scr_act());
+        lv_label_set_text(lbl, "No images found");
+        lv_obj_center(lbl);
     }
 }
 
 /* メイン */
 void app_main(void) {
+    perf_monitor_init();
+
     ESP_LOGI(TAG, "Mounting SD card");
 
     sd_evt_t sd_evt;
@@ -234,30 +608,42 @@ void app_main(void) {
         while (1) { vTaskDelay(1); }
     }
 
-    xTaskCreatePinnedToCore(sd_mount_task, "sd_mount", 8192, NULL, 3, NULL, 0);
+    // 画像用のPSRAM領域を起動直後に一括確保
+    if (image_arena_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Image arena init failed, photos are shown undecoded");
+    }
+
+    // 縮小などの画像処理を両コアで分担（失敗時は呼び出し元だけで処理）
+    if (job_pool_init(0) != ESP_OK) {
+        ESP_LOGE(TAG, "Job pool init failed");
+    }
 
-    ESP_LOGI(TAG, "Waiting for SD mount...");
-    xQueueReceive(ui_evt_q, &sd_evt, portMAX_DELAY);
-    ESP_LOGI(TAG, "SD mount done: %s", sd_evt.msg);
+    // フラッシュのアルバムがあればSDを待たずに表示し、SDの先読みが終わったら切り替える
+    const bool flash_first = use_flash_album();
+    xTaskCreatePinnedToCore(sd_mount_task, "sd_mount", 8192, flash_first ? &g_flash_album : NULL, 3, NULL, 0);
+
+    if (flash_first) {
+        g_album = &g_flash_album;
+    } else {
+        ESP_LOGI(TAG, "Waiting for SD mount...");
+        xQueueReceive(ui_evt_q, &sd_evt, portMAX_DELAY);
+        ESP_LOGI(TAG, "SD mount done: %s", sd_evt.msg);
+        g_album = sd_evt.ok ? &g_card_album : NULL;
+    }
 
-    // LCD 初期化（以後はSDに触らないため競合リスクなし）
+    // LCD 初期化（SDのマウントと並行してもCH422GとI2Cはドライバ側で排他）
     esp_err_t ret = waveshare_esp32_s3_rgb_lcd_init();
     ESP_LOGI(TAG, "LCD init = %d", ret);
     wavesahre_rgb_lcd_bl_on();
-
-    if (lvgl_port_lock(-1)) {
-        if (sd_evt.ok && g_image_count > 0) {
-            // 初回表示 + タイマー開始
-            show_image_locked(0);
-            lv_timer_t *timer = lv_timer_create(slide_timer_cb, SLIDE_INTERVAL_MS, NULL);
-            lv_timer_set_repeat_count(timer, -1);
-        } else {
-            lv_obj_t *lbl = lv_label_create(lv_scr_act());
-            lv_label_set_text(lbl, "No images found");
-            lv_obj_center(lbl);
-        }
-        lvgl_port_unlock();
-    }
+#if CONFIG_EXAMPLE_LCD_REFRESH_BENCH
+    waveshare_rgb_lcd_bench_psram();
+#endif
+
+    // UIの変更はコマンドキュー経由（描画中でもブロックしない）
+    lvgl_port_cmd_t start_cmd = {
+        .run = start_ui_cmd,
+    };
+    ESP_ERROR_CHECK(lvgl_port_post(&start_cmd));
 
     vQueueDelete(ui_evt_q);
     ui_evt_q = NULL;
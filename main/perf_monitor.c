@@ -0,0 +1,229 @@
+#include "perf_monitor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "perf";
+
+static uint32_t s_counters[PERF_COUNTER_MAX];
+
+static const char *const s_counter_names[PERF_COUNTER_MAX] = {
+    [PERF_COUNTER_BOUNCE_FRAMES]   = "bounce_frames",
+    [PERF_COUNTER_BOUNCE_LATE]     = "bounce_late",
+    [PERF_COUNTER_BOUNCE_UNDERRUN] = "bounce_underrun",
+    [PERF_COUNTER_DRAW_SPLIT]      = "draw_split",
+};
+
+IRAM_ATTR void perf_monitor_count(perf_counter_t counter, uint32_t n)
+{
+    __atomic_fetch_add(&s_counters[counter], n, __ATOMIC_RELAXED);
+}
+
+uint32_t perf_monitor_get_counter(perf_counter_t counter)
+{
+    return (counter < PERF_COUNTER_MAX) ? __atomic_load_n(&s_counters[counter], __ATOMIC_RELAXED) : 0;
+}
+
+static void perf_counters_reset(void)
+{
+    for (int i = 0; i < PERF_COUNTER_MAX; i++) {
+        __atomic_store_n(&s_counters[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+static void perf_counters_dump(void)
+{
+    for (int i = 0; i < PERF_COUNTER_MAX; i++) {
+        printf("%-16s %10lu\n", s_counter_names[i], (unsigned long)perf_monitor_get_counter(i));
+    }
+}
+
+#if CONFIG_PERF_MONITOR_ENABLE
+
+#define PERF_RING_SIZE      CONFIG_PERF_MONITOR_RING_SIZE
+#define PERF_HIST_BUCKETS   (sizeof(((perf_stage_stats_t *)0)->hist) / sizeof(uint32_t))
+
+// Last PERF_RING_SIZE durations of one stage, in us
+typedef struct {
+    uint32_t us[PERF_RING_SIZE];
+    uint32_t head;                      // Next slot to write
+    uint32_t total;                     // Samples since the last reset
+    uint32_t hist[PERF_HIST_BUCKETS];
+} perf_ring_t;
+
+static perf_ring_t s_rings[PERF_STAGE_MAX];
+
+static const char *const s_stage_names[PERF_STAGE_MAX] = {
+    [PERF_STAGE_RENDER]     = "render",
+    [PERF_STAGE_FLUSH]      = "flush",
+    [PERF_STAGE_COPY]       = "copy",
+    [PERF_STAGE_VSYNC_WAIT] = "vsync_wait",
+    [PERF_STAGE_UI_CMD]     = "ui_cmd",
+    [PERF_STAGE_IMG_DRAW]   = "img_draw",
+    [PERF_STAGE_DECODE]     = "decode",
+    [PERF_STAGE_SCALE]      = "scale",
+};
+
+void perf_monitor_record_us(perf_stage_t stage, uint32_t us)
+{
+    perf_ring_t *ring = &s_rings[stage];
+    ring->us[ring->head] = us;
+    ring->head = (ring->head + 1) % PERF_RING_SIZE;
+    ring->total++;
+
+    uint32_t bucket = us ? (31 - __builtin_clz(us)) : 0;
+    ring->hist[bucket < PERF_HIST_BUCKETS ? bucket : PERF_HIST_BUCKETS - 1]++;
+}
+
+// Lock of the sort buffer, created by the first caller whatever task it runs in
+static SemaphoreHandle_t perf_sort_lock(void)
+{
+    static StaticSemaphore_t lock_buf;
+    static SemaphoreHandle_t lock;
+    static uint32_t state;              // 0: not created, 1: being created, 2: ready
+    uint32_t expected = 0;
+    if (__atomic_compare_exchange_n(&state, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        lock = xSemaphoreCreateMutexStatic(&lock_buf);
+        __atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2) {
+        vTaskDelay(1);
+    }
+    return lock;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+esp_err_t perf_monitor_get(perf_stage_t stage, perf_stage_stats_t *stats)
+{
+    if (stage >= PERF_STAGE_MAX || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Work on a copy, the owner of the stage may keep recording meanwhile. The copy is too big for the stack of
+    // the console or logging tasks, so callers share it under a lock.
+    static uint32_t sorted[PERF_RING_SIZE];
+    const perf_ring_t *ring = &s_rings[stage];
+    uint32_t n = ring->total < PERF_RING_SIZE ? ring->total : PERF_RING_SIZE;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->samples = n;
+    stats->total = ring->total;
+    memcpy(stats->hist, ring->hist, sizeof(stats->hist));
+    if (n == 0) {
+        return ESP_OK;
+    }
+
+    SemaphoreHandle_t lock = perf_sort_lock();
+    xSemaphoreTake(lock, portMAX_DELAY);
+    memcpy(sorted, ring->us, n * sizeof(uint32_t));
+    qsort(sorted, n, sizeof(uint32_t), compare_u32);
+
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        sum += sorted[i];
+    }
+    stats->min_us = sorted[0];
+    stats->avg_us = (uint32_t)(sum / n);
+    stats->p95_us = sorted[(n * 95 - 1) / 100];
+    stats->max_us = sorted[n - 1];
+    xSemaphoreGive(lock);
+    return ESP_OK;
+}
+
+void perf_monitor_reset(void)
+{
+    memset(s_rings, 0, sizeof(s_rings));
+    perf_counters_reset();
+}
+
+void perf_monitor_dump(void)
+{
+    perf_stage_stats_t stats;
+
+    printf("%-12s %8s %8s %8s %8s %8s\n", "stage", "n", "min_us", "avg_us", "p95_us", "max_us");
+    for (int i = 0; i < PERF_STAGE_MAX; i++) {
+        perf_monitor_get(i, &stats);
+        printf("%-12s %8lu %8lu %8lu %8lu %8lu\n", s_stage_names[i], (unsigned long)stats.total,
+               (unsigned long)stats.min_us, (unsigned long)stats.avg_us,
+               (unsigned long)stats.p95_us, (unsigned long)stats.max_us);
+        if (stats.total == 0) {
+            continue;
+        }
+        printf("  hist:");
+        for (size_t b = 0; b < PERF_HIST_BUCKETS; b++) {
+            if (stats.hist[b]) {
+                printf(" <%luus:%lu", 2UL << b, (unsigned long)stats.hist[b]);
+            }
+        }
+        printf("\n");
+    }
+    perf_counters_dump();
+}
+
+#if CONFIG_PERF_MONITOR_DUMP_PERIOD_MS > 0
+static void perf_dump_timer_cb(void *arg)
+{
+    perf_monitor_dump();
+}
+#endif
+
+esp_err_t perf_monitor_init(void)
+{
+#if CONFIG_PERF_MONITOR_DUMP_PERIOD_MS > 0
+    const esp_timer_create_args_t args = {
+        .callback = perf_dump_timer_cb,
+        .name = "perf dump",
+    };
+    esp_timer_handle_t timer = NULL;
+    esp_err_t ret = esp_timer_create(&args, &timer);
+    if (ret == ESP_OK) {
+        ret = esp_timer_start_periodic(timer, (uint64_t)CONFIG_PERF_MONITOR_DUMP_PERIOD_MS * 1000);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start dump timer: %s", esp_err_to_name(ret));
+    }
+    return ret;
+#else
+    ESP_LOGI(TAG, "Performance monitor enabled, %d samples per stage", PERF_RING_SIZE);
+    return ESP_OK;
+#endif
+}
+
+#else
+
+esp_err_t perf_monitor_init(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t perf_monitor_get(perf_stage_t stage, perf_stage_stats_t *stats)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void perf_monitor_reset(void)
+{
+    perf_counters_reset();
+}
+
+void perf_monitor_dump(void)
+{
+    ESP_LOGW(TAG, "Stage timings are disabled (CONFIG_PERF_MONITOR_ENABLE)");
+    perf_counters_dump();
+}
+
+#endif /* CONFIG_PERF_MONITOR_ENABLE */
@@ -0,0 +1,124 @@
+#ifndef PERF_MONITOR_H
+#define PERF_MONITOR_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Stages whose durations are recorded
+ */
+typedef enum {
+    PERF_STAGE_RENDER,          // lv_timer_handler()
+    PERF_STAGE_FLUSH,           // LVGL flush callback, including the VSYNC wait
+    PERF_STAGE_COPY,            // Rotation / dirty area copy between frame buffers
+    PERF_STAGE_VSYNC_WAIT,      // Waiting for the RGB frame buffer to be transmitted
+    PERF_STAGE_UI_CMD,          // Latency of commands posted to the LVGL task, from posting to running
+    PERF_STAGE_IMG_DRAW,        // Drawing a decoded image (or a part of it) into the draw buffer
+    PERF_STAGE_DECODE,          // Decoding a photo into a frame slot of the photo plane
+    PERF_STAGE_SCALE,           // Shrinking a decoded photo to the screen
+    PERF_STAGE_MAX,
+} perf_stage_t;
+
+/**
+ * @brief Event counters, always available and safe to increment from an ISR
+ */
+typedef enum {
+    PERF_COUNTER_BOUNCE_FRAMES,     // Frames whose bounce buffers were completely refilled
+    PERF_COUNTER_BOUNCE_LATE,       // Frames whose last bounce refill finished after the active area ended
+    PERF_COUNTER_BOUNCE_UNDERRUN,   // VSYNCs without a completed bounce frame since the previous VSYNC
+    PERF_COUNTER_DRAW_SPLIT,        // Draw operations split between both cores
+    PERF_COUNTER_MAX,
+} perf_counter_t;
+
+/**
+ * @brief Statistics of one stage over the samples currently in its ring buffer
+ */
+typedef struct {
+    uint32_t samples;           // Number of samples in the ring buffer
+    uint32_t total;             // Number of samples recorded since the last reset
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t p95_us;
+    uint32_t max_us;
+    uint32_t hist[16];          // Samples since the last reset, bucket n counts durations in [2^n, 2^(n+1)) us
+} perf_stage_stats_t;
+
+#if CONFIG_PERF_MONITOR_ENABLE
+#include "esp_timer.h"
+
+/**
+ * @brief Time a stage: `PERF_STAGE_BEGIN(x); ...; PERF_STAGE_END(x, PERF_STAGE_...);`
+ *
+ * @note Costs two `esp_timer_get_time()` calls and a ring buffer store, and expands to nothing when
+ *       CONFIG_PERF_MONITOR_ENABLE is disabled. The time base doesn't depend on the CPU clock, so durations stay
+ *       right with dynamic frequency scaling. Each stage must be recorded from one task at a time.
+ */
+#define PERF_STAGE_BEGIN(name)          int64_t perf_start_##name = esp_timer_get_time()
+#define PERF_STAGE_END(name, stage)     perf_monitor_record_us((stage), (uint32_t)(esp_timer_get_time() - perf_start_##name))
+
+/**
+ * @brief Record a duration measured elsewhere, e.g. an interval that spans tasks
+ */
+#define PERF_STAGE_RECORD_US(stage, us) perf_monitor_record_us((stage), (us))
+
+void perf_monitor_record_us(perf_stage_t stage, uint32_t us);
+#else
+#define PERF_STAGE_BEGIN(name)
+#define PERF_STAGE_END(name, stage)
+#define PERF_STAGE_RECORD_US(stage, us)
+#endif
+
+/**
+ * @brief Add to an event counter, can be called from an ISR
+ */
+void perf_monitor_count(perf_counter_t counter, uint32_t n);
+
+/**
+ * @brief Get the value of an event counter
+ */
+uint32_t perf_monitor_get_counter(perf_counter_t counter);
+
+/**
+ * @brief Start the periodic console dump if CONFIG_PERF_MONITOR_DUMP_PERIOD_MS is set
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_NOT_SUPPORTED: The monitor is compiled out
+ */
+esp_err_t perf_monitor_init(void);
+
+/**
+ * @brief Get the statistics of one stage
+ *
+ * @param[in] stage: Stage to query
+ * @param[out] stats: Statistics
+ *
+ * @note Can be called from several tasks at once, the samples are sorted in a buffer shared under a lock
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NOT_SUPPORTED: The monitor is compiled out
+ */
+esp_err_t perf_monitor_get(perf_stage_t stage, perf_stage_stats_t *stats);
+
+/**
+ * @brief Clear all samples and counters
+ */
+void perf_monitor_reset(void);
+
+/**
+ * @brief Print the statistics of all stages to the console
+ */
+void perf_monitor_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERF_MONITOR_H
@@ -1,9 +1,336 @@
 #include "lvgl.h"
 #include "photo_display.h"
 
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "image_arena.h"
+#include "job_pool.h"
+#include "lvgl_port.h"
+#include "perf_monitor.h"
+
+static const char *TAG = "photo";
+
+#define DECODE_BAND_ROWS    (16)    // Rows decoded per hold of the LVGL lock
+#define SCALE_GRAIN_ROWS    (8)     // Smallest band of destination rows scaled on another core
+#define SHRINK_BAND_ROWS    (2 * SCALE_GRAIN_ROWS)  // Destination rows filtered at once while decoding a large photo
+
+static lv_obj_t *s_photo = NULL;
+static photo_display_frame_t s_frames[2] = { { .slot = -1 }, { .slot = -1 } };  // Shown photo and the next one
+static int s_shown = -1;                                                        // Index in s_frames, -1 if uncached
+
 void photo_display_show_image(const char *path)
 {
     lv_obj_t *img = lv_img_create(lv_scr_act());
     lv_img_set_src(img, path);  // 例: "S:/sample.jpg"
     lv_obj_center(img);
 }
+
+lv_obj_t *photo_display_get_obj(void)
+{
+    if (!s_photo) {
+        s_photo = lv_img_create(lv_scr_act());
+        lv_obj_align(s_photo, LV_ALIGN_CENTER, 0, 0);
+    }
+    return s_photo;
+}
+
+// Copy `count` pixels, dropping the alpha byte of LV_IMG_CF_TRUE_COLOR_ALPHA data (photos are opaque)
+static void copy_pixels(lv_color_t *dst, const uint8_t *src, uint32_t count, bool has_alpha)
+{
+    if (!has_alpha) {
+        memcpy(dst, src, count * sizeof(lv_color_t));
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(&dst[i], src, sizeof(lv_color_t));
+        src += LV_IMG_PX_SIZE_ALPHA_BYTE;
+    }
+}
+
+typedef struct {
+    lv_color_t *src;            // Source rows, from row `src_y`
+    uint32_t src_y;
+    uint32_t sw, sh;            // Source size
+    lv_color_t *dst;            // Destination picture, NULL to shrink `src` in place
+    uint32_t dw, dh;            // Destination size, not larger
+} scale_job_t;
+
+// Source pixels `first..last-1` averaged into destination pixel `i`, out of `n` source pixels for `d` destination ones.
+// When shrinking, the spans of consecutive pixels follow each other without overlapping.
+static inline void scale_span(uint32_t i, uint32_t n, uint32_t d, uint32_t *first, uint32_t *last)
+{
+    *first = i * n / d;
+    *last = ((i + 1) * n / d > *first) ? (i + 1) * n / d : *first + 1;
+}
+
+// Box filter of destination rows `begin..end-1`. Out of place, each average goes to its place in `dst`. In place, it is
+// written over the first pixel of its own source block, which no other pixel reads, and scale_pack() then moves the
+// results to their place. Either way bands can run on any core in any order.
+static void scale_rows(uint32_t begin, uint32_t end, void *arg)
+{
+    const scale_job_t *job = (const scale_job_t *)arg;
+    for (uint32_t y = begin; y < end; y++) {
+        uint32_t y0, y1;
+        scale_span(y, job->sh, job->dh, &y0, &y1);
+        for (uint32_t x = 0; x < job->dw; x++) {
+            uint32_t x0, x1;
+            scale_span(x, job->sw, job->dw, &x0, &x1);
+            uint32_t r = 0, g = 0, b = 0;
+            for (uint32_t sy = y0; sy < y1; sy++) {
+                const lv_color_t *row = job->src + (sy - job->src_y) * job->sw;
+                for (uint32_t sx = x0; sx < x1; sx++) {
+                    const uint32_t c = lv_color_to32(row[sx]);
+                    r += (c >> 16) & 0xFF;
+                    g += (c >> 8) & 0xFF;
+                    b += c & 0xFF;
+                }
+            }
+            const uint32_t n = (y1 - y0) * (x1 - x0);
+            const lv_color_t c = lv_color_make(r / n, g / n, b / n);
+            if (job->dst) {
+                job->dst[y * job->dw + x] = c;
+            } else {
+                job->src[(y0 - job->src_y) * job->sw + x0] = c;
+            }
+        }
+    }
+}
+
+// Gather the averages of an in place shrink into a dw x dh picture. In row-major order a pixel never lands after its
+// source, nor on the source of a pixel still to be moved.
+static void scale_pack(const scale_job_t *job)
+{
+    lv_color_t *dst = job->src;
+    for (uint32_t y = 0; y < job->dh; y++) {
+        uint32_t y0, y1;
+        scale_span(y, job->sh, job->dh, &y0, &y1);
+        const lv_color_t *row = job->src + y0 * job->sw;
+        for (uint32_t x = 0; x < job->dw; x++) {
+            uint32_t x0, x1;
+            scale_span(x, job->sw, job->dw, &x0, &x1);
+            *dst++ = row[x0];
+        }
+    }
+}
+
+// Largest size with the aspect ratio of `w` x `h` and at most `max_px` pixels
+static void fit_pixels(uint32_t w, uint32_t h, uint32_t max_px, uint32_t *dw, uint32_t *dh)
+{
+    uint32_t lo = 1, hi = h;
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi + 1) / 2;
+        const uint32_t mw = (uint32_t)((uint64_t)w * mid / h);
+        if ((uint64_t)(mw ? mw : 1) * mid <= max_px) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    *dh = lo;
+    *dw = (w * lo / h) ? w * lo / h : 1;
+}
+
+esp_err_t photo_display_decode(const void *src, photo_display_frame_t *frame)
+{
+    frame->slot = -1;
+    image_arena_usage_t usage;
+    image_arena_get_usage(&usage);
+    if (usage.slots == 0) {
+        return ESP_ERR_INVALID_STATE;   // No arena, or no slot configured
+    }
+    lv_color_t *pixels = image_arena_slot_acquire(&frame->slot);
+    if (!pixels) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // The decoders and lv_mem are not thread safe: hold the LVGL lock, released between bands of rows
+    lvgl_port_lock(-1);
+    PERF_STAGE_BEGIN(decode);
+    lv_img_decoder_dsc_t dec;
+    if (lv_img_decoder_open(&dec, src, lv_color_black(), 0) != LV_RES_OK) {
+        lvgl_port_unlock();
+        image_arena_slot_release(frame->slot);
+        frame->slot = -1;
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ESP_OK;
+    const uint32_t w = dec.header.w;
+    const uint32_t h = dec.header.h;
+    // Same pixel format rule as lv_draw_img() for decoded data
+    const bool has_alpha = lv_img_cf_has_alpha(dec.header.cf);
+    const size_t px_size = has_alpha ? LV_IMG_PX_SIZE_ALPHA_BYTE : sizeof(lv_color_t);
+    uint8_t *line = NULL;
+    lv_color_t *band = NULL;
+
+    // A photo larger than a slot is shrunk to fit while it is decoded: the source rows of SHRINK_BAND_ROWS destination
+    // rows are gathered in a band buffer, then filtered on both cores straight into the slot
+    scale_job_t job = { .src = pixels, .sw = w, .sh = h, .dw = w, .dh = h };
+    const bool shrink = (size_t)w * h * sizeof(lv_color_t) > usage.slot_size;
+    if (shrink) {
+        fit_pixels(w, h, usage.slot_size / sizeof(lv_color_t), &job.dw, &job.dh);
+        const size_t band_rows = (SHRINK_BAND_ROWS * h + job.dh - 1) / job.dh + 1;
+        band = heap_caps_malloc(band_rows * w * sizeof(lv_color_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!band) {
+            ret = ESP_ERR_NO_MEM;
+            goto out;
+        }
+        job.src = band;
+        job.dst = pixels;
+    }
+    if (!dec.img_data) {
+        // Line based decoders (e.g. JPEG): read the picture once, row by row
+        line = lv_mem_alloc(w * px_size);
+        if (!line) {
+            ret = ESP_ERR_NO_MEM;
+            goto out;
+        }
+    }
+
+    uint32_t dy = 0;            // First destination row of the band being gathered
+    for (uint32_t y = 0; y < h; y++) {
+        if (y > 0 && y % DECODE_BAND_ROWS == 0) {
+            lvgl_port_unlock();     // Let the LVGL task render, a no-op when called from it
+            lvgl_port_lock(-1);
+        }
+        const uint8_t *row = dec.img_data ? dec.img_data + (size_t)y * w * px_size : line;
+        if (!dec.img_data && lv_img_decoder_read_line(&dec, 0, y, w, line) != LV_RES_OK) {
+            ret = ESP_FAIL;
+            break;
+        }
+        copy_pixels(job.src + (y - job.src_y) * w, row, w, has_alpha);
+        if (!shrink) {
+            continue;
+        }
+
+        // The band is complete with the last source row of its last destination row
+        const uint32_t dy_end = (dy + SHRINK_BAND_ROWS < job.dh) ? dy + SHRINK_BAND_ROWS : job.dh;
+        uint32_t first, last;
+        scale_span(dy_end - 1, h, job.dh, &first, &last);
+        if (y + 1 == last) {
+            lvgl_port_unlock();
+            job_pool_parallel_for(dy, dy_end, SCALE_GRAIN_ROWS, scale_rows, &job);
+            lvgl_port_lock(-1);
+            dy = dy_end;
+            job.src_y = y + 1;      // Spans don't overlap when shrinking, the next band starts on the next row
+        }
+    }
+    if (ret != ESP_OK) {
+        goto out;
+    }
+
+    memset(&frame->dsc, 0, sizeof(frame->dsc));
+    frame->dsc.header.cf = LV_IMG_CF_TRUE_COLOR;
+    frame->dsc.header.w = job.dw;
+    frame->dsc.header.h = job.dh;
+    frame->dsc.data = (const uint8_t *)pixels;
+    frame->dsc.data_size = job.dw * job.dh * sizeof(lv_color_t);
+
+out:
+    lv_mem_free(line);
+    heap_caps_free(band);
+    lv_img_decoder_close(&dec);
+    PERF_STAGE_END(decode, PERF_STAGE_DECODE);
+    lvgl_port_unlock();
+    if (ret != ESP_OK) {
+        photo_display_frame_release(frame);
+    }
+    return ret;
+}
+
+esp_err_t photo_display_scale(photo_display_frame_t *frame, lv_coord_t max_w, lv_coord_t max_h)
+{
+    if (!frame || frame->slot < 0 || max_w <= 0 || max_h <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint32_t sw = frame->dsc.header.w;
+    const uint32_t sh = frame->dsc.header.h;
+    if (sw <= (uint32_t)max_w && sh <= (uint32_t)max_h) {
+        return ESP_OK;
+    }
+
+    // Fit inside max_w x max_h, keeping the aspect ratio
+    uint32_t dw = max_w;
+    uint32_t dh = sh * max_w / sw;
+    if (dh > (uint32_t)max_h) {
+        dh = max_h;
+        dw = sw * max_h / sh;
+    }
+    dw = dw ? dw : 1;
+    dh = dh ? dh : 1;
+
+    // Box filter on both cores, in place
+    const scale_job_t job = {
+        .src = (lv_color_t *)frame->dsc.data,
+        .sw = sw,
+        .sh = sh,
+        .dw = dw,
+        .dh = dh,
+    };
+    PERF_STAGE_BEGIN(scale);
+    job_pool_parallel_for(0, dh, SCALE_GRAIN_ROWS, scale_rows, (void *)&job);
+    scale_pack(&job);
+    PERF_STAGE_END(scale, PERF_STAGE_SCALE);
+
+    frame->dsc.header.w = dw;
+    frame->dsc.header.h = dh;
+    frame->dsc.data_size = dw * dh * sizeof(lv_color_t);
+    return ESP_OK;
+}
+
+void photo_display_frame_release(photo_display_frame_t *frame)
+{
+    if (frame && frame->slot >= 0) {
+        image_arena_slot_release(frame->slot);
+        frame->slot = -1;
+    }
+}
+
+bool photo_display_is_plain(const void *src)
+{
+    if (lv_img_src_get_type(src) != LV_IMG_SRC_VARIABLE) {
+        return false;
+    }
+    const lv_img_dsc_t *dsc = src;
+    return dsc->header.cf == LV_IMG_CF_TRUE_COLOR &&
+           dsc->data_size >= (uint32_t)dsc->header.w * dsc->header.h * sizeof(lv_color_t);
+}
+
+void photo_display_present(photo_display_frame_t *frame, const void *src)
+{
+    lv_obj_t *img = photo_display_get_obj();
+    const int next = (s_shown == 0) ? 1 : 0;
+    const bool cached = frame && frame->slot >= 0;
+
+    if (cached) {
+        // LVGL keeps the descriptor pointer, the photo plane keeps the descriptor
+        s_frames[next] = *frame;
+        frame->slot = -1;
+        lv_img_set_src(img, &s_frames[next].dsc);
+    } else {
+        lv_img_set_src(img, src);
+    }
+
+    // The previous photo is no longer referenced, its pixels are already in the frame buffers
+    if (s_shown >= 0) {
+        lv_img_cache_invalidate_src(&s_frames[s_shown].dsc);
+        photo_display_frame_release(&s_frames[s_shown]);
+    }
+    s_shown = cached ? next : -1;
+}
+
+esp_err_t photo_display_show(const void *src)
+{
+    photo_display_frame_t frame = { .slot = -1 };
+    esp_err_t ret = ESP_OK;
+
+    if (!photo_display_is_plain(src)) {
+        ret = photo_display_decode(src, &frame);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Photo not cached (%s), decoded on every redraw", esp_err_to_name(ret));
+        }
+    }
+    photo_display_present(&frame, src);     // Plain frames are shown in place, no slot needed
+    return ret;
+}
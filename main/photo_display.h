@@ -1,10 +1,33 @@
 #ifndef PHOTO_DISPLAY_H
 #define PHOTO_DISPLAY_H
 
+#include "esp_err.h"
+#include "lvgl.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Photo plane: the photo is decoded once into an RGB565 frame slot of the image arena and shown as an opaque
+ * TRUE_COLOR image. Overlays (captions, status widgets, ...) belong on `lv_layer_top()`: when one of them changes,
+ * LVGL only redraws its area, and the photo below is a plain copy of that rectangle (see the image fast path of
+ * lvgl_port.c) instead of a new decode of the whole file.
+ *
+ * The steps of `photo_display_show()` are also available on their own, so that a photo can be decoded and scaled by
+ * another task while the current one is on screen: `photo_display_decode()`, `photo_display_scale()`, then
+ * `photo_display_present()` in the LVGL task. Photos larger than a slot are shrunk while they are decoded, with the
+ * same box filter as `photo_display_scale()` on all cores.
+ */
+
+/**
+ * @brief A decoded photo in a frame slot of the image arena
+ */
+typedef struct {
+    int slot;                   // Slot holding the pixels, -1 if none
+    lv_img_dsc_t dsc;           // LV_IMG_CF_TRUE_COLOR, valid while `slot` >= 0
+} photo_display_frame_t;
+
 /**
  * @brief Show a JPEG image using LVGL from the given file path.
  * 
@@ -12,6 +35,71 @@ extern "C" {
  */
 void photo_display_show_image(const char *path);
 
+/**
+ * @brief Show a photo on the photo plane, must be called from the LVGL task or with the LVGL mutex held
+ *
+ * @note The photo is decoded right away, shrunk to fit into a frame slot if needed. If it cannot be decoded, `src`
+ *       is shown as is and LVGL decodes it whenever it has to be redrawn. A LV_IMG_CF_TRUE_COLOR `lv_img_dsc_t` is
+ *       already decoded and is shown in place, it must stay valid while shown.
+ *
+ * @param[in] src: Image source (file path or `lv_img_dsc_t`), only used during the call when the photo is cached
+ *
+ * @return
+ *      - ESP_OK: The photo is shown from a frame slot, or in place
+ *      - Others: The photo is shown uncached
+ */
+esp_err_t photo_display_show(const void *src);
+
+/**
+ * @brief Decode a photo into a frame slot, from any task. The LVGL lock is taken for every band of rows, so the LVGL
+ *        task keeps rendering in between. A photo larger than a slot is shrunk to the largest size that fits, keeping
+ *        its aspect ratio: bands of rows are decoded into a PSRAM buffer and box filtered into the slot on all cores.
+ *
+ * @param[in] src: Image source (file path or `lv_img_dsc_t`)
+ * @param[out] frame: The decoded photo, its slot is -1 on failure
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_NOT_FOUND: No free frame slot, they are freed as photos are replaced
+ *      - ESP_ERR_INVALID_STATE: The image arena has no frame slot (not initialized)
+ *      - ESP_ERR_NO_MEM: No memory for the decoder or the band buffer
+ *      - ESP_FAIL: The photo can't be decoded
+ */
+esp_err_t photo_display_decode(const void *src, photo_display_frame_t *frame);
+
+/**
+ * @brief Shrink a decoded photo in place to fit into `max_w` x `max_h`, keeping its aspect ratio. Smaller photos are
+ *        left as they are. Needs no lock.
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if the frame holds no slot
+ */
+esp_err_t photo_display_scale(photo_display_frame_t *frame, lv_coord_t max_w, lv_coord_t max_h);
+
+/**
+ * @brief Show a decoded photo, must be called from the LVGL task or with the LVGL mutex held. The photo plane takes
+ *        over the slot of `frame` and releases it when the next photo is presented.
+ *
+ * @param frame: Decoded photo, or NULL or without slot to show `src` as is
+ * @param[in] src: Shown when `frame` holds no slot, must then stay valid while shown
+ */
+void photo_display_present(photo_display_frame_t *frame, const void *src);
+
+/**
+ * @brief Release the slot of a frame that will not be presented
+ */
+void photo_display_frame_release(photo_display_frame_t *frame);
+
+/**
+ * @brief Whether `src` is a LV_IMG_CF_TRUE_COLOR `lv_img_dsc_t` already in memory (e.g. memory-mapped flash),
+ *        shown in place without decoding
+ */
+bool photo_display_is_plain(const void *src);
+
+/**
+ * @brief Get the image object of the photo plane, created on the active screen on first use
+ */
+lv_obj_t *photo_display_get_obj(void);
+
 #ifdef __cplusplus
 }
 #endif
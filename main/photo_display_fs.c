@@ -1,85 +1,410 @@
 #include "photo_display_fs.h"
-#include "ff.h"        // FatFS API
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "lvgl.h"
+#include "sd_io.h"
+#include "storage_manager.h"
 
 static const char *TAG = "photo_fs";
 
-// ファイル構造体
+#define FS_LETTER           'S'         // "S:/sample.jpg"
+#define FS_ROOT             "/sdcard"
+#define BLOCK_SIZE          (CONFIG_PHOTO_FS_BLOCK_KB * 1024)
+#define CACHE_BLOCKS        CONFIG_PHOTO_FS_CACHE_BLOCKS
+#define READ_AHEAD_BLOCKS   CONFIG_PHOTO_FS_READ_AHEAD_BLOCKS
+#define MAX_FILES           CONFIG_PHOTO_FS_MAX_FILES
+#define NO_BLOCK            UINT16_MAX
+#define NO_INDEX            UINT32_MAX
+
+_Static_assert(CACHE_BLOCKS > READ_AHEAD_BLOCKS, "The cache must hold the read-ahead and the block being read");
+
+typedef enum {
+    BLOCK_FREE = 0,
+    BLOCK_LOADING,              // Read-ahead in flight, completed by the SD I/O task
+    BLOCK_VALID,
+} block_state_t;
+
+// Everything but `state` and `len` is only touched with the LVGL lock held
+typedef struct {
+    uint32_t key;               // Hash of the path and size of the file, the path in `s_cache.paths` is compared too
+    uint32_t index;             // Block number in the file
+    uint32_t generation;        // `s_cache.generation` when loaded, older blocks are dropped
+    uint32_t len;               // Valid bytes, short for the last block of a file
+    block_state_t state;        // Published with release semantics after `len`
+    uint32_t in_flight;         // Read-ahead requests writing the block, it can't be reused meanwhile
+    bool prefetched;            // Loaded by read-ahead and not used yet
+    uint16_t prev, next;        // LRU list, most recent first
+} cache_block_t;
+
+// Pooled file object, no allocation per open
 typedef struct {
-    FIL fil;
+    bool used;
+    char path[SD_IO_PATH_MAX];
+    uint32_t key;
+    uint32_t size;
+    uint32_t pos;
+    uint32_t last_index;        // Block of the last access, to detect sequential reads
+    uint16_t block;             // Block of the last access, tried before the cache lookup
 } fs_file_t;
 
-static void *fs_open_cb(lv_fs_drv_t *drv, const char *path, lv_fs_mode_t mode)
+static struct {
+    uint8_t *data;              // CACHE_BLOCKS * BLOCK_SIZE in PSRAM
+    char (*paths)[SD_IO_PATH_MAX];  // File of each block, in PSRAM after the data
+    cache_block_t blocks[CACHE_BLOCKS];
+    uint16_t head, tail;        // LRU list
+    uint32_t generation;
+    fs_file_t files[MAX_FILES];
+    photo_display_fs_stats_t stats;
+} s_cache;
+
+static uint8_t *block_data(uint16_t b)
+{
+    return s_cache.data + (size_t)b * BLOCK_SIZE;
+}
+
+static block_state_t block_state(const cache_block_t *blk)
+{
+    return __atomic_load_n(&blk->state, __ATOMIC_ACQUIRE);
+}
+
+static void lru_unlink(uint16_t b)
+{
+    cache_block_t *blk = &s_cache.blocks[b];
+    if (blk->prev != NO_BLOCK) {
+        s_cache.blocks[blk->prev].next = blk->next;
+    } else {
+        s_cache.head = blk->next;
+    }
+    if (blk->next != NO_BLOCK) {
+        s_cache.blocks[blk->next].prev = blk->prev;
+    } else {
+        s_cache.tail = blk->prev;
+    }
+}
+
+static void lru_touch(uint16_t b)
+{
+    if (s_cache.head == b) {
+        return;
+    }
+    lru_unlink(b);
+    cache_block_t *blk = &s_cache.blocks[b];
+    blk->prev = NO_BLOCK;
+    blk->next = s_cache.head;
+    s_cache.blocks[s_cache.head].prev = b;
+    s_cache.head = b;
+}
+
+// The key sorts blocks out quickly, the path makes sure two files with the same key never share blocks. Files of
+// the same path with the same key have the same size.
+static bool block_matches(uint16_t b, const fs_file_t *file, uint32_t index)
+{
+    const cache_block_t *blk = &s_cache.blocks[b];
+    return blk->key == file->key && blk->index == index && blk->generation == s_cache.generation &&
+           block_state(blk) != BLOCK_FREE && strcmp(s_cache.paths[b], file->path) == 0;
+}
+
+static uint16_t cache_find(const fs_file_t *file, uint32_t index)
+{
+    // Few blocks, a scan is cheaper than maintaining a hash table
+    for (uint16_t b = 0; b < CACHE_BLOCKS; b++) {
+        if (block_matches(b, file, index)) {
+            return b;
+        }
+    }
+    return NO_BLOCK;
+}
+
+// Take the least recently used block that is not being loaded
+static uint16_t cache_alloc(const fs_file_t *file, uint32_t index)
+{
+    for (uint16_t b = s_cache.tail; b != NO_BLOCK; b = s_cache.blocks[b].prev) {
+        cache_block_t *blk = &s_cache.blocks[b];
+        const block_state_t state = block_state(blk);
+        if (state == BLOCK_LOADING || __atomic_load_n(&blk->in_flight, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        if (state == BLOCK_VALID && blk->generation == s_cache.generation) {
+            s_cache.stats.evictions++;
+        }
+        blk->key = file->key;
+        memcpy(s_cache.paths[b], file->path, sizeof(s_cache.paths[b]));
+        blk->index = index;
+        blk->generation = s_cache.generation;
+        blk->len = 0;
+        blk->prefetched = false;
+        __atomic_store_n(&blk->state, BLOCK_LOADING, __ATOMIC_RELEASE);
+        lru_touch(b);
+        return b;
+    }
+    return NO_BLOCK;
+}
+
+static void block_loaded(cache_block_t *blk, esp_err_t status, size_t len)
+{
+    blk->len = (uint32_t)len;
+    __atomic_store_n(&blk->state, (status == ESP_OK && len) ? BLOCK_VALID : BLOCK_FREE, __ATOMIC_RELEASE);
+}
+
+// Runs in the SD I/O task
+static void read_ahead_done(sd_io_id_t id, esp_err_t status, size_t len, void *user_data)
+{
+    cache_block_t *blk = user_data;
+    block_loaded(blk, status, len);
+    __atomic_fetch_sub(&blk->in_flight, 1, __ATOMIC_RELEASE);
+}
+
+static uint32_t block_bytes(const fs_file_t *file, uint32_t index)
+{
+    const uint32_t offset = index * BLOCK_SIZE;
+    return file->size - offset < BLOCK_SIZE ? file->size - offset : BLOCK_SIZE;
+}
+
+static void read_ahead(fs_file_t *file, uint32_t index)
+{
+    const uint32_t blocks = (file->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for (uint32_t i = index + 1; i <= index + READ_AHEAD_BLOCKS && i < blocks; i++) {
+        if (cache_find(file, i) != NO_BLOCK) {
+            continue;
+        }
+        const uint16_t b = cache_alloc(file, i);
+        if (b == NO_BLOCK) {
+            return;
+        }
+        cache_block_t *blk = &s_cache.blocks[b];
+        const sd_io_req_t req = {
+            .path = file->path,
+            .offset = i * BLOCK_SIZE,
+            .buf = block_data(b),
+            .size = block_bytes(file, i),
+            .prio = SD_IO_PRIO_PREFETCH,
+            .done = read_ahead_done,
+            .user_data = blk,
+        };
+        __atomic_fetch_add(&blk->in_flight, 1, __ATOMIC_RELAXED);
+        if (sd_io_submit(&req, NULL) != ESP_OK) {
+            __atomic_fetch_sub(&blk->in_flight, 1, __ATOMIC_RELAXED);
+            block_loaded(blk, ESP_FAIL, 0);
+            return;
+        }
+        blk->prefetched = true;
+        s_cache.stats.read_ahead++;
+    }
+}
+
+// Get a valid block of the file, reading it from the card if needed
+static cache_block_t *block_get(fs_file_t *file, uint32_t index)
 {
-    fs_file_t *file = malloc(sizeof(fs_file_t));
-    if (!file) return NULL;
+    uint16_t b = (file->block != NO_BLOCK && block_matches(file->block, file, index)) ?
+                 file->block : cache_find(file, index);
+    const bool sequential = (index == file->last_index + 1);
+    file->last_index = index;
+
+    if (b != NO_BLOCK && block_state(&s_cache.blocks[b]) == BLOCK_VALID) {
+        cache_block_t *blk = &s_cache.blocks[b];
+        s_cache.stats.hits++;
+        if (blk->prefetched) {
+            blk->prefetched = false;
+            s_cache.stats.read_ahead_hits++;
+        }
+        lru_touch(b);
+        file->block = b;
+        if (sequential) {
+            read_ahead(file, index);    // Keep the read-ahead window ahead of the decoder
+        }
+        return blk;
+    }
 
-    char full_path[128];
-    snprintf(full_path, sizeof(full_path), "/sdcard/%s", path);  // "sample.jpg" → "/sdcard/sample.jpg"
+    if (b != NO_BLOCK) {
+        // Read-ahead in flight: the same read at current priority is merged into it by the I/O task
+        s_cache.stats.read_ahead_waits++;
+        s_cache.blocks[b].prefetched = false;
+    } else {
+        s_cache.stats.misses++;
+        b = cache_alloc(file, index);
+        if (b == NO_BLOCK) {
+            return NULL;
+        }
+    }
 
-    BYTE fatfs_mode = 0;
-    if (mode == LV_FS_MODE_WR) fatfs_mode = FA_WRITE | FA_OPEN_ALWAYS;
-    else if (mode == LV_FS_MODE_RD) fatfs_mode = FA_READ;
-    else fatfs_mode = FA_READ | FA_WRITE;
+    cache_block_t *blk = &s_cache.blocks[b];
+    size_t len = 0;
+    esp_err_t ret = sd_io_read(file->path, index * BLOCK_SIZE, block_data(b), block_bytes(file, index),
+                               SD_IO_PRIO_CURRENT, &len);
+    block_loaded(blk, ret, len);
+    if (ret != ESP_OK || len == 0) {
+        ESP_LOGE(TAG, "Read of block %lu failed (%s): %s", (unsigned long)index, esp_err_to_name(ret), file->path);
+        return NULL;
+    }
+    file->block = b;
+    if (sequential) {
+        read_ahead(file, index);
+    }
+    return blk;
+}
 
-    FRESULT res = f_open(&file->fil, full_path, fatfs_mode);
-    if (res != FR_OK) {
-        ESP_LOGE(TAG, "f_open failed: %d", res);
-        free(file);
+static uint32_t file_key(const char *path, uint32_t size)
+{
+    uint32_t hash = 2166136261u;    // FNV-1a
+    for (const char *p = path; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    return hash ^ (size * 2654435761u);
+}
+
+static void *fs_open_cb(lv_fs_drv_t *drv, const char *path, lv_fs_mode_t mode)
+{
+    if (mode != LV_FS_MODE_RD) {
+        ESP_LOGE(TAG, "Read only: %s", path);
+        return NULL;
+    }
+
+    fs_file_t *file = NULL;
+    for (int i = 0; i < MAX_FILES && !file; i++) {
+        file = s_cache.files[i].used ? NULL : &s_cache.files[i];
+    }
+    if (!file) {
+        ESP_LOGE(TAG, "All %d files are open", MAX_FILES);
+        return NULL;
+    }
+
+    // "S:/slides/a.jpg" and "S:slides/a.jpg" -> "/sdcard/slides/a.jpg"
+    int n = snprintf(file->path, sizeof(file->path), "%s%s%s", FS_ROOT, path[0] == '/' ? "" : "/", path);
+    if (n < 0 || (size_t)n >= sizeof(file->path)) {
+        ESP_LOGE(TAG, "Path too long: %s", path);
+        return NULL;
+    }
+    if (sd_io_file_size(file->path, SD_IO_PRIO_CURRENT, &file->size) != ESP_OK) {
+        ESP_LOGE(TAG, "Open failed: %s", file->path);
         return NULL;
     }
 
+    file->used = true;
+    file->key = file_key(file->path, file->size);
+    file->pos = 0;
+    file->last_index = NO_INDEX;
+    file->block = NO_BLOCK;
+    s_cache.stats.opens++;
     return file;
 }
 
 static lv_fs_res_t fs_read_cb(lv_fs_drv_t *drv, void *file_p, void *buf, uint32_t btr, uint32_t *br)
 {
-    fs_file_t *file = (fs_file_t *)file_p;
-    UINT bytes_read;
-    FRESULT res = f_read(&file->fil, buf, btr, &bytes_read);
-    *br = bytes_read;
-    return (res == FR_OK) ? LV_FS_RES_OK : LV_FS_RES_UNKNOWN;
+    fs_file_t *file = file_p;
+    uint8_t *dst = buf;
+    uint32_t done = 0;
+    lv_fs_res_t res = LV_FS_RES_OK;
+
+    while (done < btr && file->pos < file->size) {
+        const cache_block_t *blk = block_get(file, file->pos / BLOCK_SIZE);
+        if (!blk) {
+            res = LV_FS_RES_HW_ERR;
+            break;
+        }
+        const uint32_t offset = file->pos % BLOCK_SIZE;
+        if (offset >= blk->len) {
+            break;      // The file shrank since it was opened
+        }
+        const uint32_t avail = blk->len - offset;
+        const uint32_t n = btr - done < avail ? btr - done : avail;
+        memcpy(dst + done, block_data(blk - s_cache.blocks) + offset, n);
+        done += n;
+        file->pos += n;
+    }
+    *br = done;
+    return res;
 }
 
 static lv_fs_res_t fs_seek_cb(lv_fs_drv_t *drv, void *file_p, uint32_t pos, lv_fs_whence_t whence)
 {
-    fs_file_t *file = (fs_file_t *)file_p;
-    FSIZE_t new_pos = 0;
+    fs_file_t *file = file_p;
+
+    // Only the position moves, the blocks stay cached
     switch (whence) {
-        case LV_FS_SEEK_SET: new_pos = pos; break;
-        case LV_FS_SEEK_CUR: new_pos = f_tell(&file->fil) + pos; break;
-        case LV_FS_SEEK_END: new_pos = f_size(&file->fil) + pos; break;
-        default: return LV_FS_RES_INV_PARAM;
+    case LV_FS_SEEK_SET: file->pos = pos; break;
+    case LV_FS_SEEK_CUR: file->pos += pos; break;
+    case LV_FS_SEEK_END: file->pos = file->size + pos; break;
+    default: return LV_FS_RES_INV_PARAM;
     }
-    FRESULT res = f_lseek(&file->fil, new_pos);
-    return (res == FR_OK) ? LV_FS_RES_OK : LV_FS_RES_UNKNOWN;
+    return LV_FS_RES_OK;
 }
 
 static lv_fs_res_t fs_tell_cb(lv_fs_drv_t *drv, void *file_p, uint32_t *pos)
 {
-    fs_file_t *file = (fs_file_t *)file_p;
-    *pos = f_tell(&file->fil);
+    *pos = ((fs_file_t *)file_p)->pos;
     return LV_FS_RES_OK;
 }
 
 static lv_fs_res_t fs_close_cb(lv_fs_drv_t *drv, void *file_p)
 {
-    fs_file_t *file = (fs_file_t *)file_p;
-    f_close(&file->fil);
-    free(file);
+    // Read-ahead still in flight completes into the cache for the next open
+    ((fs_file_t *)file_p)->used = false;
     return LV_FS_RES_OK;
 }
 
-void photo_display_fs_init(void)
+esp_err_t photo_display_fs_init(void)
 {
     static lv_fs_drv_t drv;
+
+    if (s_cache.data) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_cache.data = heap_caps_aligned_alloc(STORAGE_DMA_ALIGN, (size_t)CACHE_BLOCKS * (BLOCK_SIZE + SD_IO_PATH_MAX),
+                                           MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_cache.data) {
+        ESP_LOGE(TAG, "No memory for %d x %d KB blocks", CACHE_BLOCKS, CONFIG_PHOTO_FS_BLOCK_KB);
+        return ESP_ERR_NO_MEM;
+    }
+    s_cache.paths = (char (*)[SD_IO_PATH_MAX])(s_cache.data + (size_t)CACHE_BLOCKS * BLOCK_SIZE);
+    for (uint16_t b = 0; b < CACHE_BLOCKS; b++) {
+        s_cache.blocks[b].prev = b ? b - 1 : NO_BLOCK;
+        s_cache.blocks[b].next = (b + 1 < CACHE_BLOCKS) ? b + 1 : NO_BLOCK;
+    }
+    s_cache.head = 0;
+    s_cache.tail = CACHE_BLOCKS - 1;
+
     lv_fs_drv_init(&drv);
-    drv.letter = 'S';  // "S:/sample.jpg" という形式で使えるように
+    drv.letter = FS_LETTER;
+    drv.cache_size = 0;         // The block cache replaces the per file cache of LVGL
     drv.open_cb = fs_open_cb;
     drv.read_cb = fs_read_cb;
     drv.seek_cb = fs_seek_cb;
     drv.tell_cb = fs_tell_cb;
     drv.close_cb = fs_close_cb;
     lv_fs_drv_register(&drv);
+
+    ESP_LOGI(TAG, "%c: cache %d x %d KB, read-ahead %d blocks", FS_LETTER, CACHE_BLOCKS, CONFIG_PHOTO_FS_BLOCK_KB,
+             READ_AHEAD_BLOCKS);
+    return ESP_OK;
+}
+
+void photo_display_fs_invalidate(void)
+{
+    s_cache.generation++;
+    for (int i = 0; i < MAX_FILES; i++) {
+        s_cache.files[i].block = NO_BLOCK;
+    }
+}
+
+void photo_display_fs_get_stats(photo_display_fs_stats_t *stats, bool reset)
+{
+    *stats = s_cache.stats;
+    if (reset) {
+        memset(&s_cache.stats, 0, sizeof(s_cache.stats));
+    }
+}
+
+void photo_display_fs_log_stats(void)
+{
+    const photo_display_fs_stats_t *s = &s_cache.stats;
+    const uint32_t total = s->hits + s->misses + s->read_ahead_waits;
+
+    ESP_LOGI(TAG, "opens %lu, hits %lu (%lu%%), misses %lu, read-ahead %lu (hits %lu, waits %lu), evictions %lu",
+             (unsigned long)s->opens, (unsigned long)s->hits, (unsigned long)(total ? s->hits * 100ULL / total : 0),
+             (unsigned long)s->misses, (unsigned long)s->read_ahead, (unsigned long)s->read_ahead_hits,
+             (unsigned long)s->read_ahead_waits, (unsigned long)s->evictions);
 }
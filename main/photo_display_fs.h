@@ -1,11 +1,60 @@
 #ifndef PHOTO_DISPLAY_FS_H
 #define PHOTO_DISPLAY_FS_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void photo_display_fs_init(void);
+/**
+ * LVGL file system driver for the SD card ("S:/slides/IMG0001.JPG" is "/sdcard/slides/IMG0001.JPG").
+ * Reads go through the SD I/O task in blocks of CONFIG_PHOTO_FS_BLOCK_KB, kept in a shared LRU cache in PSRAM:
+ * the many small reads and seeks of the PNG/SJPG decoders are served from memory, and sequential access reads
+ * the next CONFIG_PHOTO_FS_READ_AHEAD_BLOCKS blocks ahead at prefetch priority. Read only.
+ */
+
+/**
+ * @brief Cache statistics
+ */
+typedef struct {
+    uint32_t opens;
+    uint32_t hits;              // Block accesses served from the cache
+    uint32_t misses;            // Block accesses that waited for a card read
+    uint32_t read_ahead;        // Blocks requested ahead of the decoder
+    uint32_t read_ahead_hits;   // Read-ahead blocks used later on
+    uint32_t read_ahead_waits;  // Accesses that caught up with a read-ahead still in flight
+    uint32_t evictions;
+} photo_display_fs_stats_t;
+
+/**
+ * @brief Reserve the block cache and register the "S:" driver, call after `lv_init()` with the LVGL lock held
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: Already registered
+ *      - ESP_ERR_NO_MEM: Not enough PSRAM for the cache
+ */
+esp_err_t photo_display_fs_init(void);
+
+/**
+ * @brief Drop all cached blocks, e.g. after files changed on the card. Call with the LVGL lock held.
+ */
+void photo_display_fs_invalidate(void);
+
+/**
+ * @brief Get the cache statistics
+ *
+ * @param reset Clear them after reading
+ */
+void photo_display_fs_get_stats(photo_display_fs_stats_t *stats, bool reset);
+
+/**
+ * @brief Print the cache statistics with ESP_LOGI
+ */
+void photo_display_fs_log_stats(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,348 @@
+#include "pipeline.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "pipeline";
+
+typedef struct {
+    void *item;
+    esp_err_t status;           // ESP_OK until a stage fails the item
+    uint32_t epoch;             // Of `pipeline_t`, when the item was submitted
+} pipeline_cell_t;
+
+// Single-producer/single-consumer ring: each index is written by one side only
+typedef struct {
+    pipeline_cell_t *cells;
+    uint32_t mask;
+    uint32_t head;              // Next cell written, only changed by the producer
+    uint32_t tail;              // Next cell read, only changed by the consumer
+} pipeline_ring_t;
+
+typedef struct {
+    pipeline_stage_config_t cfg;
+    pipeline_t *pipeline;
+    size_t index;
+    pipeline_ring_t in;
+    TaskHandle_t task;
+    pipeline_stage_stats_t stats;   // Protected by `pipeline->lock`
+    uint64_t busy_runs;             // Items that ran, for `busy_avg_us`
+} pipeline_stage_t;
+
+struct pipeline_t {
+    pipeline_stage_t stages[PIPELINE_MAX_STAGES];
+    size_t n_stages;
+    pipeline_done_t done;
+    void *done_ctx;
+    portMUX_TYPE lock;          // Serializes the submitters, protects the flags and the stats
+    bool flushing;              // Submissions are refused
+    bool stopping;
+    uint32_t epoch;             // Incremented by each flush, items of older epochs skip the remaining stages
+    uint32_t in_flight;         // Submitted and not done yet
+    SemaphoreHandle_t idle;     // Given when the last item in flight is done
+    SemaphoreHandle_t exited;   // Given by each stage task when it ends
+};
+
+// Returns the fill level before the push in `fill`
+static bool ring_push(pipeline_ring_t *r, const pipeline_cell_t *cell, uint32_t *fill)
+{
+    const uint32_t head = r->head;
+    const uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);    // The consumer is done with the cell
+    *fill = head - tail;
+    if (*fill > r->mask) {
+        return false;
+    }
+    r->cells[head & r->mask] = *cell;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);                // Publish the cell
+    return true;
+}
+
+// Returns the fill level before the pop in `fill`
+static bool ring_pop(pipeline_ring_t *r, pipeline_cell_t *cell, uint32_t *fill)
+{
+    const uint32_t tail = r->tail;
+    const uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    *fill = head - tail;
+    if (*fill == 0) {
+        return false;
+    }
+    *cell = r->cells[tail & r->mask];
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);                // Free the cell
+    return true;
+}
+
+static void stage_account(pipeline_stage_t *st, bool ran, esp_err_t status, int64_t busy_us, int64_t starved_us,
+                          int64_t blocked_us, uint32_t fill)
+{
+    pipeline_t *p = st->pipeline;
+    pipeline_stage_stats_t *s = &st->stats;
+
+    portENTER_CRITICAL(&p->lock);
+    if (ran) {
+        s->items++;
+        s->failed += (status != ESP_OK) ? 1 : 0;
+        s->busy_us += busy_us;
+        s->busy_max_us = (uint32_t)busy_us > s->busy_max_us ? (uint32_t)busy_us : s->busy_max_us;
+        st->busy_runs++;
+    } else {
+        s->skipped++;
+    }
+    s->starved_us += starved_us;
+    s->blocked_us += blocked_us;
+    s->depth_max = fill > s->depth_max ? fill : s->depth_max;
+    portEXIT_CRITICAL(&p->lock);
+}
+
+static void stage_task(void *arg)
+{
+    pipeline_stage_t *st = arg;
+    pipeline_t *p = st->pipeline;
+    pipeline_stage_t *prev = (st->index > 0) ? &p->stages[st->index - 1] : NULL;
+    pipeline_stage_t *next = (st->index + 1 < p->n_stages) ? &p->stages[st->index + 1] : NULL;
+
+    for (;;) {
+        pipeline_cell_t cell;
+        uint32_t fill;
+        int64_t start_us = esp_timer_get_time();
+        while (!ring_pop(&st->in, &cell, &fill)) {
+            if (__atomic_load_n(&p->stopping, __ATOMIC_ACQUIRE)) {
+                xSemaphoreGive(p->exited);
+                vTaskDelete(NULL);
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        const int64_t starved_us = esp_timer_get_time() - start_us;
+        if (prev && fill == st->in.mask + 1) {
+            xTaskNotifyGive(prev->task);    // The previous stage may be waiting for room
+        }
+
+        if (cell.status == ESP_OK && cell.epoch != __atomic_load_n(&p->epoch, __ATOMIC_ACQUIRE)) {
+            cell.status = ESP_ERR_NOT_FINISHED;
+        }
+        const bool ran = (cell.status == ESP_OK);
+        int64_t busy_us = 0;
+        if (ran) {
+            start_us = esp_timer_get_time();
+            cell.status = st->cfg.run(cell.item, st->cfg.ctx);
+            busy_us = esp_timer_get_time() - start_us;
+        }
+
+        int64_t blocked_us = 0;
+        if (next) {
+            uint32_t next_fill;
+            start_us = esp_timer_get_time();
+            while (!ring_push(&next->in, &cell, &next_fill)) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            blocked_us = esp_timer_get_time() - start_us;
+            if (next_fill == 0) {
+                xTaskNotifyGive(next->task);    // The next stage may be waiting for input
+            }
+        }
+        stage_account(st, ran, cell.status, busy_us, starved_us, blocked_us, fill);
+
+        if (!next) {
+            p->done(cell.item, cell.status, p->done_ctx);
+            if (__atomic_sub_fetch(&p->in_flight, 1, __ATOMIC_ACQ_REL) == 0) {
+                xSemaphoreGive(p->idle);
+            }
+        }
+    }
+}
+
+// End the tasks of the stages [first, n_stages), their rings must be empty
+static void pipeline_end_tasks(pipeline_t *p, size_t first)
+{
+    __atomic_store_n(&p->stopping, true, __ATOMIC_RELEASE);
+    for (size_t i = first; i < p->n_stages; i++) {
+        xTaskNotifyGive(p->stages[i].task);
+    }
+    for (size_t i = first; i < p->n_stages; i++) {
+        xSemaphoreTake(p->exited, portMAX_DELAY);
+    }
+}
+
+static void pipeline_free(pipeline_t *p)
+{
+    for (size_t i = 0; i < p->n_stages; i++) {
+        free(p->stages[i].in.cells);
+    }
+    if (p->idle) {
+        vSemaphoreDelete(p->idle);
+    }
+    if (p->exited) {
+        vSemaphoreDelete(p->exited);
+    }
+    free(p);
+}
+
+esp_err_t pipeline_create(const pipeline_config_t *config, pipeline_t **pipeline)
+{
+    if (!config || !pipeline || !config->stages || !config->done || config->n_stages == 0 ||
+            config->n_stages > PIPELINE_MAX_STAGES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < config->n_stages; i++) {
+        const uint32_t depth = config->stages[i].depth;
+        if (!config->stages[i].run || depth == 0 || (depth & (depth - 1)) != 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    pipeline_t *p = calloc(1, sizeof(*p));
+    if (!p) {
+        return ESP_ERR_NO_MEM;
+    }
+    portMUX_INITIALIZE(&p->lock);
+    p->n_stages = config->n_stages;
+    p->done = config->done;
+    p->done_ctx = config->done_ctx;
+    p->idle = xSemaphoreCreateBinary();
+    p->exited = xSemaphoreCreateCounting(PIPELINE_MAX_STAGES, 0);
+    bool ok = p->idle && p->exited;
+    for (size_t i = 0; i < p->n_stages && ok; i++) {
+        pipeline_stage_t *st = &p->stages[i];
+        st->cfg = config->stages[i];
+        st->pipeline = p;
+        st->index = i;
+        st->in.mask = st->cfg.depth - 1;
+        st->in.cells = calloc(st->cfg.depth, sizeof(pipeline_cell_t));
+        ok = (st->in.cells != NULL);
+    }
+    if (!ok) {
+        pipeline_free(p);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Last stage first, so that every task can find the task it feeds
+    for (size_t i = p->n_stages; i-- > 0;) {
+        pipeline_stage_t *st = &p->stages[i];
+        if (xTaskCreatePinnedToCore(stage_task, st->cfg.name, st->cfg.stack_size, st, st->cfg.priority, &st->task,
+                                    st->cfg.core) != pdPASS) {
+            ESP_LOGE(TAG, "Can't create the task of stage \"%s\"", st->cfg.name);
+            pipeline_end_tasks(p, i + 1);
+            pipeline_free(p);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    *pipeline = p;
+    return ESP_OK;
+}
+
+esp_err_t pipeline_submit(pipeline_t *pipeline, void *item)
+{
+    if (!pipeline) return ESP_ERR_INVALID_ARG;
+
+    pipeline_t *p = pipeline;
+    pipeline_stage_t *first = &p->stages[0];
+    const pipeline_cell_t cell = { .item = item, .status = ESP_OK, .epoch = __atomic_load_n(&p->epoch, __ATOMIC_ACQUIRE) };
+    uint32_t fill = 0;
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&p->lock);
+    if (p->flushing || p->stopping) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        // Counted before it is visible, the last stage may be done with it right away
+        __atomic_add_fetch(&p->in_flight, 1, __ATOMIC_ACQ_REL);
+        if (!ring_push(&first->in, &cell, &fill)) {
+            __atomic_sub_fetch(&p->in_flight, 1, __ATOMIC_ACQ_REL);
+            ret = ESP_ERR_NO_MEM;
+        }
+    }
+    portEXIT_CRITICAL(&p->lock);
+
+    if (ret == ESP_OK && fill == 0) {
+        xTaskNotifyGive(first->task);
+    }
+    return ret;
+}
+
+// Wait until no item is in flight, `timeout_us` < 0 waits forever
+static esp_err_t pipeline_wait_idle(pipeline_t *p, int64_t timeout_us)
+{
+    const int64_t deadline_us = esp_timer_get_time() + timeout_us;
+    while (__atomic_load_n(&p->in_flight, __ATOMIC_ACQUIRE) > 0) {
+        TickType_t ticks = portMAX_DELAY;
+        if (timeout_us >= 0) {
+            const int64_t left_us = deadline_us - esp_timer_get_time();
+            if (left_us <= 0) {
+                return ESP_ERR_TIMEOUT;
+            }
+            ticks = pdMS_TO_TICKS(left_us / 1000) + 1;
+        }
+        xSemaphoreTake(p->idle, ticks);
+    }
+    return ESP_OK;
+}
+
+esp_err_t pipeline_flush(pipeline_t *pipeline, uint32_t timeout_ms)
+{
+    if (!pipeline) return ESP_ERR_INVALID_ARG;
+
+    pipeline_t *p = pipeline;
+    portENTER_CRITICAL(&p->lock);
+    p->flushing = true;
+    __atomic_add_fetch(&p->epoch, 1, __ATOMIC_ACQ_REL);
+    portEXIT_CRITICAL(&p->lock);
+
+    const esp_err_t ret = pipeline_wait_idle(p, (int64_t)timeout_ms * 1000);
+
+    portENTER_CRITICAL(&p->lock);
+    p->flushing = false;
+    portEXIT_CRITICAL(&p->lock);
+    return ret;
+}
+
+void pipeline_stop(pipeline_t *pipeline)
+{
+    if (!pipeline) return;
+
+    pipeline_t *p = pipeline;
+    portENTER_CRITICAL(&p->lock);
+    p->flushing = true;
+    __atomic_add_fetch(&p->epoch, 1, __ATOMIC_ACQ_REL);
+    portEXIT_CRITICAL(&p->lock);
+
+    pipeline_wait_idle(p, -1);
+    pipeline_end_tasks(p, 0);
+    pipeline_free(p);
+}
+
+esp_err_t pipeline_get_stats(pipeline_t *pipeline, size_t stage, pipeline_stage_stats_t *stats, bool reset)
+{
+    if (!pipeline || !stats || stage >= pipeline->n_stages) return ESP_ERR_INVALID_ARG;
+
+    pipeline_stage_t *st = &pipeline->stages[stage];
+    portENTER_CRITICAL(&pipeline->lock);
+    *stats = st->stats;
+    stats->busy_avg_us = st->busy_runs ? (uint32_t)(st->stats.busy_us / st->busy_runs) : 0;
+    if (reset) {
+        memset(&st->stats, 0, sizeof(st->stats));
+        st->busy_runs = 0;
+    }
+    portEXIT_CRITICAL(&pipeline->lock);
+    return ESP_OK;
+}
+
+void pipeline_log_stats(pipeline_t *pipeline)
+{
+    if (!pipeline) return;
+
+    for (size_t i = 0; i < pipeline->n_stages; i++) {
+        pipeline_stage_stats_t st;
+        pipeline_get_stats(pipeline, i, &st, false);
+        ESP_LOGI(TAG, "%-8s %lu items (%lu failed, %lu skipped), busy avg %lu max %lu ms, "
+                 "starved %llu ms, blocked %llu ms, depth max %lu",
+                 pipeline->stages[i].cfg.name, (unsigned long)st.items, (unsigned long)st.failed,
+                 (unsigned long)st.skipped, (unsigned long)(st.busy_avg_us / 1000),
+                 (unsigned long)(st.busy_max_us / 1000), (unsigned long long)(st.starved_us / 1000),
+                 (unsigned long long)(st.blocked_us / 1000), (unsigned long)st.depth_max);
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Staged pipeline: each stage is a task pinned to a core, taking items from its input ring and passing them to the
+ * input ring of the next stage. Items are opaque handles (e.g. a slide with its buffers), processed in place.
+ *  - The rings between stages are fixed-capacity single-producer/single-consumer rings, lock free. A stage waits on
+ *    its task notification when its input is empty or the next ring is full, so a slow stage holds back the ones
+ *    before it (backpressure) down to `pipeline_submit()`, which fails when the first ring is full.
+ *  - An item failed by a stage skips the following stages. Every item leaves through the `done` callback, called
+ *    from the task of the last stage, exactly once.
+ *  - `pipeline_flush()` ends all items in flight without running the remaining stages on them.
+ *  - Each stage accounts its busy time, the time starved of input and the time blocked by the next stage.
+ */
+
+#define PIPELINE_MAX_STAGES     (6)
+
+typedef struct pipeline_t pipeline_t;
+
+/**
+ * @brief Work of a stage on one item, called from the task of the stage
+ *
+ * @return ESP_OK to pass the item on, or an error that ends it: the following stages skip it
+ */
+typedef esp_err_t (*pipeline_run_t)(void *item, void *ctx);
+
+/**
+ * @brief Called from the task of the last stage when an item leaves the pipeline
+ *
+ * @param status ESP_OK, the error of the stage that failed the item, or ESP_ERR_NOT_FINISHED if it was flushed
+ */
+typedef void (*pipeline_done_t)(void *item, esp_err_t status, void *ctx);
+
+typedef struct {
+    const char *name;           // Task name
+    pipeline_run_t run;
+    void *ctx;
+    uint32_t depth;             // Capacity of the input ring, a power of two
+    uint32_t stack_size;
+    UBaseType_t priority;
+    BaseType_t core;            // 0, 1 or tskNO_AFFINITY
+} pipeline_stage_config_t;
+
+typedef struct {
+    const pipeline_stage_config_t *stages;  // Copied on create
+    size_t n_stages;
+    pipeline_done_t done;
+    void *done_ctx;
+} pipeline_config_t;
+
+/**
+ * @brief Statistics of a stage
+ */
+typedef struct {
+    uint32_t items;             // Items run
+    uint32_t failed;            // Items ended by this stage
+    uint32_t skipped;           // Failed or flushed items passed through without running
+    uint32_t busy_avg_us;
+    uint32_t busy_max_us;
+    uint64_t busy_us;           // Time in `run`
+    uint64_t starved_us;        // Time waiting for input
+    uint64_t blocked_us;        // Time waiting for room in the next ring
+    uint32_t depth_max;         // Highest fill level of the input ring
+} pipeline_stage_stats_t;
+
+/**
+ * @brief Create the rings and start the stage tasks
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: No stage, too many stages, a missing `run` or a depth that is not a power of two
+ *      - ESP_ERR_NO_MEM: Not enough memory for the rings or the tasks
+ */
+esp_err_t pipeline_create(const pipeline_config_t *config, pipeline_t **pipeline);
+
+/**
+ * @brief Queue an item at the first stage, without waiting. Any task can submit.
+ *
+ * @return
+ *      - ESP_OK: Queued, `done` will be called for it
+ *      - ESP_ERR_NO_MEM: The first ring is full, retry when an item is done
+ *      - ESP_ERR_INVALID_STATE: The pipeline is stopping
+ */
+esp_err_t pipeline_submit(pipeline_t *pipeline, void *item);
+
+/**
+ * @brief End all items in flight and wait until they are done. A stage already running an item finishes it first.
+ *        Must not be called from a stage or the `done` callback.
+ *
+ * @return
+ *      - ESP_OK: The pipeline is empty
+ *      - ESP_ERR_TIMEOUT: Items are still in flight after `timeout_ms`
+ */
+esp_err_t pipeline_flush(pipeline_t *pipeline, uint32_t timeout_ms);
+
+/**
+ * @brief Flush, end the stage tasks and free the pipeline. Same restrictions as `pipeline_flush()`.
+ */
+void pipeline_stop(pipeline_t *pipeline);
+
+/**
+ * @brief Get the statistics of a stage
+ *
+ * @param reset Clear them after reading
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if there is no such stage
+ */
+esp_err_t pipeline_get_stats(pipeline_t *pipeline, size_t stage, pipeline_stage_stats_t *stats, bool reset);
+
+/**
+ * @brief Print the statistics of all stages with ESP_LOGI
+ */
+void pipeline_log_stats(pipeline_t *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PIPELINE_H
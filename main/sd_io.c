@@ -0,0 +1,529 @@
+#include "sd_io.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "storage_manager.h"
+
+static const char *TAG = "sd_io";
+
+#define MAX_REQUESTS        CONFIG_SD_IO_MAX_REQUESTS
+#define CHUNK_SIZE          (CONFIG_SD_IO_CHUNK_KB * 1024)
+#define TASK_STACK_SIZE     (4096)
+
+typedef struct sd_io_slot_t sd_io_slot_t;
+
+struct sd_io_slot_t {
+    sd_io_req_t req;                // `req.path` points to `path`, `req.prio` is the priority it was submitted with
+    char path[SD_IO_PATH_MAX];
+    sd_io_id_t id;                  // 0 while free
+    sd_io_prio_t prio;              // Scheduling priority, raised by merged requests
+    size_t len;                     // Bytes read so far
+    int64_t submit_us;
+    bool started;                   // First chunk read
+    bool size_only;                 // `sd_io_file_size()`: `len` returns the size of the file
+    bool cancel;                    // Cancelled, but still read for its followers
+    bool finishing;                 // Being completed, can't be cancelled any more
+    sd_io_slot_t *next;             // Queue, free list or list of followers
+    sd_io_slot_t *leader;           // Request serving this one, NULL for a leader
+    sd_io_slot_t *followers;        // Identical requests completed with this one
+};
+
+static struct {
+    sd_io_slot_t slots[MAX_REQUESTS];
+    sd_io_slot_t *free;
+    sd_io_slot_t *queue[SD_IO_PRIO_MAX];
+    sd_io_slot_t *current;          // Being read by the I/O task
+    SemaphoreHandle_t lock;
+    TaskHandle_t task;
+    sd_io_id_t next_id;
+    // Only used by the I/O task
+    storage_file_t *file;           // Kept open while requests are pending
+    char file_path[SD_IO_PATH_MAX];
+    uint32_t file_pos;              // End of the last read
+    // Protected by `lock`
+    uint32_t started[SD_IO_PRIO_MAX];
+    uint64_t wait_sum_us[SD_IO_PRIO_MAX];
+    sd_io_stats_t stats;
+} s_io;
+
+static void queue_push(sd_io_slot_t *slot, bool head)
+{
+    sd_io_slot_t **link = &s_io.queue[slot->prio];
+    while (!head && *link) {
+        link = &(*link)->next;
+    }
+    slot->next = *link;
+    *link = slot;
+}
+
+static bool list_remove(sd_io_slot_t **link, sd_io_slot_t *slot)
+{
+    for (; *link; link = &(*link)->next) {
+        if (*link == slot) {
+            *link = slot->next;
+            slot->next = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool higher_pending(sd_io_prio_t prio)
+{
+    for (int p = 0; p < (int)prio; p++) {
+        if (s_io.queue[p]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static sd_io_slot_t *find_slot(sd_io_id_t id)
+{
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        if (s_io.slots[i].id == id) {
+            return &s_io.slots[i];
+        }
+    }
+    return NULL;
+}
+
+// A queued or running request reading the same range of the same file
+static sd_io_slot_t *find_identical(const sd_io_slot_t *slot)
+{
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        const sd_io_slot_t *s = &s_io.slots[i];
+        if (s != slot && s->id && !s->leader && !s->cancel && !s->finishing && s->size_only == slot->size_only &&
+                s->req.offset == slot->req.offset && s->req.size == slot->req.size &&
+                strcmp(s->path, slot->path) == 0) {
+            return (sd_io_slot_t *)s;
+        }
+    }
+    return NULL;
+}
+
+// Highest priority first, and within a priority the read that continues the open file
+static sd_io_slot_t *pick_next(void)
+{
+    for (int p = 0; p < SD_IO_PRIO_MAX; p++) {
+        sd_io_slot_t *pick = s_io.queue[p];
+        if (!pick) {
+            continue;
+        }
+        for (sd_io_slot_t *s = pick; s && s_io.file; s = s->next) {
+            if (s->req.offset + s->len == s_io.file_pos && strcmp(s->path, s_io.file_path) == 0) {
+                pick = s;
+                break;
+            }
+        }
+        list_remove(&s_io.queue[p], pick);
+        return pick;
+    }
+    return NULL;
+}
+
+// Return the slot to the free list, called with the lock held
+static void slot_release(sd_io_slot_t *slot, esp_err_t status)
+{
+    if (status == ESP_ERR_NOT_FINISHED) {
+        s_io.stats.cancelled[slot->req.prio]++;
+    } else {
+        s_io.stats.completed[slot->req.prio]++;
+    }
+    slot->id = 0;
+    slot->next = s_io.free;
+    s_io.free = slot;
+}
+
+static void notify(const sd_io_req_t *req, sd_io_id_t id, esp_err_t status, size_t len)
+{
+    if (req->done) {
+        req->done(id, status, len, req->user_data);
+    }
+}
+
+// Complete a leader and its followers. The callbacks run after the slots are released, so they can submit again.
+static void sd_io_finish(sd_io_slot_t *slot, esp_err_t status)
+{
+    xSemaphoreTake(s_io.lock, portMAX_DELAY);
+    if (s_io.current == slot) {
+        s_io.current = NULL;
+    }
+    sd_io_slot_t *followers = slot->followers;
+    slot->followers = NULL;
+    slot->finishing = true;
+    for (sd_io_slot_t *f = followers; f; f = f->next) {
+        f->finishing = true;
+    }
+    xSemaphoreGive(s_io.lock);
+
+    while (followers) {
+        sd_io_slot_t *f = followers;
+        followers = f->next;
+        if (!slot->size_only && f->req.buf != slot->req.buf) {
+            memcpy(f->req.buf, slot->req.buf, slot->len);
+        }
+        const sd_io_req_t req = f->req;
+        const sd_io_id_t id = f->id;
+        xSemaphoreTake(s_io.lock, portMAX_DELAY);
+        slot_release(f, status);
+        xSemaphoreGive(s_io.lock);
+        notify(&req, id, status, slot->len);
+    }
+
+    const sd_io_req_t req = slot->req;
+    const sd_io_id_t id = slot->id;
+    const size_t len = slot->len;
+    xSemaphoreTake(s_io.lock, portMAX_DELAY);
+    if (slot->cancel) {
+        status = ESP_ERR_NOT_FINISHED;
+    }
+    slot_release(slot, status);
+    xSemaphoreGive(s_io.lock);
+    notify(&req, id, status, len);
+}
+
+static void file_close(void)
+{
+    storage_file_close(s_io.file);
+    s_io.file = NULL;
+}
+
+// Chunks are read with the bulk read path, multi-block reads into the read-ahead buffer for PSRAM destinations
+static esp_err_t file_open(const char *path)
+{
+    if (s_io.file && strcmp(s_io.file_path, path) == 0) {
+        return ESP_OK;
+    }
+
+    file_close();
+    esp_err_t ret = storage_file_open(path, &s_io.file);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Open failed (%s): %s", esp_err_to_name(ret), path);
+        s_io.file = NULL;
+        return ret == ESP_ERR_NOT_FOUND ? ret : ESP_FAIL;
+    }
+    strlcpy(s_io.file_path, path, sizeof(s_io.file_path));
+    s_io.file_pos = 0;
+    return ESP_OK;
+}
+
+// Read a request chunk by chunk until it completes, is cancelled or is preempted
+static void sd_io_serve(sd_io_slot_t *slot)
+{
+    const uint32_t pos = slot->req.offset + slot->len;
+
+    if (!slot->started) {
+        const bool sequential = s_io.file && s_io.file_pos == pos && strcmp(s_io.file_path, slot->path) == 0;
+        const uint32_t wait_us = (uint32_t)(esp_timer_get_time() - slot->submit_us);
+        xSemaphoreTake(s_io.lock, portMAX_DELAY);
+        slot->started = true;
+        s_io.started[slot->prio]++;
+        s_io.wait_sum_us[slot->prio] += wait_us;
+        if (wait_us > s_io.stats.wait_max_us[slot->prio]) {
+            s_io.stats.wait_max_us[slot->prio] = wait_us;
+        }
+        s_io.stats.sequential += sequential;
+        xSemaphoreGive(s_io.lock);
+    }
+
+    esp_err_t ret = file_open(slot->path);
+    if (ret != ESP_OK || slot->size_only) {
+        slot->len = (ret == ESP_OK) ? storage_file_size(s_io.file) : 0;
+        sd_io_finish(slot, ret);
+        return;
+    }
+
+    while (true) {
+        const size_t remain = slot->req.size - slot->len;
+        const size_t chunk = remain < CHUNK_SIZE ? remain : CHUNK_SIZE;
+        size_t rd = 0;
+        if (chunk && storage_file_read(s_io.file, slot->req.offset + slot->len, (uint8_t *)slot->req.buf + slot->len,
+                                       chunk, &rd) != ESP_OK) {
+            ret = ESP_FAIL;
+        }
+        slot->len += rd;
+        s_io.file_pos = slot->req.offset + slot->len;
+
+        xSemaphoreTake(s_io.lock, portMAX_DELAY);
+        s_io.stats.bytes += rd;
+        const bool done = ret != ESP_OK || rd < chunk || slot->len == slot->req.size ||
+                          (slot->cancel && !slot->followers);
+        if (!done && higher_pending(slot->prio)) {
+            // Resume later from `slot->len`
+            s_io.stats.preempted++;
+            s_io.current = NULL;
+            queue_push(slot, true);
+            xSemaphoreGive(s_io.lock);
+            return;
+        }
+        xSemaphoreGive(s_io.lock);
+
+        if (done) {
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Read failed at %u: %s", (unsigned)(slot->req.offset + slot->len), slot->path);
+                file_close();
+            }
+            sd_io_finish(slot, ret);
+            return;
+        }
+    }
+}
+
+static void sd_io_task(void *arg)
+{
+    while (true) {
+        xSemaphoreTake(s_io.lock, portMAX_DELAY);
+        sd_io_slot_t *slot = pick_next();
+        s_io.current = slot;
+        xSemaphoreGive(s_io.lock);
+
+        if (!slot) {
+            file_close();   // Don't hold a file while idle, it may be rewritten
+            // Writes go one chunk at a time, so a read arriving meanwhile waits for one chunk at most
+            if (!storage_service()) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            continue;
+        }
+        sd_io_serve(slot);
+    }
+}
+
+static void sd_io_wake(void)
+{
+    xTaskNotifyGive(s_io.task);
+}
+
+esp_err_t sd_io_init(void)
+{
+    if (s_io.task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_io.lock = xSemaphoreCreateMutex();
+    if (!s_io.lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = MAX_REQUESTS - 1; i >= 0; i--) {
+        s_io.slots[i].next = s_io.free;
+        s_io.free = &s_io.slots[i];
+    }
+    s_io.next_id = 1;
+
+    if (xTaskCreatePinnedToCore(sd_io_task, "sd_io", TASK_STACK_SIZE, NULL, CONFIG_SD_IO_TASK_PRIORITY,
+                                &s_io.task, CONFIG_SD_IO_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task");
+        vSemaphoreDelete(s_io.lock);
+        s_io.lock = NULL;
+        s_io.free = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    storage_set_notify(sd_io_wake);
+
+    ESP_LOGI(TAG, "Started, %d requests, %d KB chunks", MAX_REQUESTS, CONFIG_SD_IO_CHUNK_KB);
+    return ESP_OK;
+}
+
+static esp_err_t sd_io_enqueue(const sd_io_req_t *req, bool size_only, sd_io_id_t *id)
+{
+    if (!req || !req->path || (!req->buf && req->size) || req->prio >= SD_IO_PRIO_MAX ||
+            strlen(req->path) >= SD_IO_PATH_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_io.task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_io.lock, portMAX_DELAY);
+    sd_io_slot_t *slot = s_io.free;
+    if (!slot) {
+        s_io.stats.queue_full++;
+        xSemaphoreGive(s_io.lock);
+        return ESP_ERR_NO_MEM;
+    }
+    s_io.free = slot->next;
+
+    memset(slot, 0, sizeof(*slot));
+    slot->req = *req;
+    strlcpy(slot->path, req->path, sizeof(slot->path));
+    slot->req.path = slot->path;
+    slot->prio = req->prio;
+    slot->size_only = size_only;
+    slot->submit_us = esp_timer_get_time();
+    slot->id = s_io.next_id++;
+    if (s_io.next_id == 0) {
+        s_io.next_id = 1;
+    }
+    s_io.stats.submitted[req->prio]++;
+
+    sd_io_slot_t *leader = find_identical(slot);
+    if (leader) {
+        slot->leader = leader;
+        slot->next = leader->followers;
+        leader->followers = slot;
+        s_io.stats.merged++;
+        if (slot->prio < leader->prio) {
+            // Serve the shared read at the more urgent priority
+            const bool queued = list_remove(&s_io.queue[leader->prio], leader);
+            leader->prio = slot->prio;
+            if (queued) {
+                queue_push(leader, false);
+            }
+        }
+    } else {
+        queue_push(slot, false);
+    }
+    if (id) {
+        *id = slot->id;
+    }
+    xSemaphoreGive(s_io.lock);
+
+    xTaskNotifyGive(s_io.task);
+    return ESP_OK;
+}
+
+esp_err_t sd_io_submit(const sd_io_req_t *req, sd_io_id_t *id)
+{
+    return sd_io_enqueue(req, false, id);
+}
+
+esp_err_t sd_io_cancel(sd_io_id_t id)
+{
+    if (id == 0 || !s_io.task) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(s_io.lock, portMAX_DELAY);
+    sd_io_slot_t *slot = find_slot(id);
+    if (!slot || slot->finishing || slot->cancel) {
+        xSemaphoreGive(s_io.lock);
+        return slot && slot->cancel ? ESP_OK : ESP_ERR_NOT_FOUND;
+    }
+
+    bool removed;
+    if (slot->leader) {
+        removed = list_remove(&slot->leader->followers, slot);
+    } else if (slot->followers || slot == s_io.current) {
+        // Still read for the followers, or stopped by the I/O task at the next chunk
+        removed = false;
+    } else {
+        removed = list_remove(&s_io.queue[slot->prio], slot);
+    }
+    if (!removed) {
+        slot->cancel = true;
+        xSemaphoreGive(s_io.lock);
+        return ESP_OK;
+    }
+
+    const sd_io_req_t req = slot->req;
+    slot_release(slot, ESP_ERR_NOT_FINISHED);
+    xSemaphoreGive(s_io.lock);
+    notify(&req, id, ESP_ERR_NOT_FINISHED, 0);
+    return ESP_OK;
+}
+
+typedef struct {
+    SemaphoreHandle_t done;
+    esp_err_t status;
+    size_t len;
+} sd_io_wait_t;
+
+static void sd_io_read_done(sd_io_id_t id, esp_err_t status, size_t len, void *user_data)
+{
+    sd_io_wait_t *wait = user_data;
+    wait->status = status;
+    wait->len = len;
+    xSemaphoreGive(wait->done);
+}
+
+static esp_err_t sd_io_wait(const char *path, uint32_t offset, void *buf, size_t size, sd_io_prio_t prio,
+                            bool size_only, size_t *len)
+{
+    StaticSemaphore_t sem_buf;
+    sd_io_wait_t wait = {
+        .done = xSemaphoreCreateBinaryStatic(&sem_buf),
+        .len = 0,
+    };
+    const sd_io_req_t req = {
+        .path = path,
+        .offset = offset,
+        .buf = buf,
+        .size = size,
+        .prio = prio,
+        .done = sd_io_read_done,
+        .user_data = &wait,
+    };
+
+    esp_err_t ret = sd_io_enqueue(&req, size_only, NULL);
+    if (ret == ESP_OK) {
+        xSemaphoreTake(wait.done, portMAX_DELAY);
+        ret = wait.status;
+    }
+    vSemaphoreDelete(wait.done);
+    if (len) {
+        *len = wait.len;
+    }
+    return ret;
+}
+
+esp_err_t sd_io_read(const char *path, uint32_t offset, void *buf, size_t size, sd_io_prio_t prio, size_t *len)
+{
+    return sd_io_wait(path, offset, buf, size, prio, false, len);
+}
+
+esp_err_t sd_io_file_size(const char *path, sd_io_prio_t prio, uint32_t *size)
+{
+    size_t len = 0;
+    esp_err_t ret = sd_io_wait(path, 0, NULL, 0, prio, true, &len);
+    if (size) {
+        *size = (ret == ESP_OK) ? (uint32_t)len : 0;
+    }
+    return ret;
+}
+
+void sd_io_get_stats(sd_io_stats_t *stats, bool reset)
+{
+    if (!stats || !s_io.lock) {
+        if (stats) {
+            memset(stats, 0, sizeof(*stats));
+        }
+        return;
+    }
+
+    xSemaphoreTake(s_io.lock, portMAX_DELAY);
+    *stats = s_io.stats;
+    for (int p = 0; p < SD_IO_PRIO_MAX; p++) {
+        stats->wait_avg_us[p] = s_io.started[p] ? (uint32_t)(s_io.wait_sum_us[p] / s_io.started[p]) : 0;
+    }
+    if (reset) {
+        memset(&s_io.stats, 0, sizeof(s_io.stats));
+        memset(s_io.started, 0, sizeof(s_io.started));
+        memset(s_io.wait_sum_us, 0, sizeof(s_io.wait_sum_us));
+    }
+    xSemaphoreGive(s_io.lock);
+}
+
+void sd_io_log_stats(void)
+{
+    static const char *const names[SD_IO_PRIO_MAX] = { "current", "prefetch", "index", "write" };
+    sd_io_stats_t stats;
+
+    sd_io_get_stats(&stats, false);
+    for (int p = 0; p < SD_IO_PRIO_MAX; p++) {
+        ESP_LOGI(TAG, "%-8s submitted %lu, completed %lu, cancelled %lu, wait avg %lu us, max %lu us", names[p],
+                 (unsigned long)stats.submitted[p], (unsigned long)stats.completed[p],
+                 (unsigned long)stats.cancelled[p], (unsigned long)stats.wait_avg_us[p],
+                 (unsigned long)stats.wait_max_us[p]);
+    }
+    ESP_LOGI(TAG, "merged %lu, sequential %lu, preempted %lu, queue full %lu, %llu KB read",
+             (unsigned long)stats.merged, (unsigned long)stats.sequential, (unsigned long)stats.preempted,
+             (unsigned long)stats.queue_full, (unsigned long long)(stats.bytes / 1024));
+}
@@ -0,0 +1,135 @@
+#ifndef SD_IO_H
+#define SD_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * SD I/O scheduler: one task owns the card and serves file reads from per priority queues.
+ *  - The highest non-empty priority is always served first. Reads are done in chunks of CONFIG_SD_IO_CHUNK_KB,
+ *    and a read is put back at the head of its queue when a more urgent request arrives in between.
+ *  - Identical queued reads (same file and range) are served once, at the more urgent of their priorities.
+ *  - Within a priority, a read continuing the open file at its current position goes first, so sequential
+ *    requests are served without reopening or seeking.
+ *  - Queued or running requests can be cancelled.
+ *  - When no read is pending, the task writes out the files of the write-behind writer (see storage_manager.h).
+ */
+
+#define SD_IO_PATH_MAX          (64)    // Longest path accepted, including the terminator
+
+typedef enum {
+    SD_IO_PRIO_CURRENT = 0,     // The slide on screen, or about to be
+    SD_IO_PRIO_PREFETCH,        // The next slides
+    SD_IO_PRIO_INDEX,           // Background catalog scans
+    SD_IO_PRIO_WRITE,           // Cache maintenance
+    SD_IO_PRIO_MAX,
+} sd_io_prio_t;
+
+typedef uint32_t sd_io_id_t;    // 0 is never a valid id
+
+/**
+ * @brief Completion callback, called from the I/O task
+ *
+ * @param status ESP_OK, ESP_ERR_NOT_FOUND (can't open), ESP_FAIL (read error), ESP_ERR_NOT_FINISHED (cancelled)
+ * @param len Bytes read into the buffer, short at the end of the file
+ */
+typedef void (*sd_io_done_cb_t)(sd_io_id_t id, esp_err_t status, size_t len, void *user_data);
+
+typedef struct {
+    const char *path;           // File to read, copied on submit
+    uint32_t offset;            // First byte to read
+    void *buf;                  // Destination, must stay valid until completion
+    size_t size;                // Bytes to read
+    sd_io_prio_t prio;
+    sd_io_done_cb_t done;       // Can be NULL
+    void *user_data;
+} sd_io_req_t;
+
+/**
+ * @brief Statistics of the scheduler
+ */
+typedef struct {
+    uint32_t submitted[SD_IO_PRIO_MAX];
+    uint32_t completed[SD_IO_PRIO_MAX];
+    uint32_t cancelled[SD_IO_PRIO_MAX];
+    uint32_t wait_max_us[SD_IO_PRIO_MAX];   // Longest time from submit to the first byte read
+    uint32_t wait_avg_us[SD_IO_PRIO_MAX];
+    uint32_t merged;            // Requests served by an identical one
+    uint32_t sequential;        // Requests served without reopening or seeking the file
+    uint32_t preempted;         // Reads interrupted by a more urgent request
+    uint32_t queue_full;        // Submissions refused for lack of a free request
+    uint64_t bytes;             // Bytes read from the card
+} sd_io_stats_t;
+
+/**
+ * @brief Start the I/O task, call once the card is mounted
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: Already started
+ *      - ESP_ERR_NO_MEM: Can't create the task
+ */
+esp_err_t sd_io_init(void);
+
+/**
+ * @brief Queue a read
+ *
+ * @param id Returns the id of the request for `sd_io_cancel()`, can be NULL
+ *
+ * @return
+ *      - ESP_OK: Queued, `done` will be called exactly once
+ *      - ESP_ERR_INVALID_ARG: Bad request or path too long
+ *      - ESP_ERR_INVALID_STATE: Not started
+ *      - ESP_ERR_NO_MEM: All CONFIG_SD_IO_MAX_REQUESTS requests are in use
+ */
+esp_err_t sd_io_submit(const sd_io_req_t *req, sd_io_id_t *id);
+
+/**
+ * @brief Cancel a request. A running read stops at the next chunk.
+ *
+ * @return
+ *      - ESP_OK: Cancelled, `done` is called with ESP_ERR_NOT_FINISHED
+ *      - ESP_ERR_NOT_FOUND: Already completed
+ */
+esp_err_t sd_io_cancel(sd_io_id_t id);
+
+/**
+ * @brief Read and wait for the result. Must not be called from the I/O task (i.e. from a `done` callback).
+ *
+ * @param len Returns the bytes read, can be NULL
+ *
+ * @return Same status as the completion callback, or an error of `sd_io_submit()`
+ */
+esp_err_t sd_io_read(const char *path, uint32_t offset, void *buf, size_t size, sd_io_prio_t prio, size_t *len);
+
+/**
+ * @brief Get the size of a file through the I/O task, so that no other task touches the card meanwhile.
+ *        Same restrictions as `sd_io_read()`.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND or an error of `sd_io_submit()`
+ */
+esp_err_t sd_io_file_size(const char *path, sd_io_prio_t prio, uint32_t *size);
+
+/**
+ * @brief Get the statistics
+ *
+ * @param reset Clear them after reading
+ */
+void sd_io_get_stats(sd_io_stats_t *stats, bool reset);
+
+/**
+ * @brief Print the statistics with ESP_LOGI
+ */
+void sd_io_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
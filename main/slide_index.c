@@ -0,0 +1,161 @@
+#include "slide_index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sd_io.h"
+
+static const char *TAG = "slide_index";
+
+#define INDEX_MAGIC         0x58495054  // "TPIX"
+#define INDEX_VERSION       2
+#define INDEX_MAX_SIZE      (1024 * 1024)
+#define FNV_OFFSET          2166136261u
+#define FNV_PRIME           16777619u
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t count;
+    uint32_t names_offset;      // From the start of the file
+    uint32_t names_size;
+    uint32_t reserved[2];
+    uint32_t checksum;          // FNV-1a of everything after the header
+} index_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t size;
+    uint32_t name_offset;       // In the names
+    uint16_t name_len;          // Bytes, terminator excluded
+    uint8_t attr;               // FAT attributes
+    uint8_t reserved;
+    char short_name[12];        // "NAME.EXT", NUL padded, not terminated when 12 long
+} index_entry_t;
+
+_Static_assert(sizeof(index_header_t) == 32 && sizeof(index_entry_t) == 24, "Must match tools/make_slide_index.py");
+
+struct slide_index_t {
+    uint8_t *data;              // The whole file
+    const index_header_t *hdr;
+    const index_entry_t *entries;
+    const char *names;
+};
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static esp_err_t index_check(const uint8_t *data, size_t size)
+{
+    const index_header_t *hdr = (const index_header_t *)data;
+    if (size < sizeof(*hdr) || hdr->magic != INDEX_MAGIC || hdr->version != INDEX_VERSION ||
+            hdr->entry_size != sizeof(index_entry_t)) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    const uint64_t entries_end = sizeof(*hdr) + (uint64_t)hdr->count * sizeof(index_entry_t);
+    if (entries_end > hdr->names_offset || (uint64_t)hdr->names_offset + hdr->names_size != size ||
+            fnv1a(FNV_OFFSET, data + sizeof(*hdr), size - sizeof(*hdr)) != hdr->checksum) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    const index_entry_t *entries = (const index_entry_t *)(data + sizeof(*hdr));
+    const char *names = (const char *)data + hdr->names_offset;
+    for (uint32_t i = 0; i < hdr->count; i++) {
+        const index_entry_t *e = &entries[i];
+        if ((uint64_t)e->name_offset + e->name_len >= hdr->names_size || names[e->name_offset + e->name_len] != '\0') {
+            return ESP_ERR_INVALID_VERSION;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t slide_index_load(const char *dir, slide_index_t **index)
+{
+    if (!dir || !index) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char path[SD_IO_PATH_MAX];
+    int n = snprintf(path, sizeof(path), "%s/%s", dir, SLIDE_INDEX_FILE);
+    if (n < 0 || (size_t)n >= sizeof(path)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t size = 0;
+    esp_err_t ret = sd_io_file_size(path, SD_IO_PRIO_INDEX, &size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (size > INDEX_MAX_SIZE) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    slide_index_t *idx = calloc(1, sizeof(slide_index_t));
+    uint8_t *data = heap_caps_malloc(size ? size : 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!idx || !data) {
+        ret = ESP_ERR_NO_MEM;
+        goto err;
+    }
+    size_t len = 0;
+    ret = sd_io_read(path, 0, data, size, SD_IO_PRIO_INDEX, &len);
+    if (ret == ESP_OK && len != size) {
+        ret = ESP_FAIL;
+    }
+    if (ret == ESP_OK) {
+        ret = index_check(data, size);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Can't use %s: %s", path, esp_err_to_name(ret));
+        goto err;
+    }
+
+    idx->data = data;
+    idx->hdr = (const index_header_t *)data;
+    idx->entries = (const index_entry_t *)(data + sizeof(index_header_t));
+    idx->names = (const char *)data + idx->hdr->names_offset;
+    *index = idx;
+    ESP_LOGI(TAG, "%s: %lu files", path, (unsigned long)idx->hdr->count);
+    return ESP_OK;
+
+err:
+    heap_caps_free(data);
+    free(idx);
+    return ret;
+}
+
+size_t slide_index_count(const slide_index_t *index)
+{
+    return index ? index->hdr->count : 0;
+}
+
+static void entry_fill(const slide_index_t *index, const index_entry_t *e, slide_index_entry_t *entry)
+{
+    entry->name = index->names + e->name_offset;
+    memcpy(entry->short_name, e->short_name, sizeof(e->short_name));
+    entry->short_name[sizeof(e->short_name)] = '\0';
+    entry->size = e->size;
+}
+
+bool slide_index_get(const slide_index_t *index, size_t pos, slide_index_entry_t *entry)
+{
+    if (!index || !entry || pos >= index->hdr->count) {
+        return false;
+    }
+    entry_fill(index, &index->entries[pos], entry);
+    return true;
+}
+
+void slide_index_free(slide_index_t *index)
+{
+    if (index) {
+        heap_caps_free(index->data);
+        free(index);
+    }
+}
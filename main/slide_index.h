@@ -0,0 +1,75 @@
+#ifndef SLIDE_INDEX_H
+#define SLIDE_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Slide index: long file names of a slide directory, for a FatFs built without LFN support.
+ * tools/make_slide_index.py reads the directory from the card and writes SLIDE_INDEX_FILE into it, mapping every long
+ * name to its 8.3 name and size. The device loads the file in one read, then lists the slides in name order without
+ * readdir() or stat(). The sizes are not checked here: the caller finds an out of date index when a file is missing
+ * or has another size as it reads it.
+ *
+ * Layout of the file (little endian):
+ *  - header: magic "TPIX", version, entry size, entry count, offset and size of the names, checksum
+ *  - entries: size, offset and length of the name, FAT attributes, 8.3 name
+ *  - names: UTF-8, NUL terminated
+ */
+
+#define SLIDE_INDEX_FILE        "TPINDEX.BIN"
+#define SLIDE_INDEX_SHORT_LEN   (13)    // "NAME1234.EXT" and the terminator
+
+typedef struct slide_index_t slide_index_t;
+
+/**
+ * @brief A file of the index
+ */
+typedef struct {
+    const char *name;                       // Long name, valid until `slide_index_free()`
+    char short_name[SLIDE_INDEX_SHORT_LEN]; // Name to open the file with
+    uint32_t size;
+} slide_index_entry_t;
+
+/**
+ * @brief Load the index of a directory through the SD I/O task
+ *
+ * @param dir Directory on the card, e.g. "/sdcard/slides"
+ * @param index Returns the index
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_NOT_FOUND: The directory has no index
+ *      - ESP_ERR_INVALID_VERSION: Not an index, or a corrupted one
+ *      - ESP_ERR_NO_MEM: Out of memory
+ *      - Others: Errors of `sd_io_read()`
+ */
+esp_err_t slide_index_load(const char *dir, slide_index_t **index);
+
+/**
+ * @brief Number of files, sorted by long name
+ */
+size_t slide_index_count(const slide_index_t *index);
+
+/**
+ * @brief Get a file by position
+ *
+ * @return false if `pos` is out of range
+ */
+bool slide_index_get(const slide_index_t *index, size_t pos, slide_index_entry_t *entry);
+
+/**
+ * @brief Free an index
+ */
+void slide_index_free(slide_index_t *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SLIDE_INDEX_H
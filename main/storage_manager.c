@@ -2,27 +2,27 @@
 #include "driver/sdspi_host.h"
 #include "driver/spi_common.h"
 #include "esp_check.h"
-#include "i2c_bus_mgr.h"
+#include "ch422g.h"
 
 #include <stdint.h>
 #include <string.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
 
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_memory_utils.h"
+#include "esp_timer.h"
 #include "esp_vfs_fat.h"
+#include "diskio_sdmmc.h"
+#include "ff.h"
 #include "sd_protocol_types.h"
 #include "sdmmc_cmd.h"
-#include "driver/i2c.h"
-
-// I2C configuration
-#define I2C_MASTER_SCL_IO CONFIG_STORAGE_I2C_SCL
-#define I2C_MASTER_SDA_IO CONFIG_STORAGE_I2C_SDA
-#define I2C_MASTER_NUM 0
-#define I2C_MASTER_FREQ_HZ 400000
-#define I2C_MASTER_TX_BUF_DISABLE 0
-#define I2C_MASTER_RX_BUF_DISABLE 0
-#define I2C_MASTER_TIMEOUT_MS 1000
 
 // Maximum character size for file operations
 #define MAX_FILE_CHAR_SIZE 64
@@ -30,81 +30,282 @@
 // Mount point for SD card
 #define MOUNT_POINT "/sdcard"
 
+// Allocation unit of cards formatted by the mount, also the chunk of the write-behind writer
+#define ALLOCATION_UNIT_SIZE (16 * 1024)
+
 // Pin assignments for SD SPI interface
 #define PIN_NUM_MISO CONFIG_STORAGE_PIN_MISO
 #define PIN_NUM_MOSI CONFIG_STORAGE_PIN_MOSI
 #define PIN_NUM_CLK  CONFIG_STORAGE_PIN_CLK
 #define PIN_NUM_CS   CONFIG_STORAGE_PIN_CS
 
+// SD clock negotiation
+#define SD_PROBE_SECTORS    64      // Sectors read back at every probed clock (32 KB from sector 0)
+#define SD_BENCH_ROUNDS     8       // Reads of the probe sectors timed for the throughput figure
+
+// Bulk reads
+#define READ_AHEAD_SIZE     (CONFIG_STORAGE_READ_AHEAD_KB * 1024)
+#define CLMT_INITIAL_SIZE   (1 + 2 * 8 + 1)     // Fast seek table for up to 8 fragments, grown when needed
+#define BENCH_MAX_BYTES     (2 * 1024 * 1024)
+#define BENCH_CHUNK_SIZE    (32 * 1024)
+
+// Write-behind writer
+#define WRITE_CHUNK_SIZE    ALLOCATION_UNIT_SIZE
+#define WRITE_BUFFER_SIZE   ((CONFIG_STORAGE_WRITE_BUFFER_KB * 1024 + WRITE_CHUNK_SIZE - 1) / WRITE_CHUNK_SIZE * WRITE_CHUNK_SIZE)
+#define WRITE_SYNC_US       (CONFIG_STORAGE_WRITE_SYNC_S * 1000000LL)
+
+// Free space scan and telemetry
+#define SPACE_SCAN_SECTORS  64      // FAT sectors counted by each `storage_service()` call (32 KB)
+#define IO_RETRIES          2       // Extra attempts of a failed bulk read or write command
+
+#if !CONFIG_FATFS_USE_FASTSEEK
+#error "Bulk reads resolve the cluster chain with f_lseek(CREATE_LINKMAP), enable CONFIG_FATFS_USE_FASTSEEK"
+#endif
+#if !FF_USE_EXPAND
+#error "The write-behind writer preallocates files with f_expand(), FF_USE_EXPAND is required"
+#endif
+
 static const char *TAG = "storage";
 static bool is_mounted = false;
+static storage_bus_info_t bus_info;
+
+// Write-behind writer, see `storage_service()`
+static struct {
+    SemaphoreHandle_t lock;     // Protects the list, the ring positions and states of the writers, and the stats
+    storage_writer_t *writers;  // Oldest first
+    void (*notify)(void);
+    storage_write_stats_t stats;
+    int64_t busy_us;            // Time spent in card writes
+    uint64_t card_bytes;        // Data and metadata written since mounting, kept when the stats are reset
+} s_write;
+
+// Free space, counted once after mounting by `storage_service()`
+static struct {
+    FATFS *fs;
+    bool scanning;
+    uint32_t next_sector;       // Next FAT sector to count, from the start of the FAT
+    uint32_t free_clusters;     // Counted so far
+    uint8_t *buf;               // SPACE_SCAN_SECTORS sectors while scanning
+    int64_t start_us;
+} s_space;
+
+static storage_telemetry_t s_telemetry;
+static portMUX_TYPE s_telemetry_lock = portMUX_INITIALIZER_UNLOCKED;
+static const uint32_t latency_edges_us[STORAGE_LATENCY_BUCKETS - 1] = STORAGE_LATENCY_EDGES_US;
+
+// Clocks tried after mounting, in increasing order
+static const uint32_t sd_probe_freqs_khz[] = { 20000, 26000, 40000 };
 
 sdmmc_card_t *card;
 const char mount_point[] = MOUNT_POINT;
 
-// By default, SD card frequency is initialized to SDMMC_FREQ_DEFAULT (20MHz)
-// For setting a specific frequency, use host.max_freq_khz (range 400kHz - 20MHz for SDSPI)
-// Example: for fixed frequency of 10MHz, use host.max_freq_khz = 10000;
+// The card is mounted at CONFIG_STORAGE_SD_INIT_FREQ_KHZ, then `sd_negotiate_clock()` raises the clock
 sdmmc_host_t host = SDSPI_HOST_DEFAULT();
 
-esp_err_t i2c_master_init(void)
+static bool s_expander = false;     // Reference taken on the CH422G
+
+static void expander_close(void)
 {
-    int i2c_master_port = I2C_MASTER_NUM;
+    if (s_expander) {
+        ch422g_deinit();
+        s_expander = false;
+    }
+}
 
-    // Configure I2C parameters
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,                // Set to master mode
-        .sda_io_num = I2C_MASTER_SDA_IO,        // Set SDA pin
-        .scl_io_num = I2C_MASTER_SCL_IO,        // Set SCL pin
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,    // Enable SDA pull-up
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,    // Enable SCL pull-up
-        .master.clk_speed = I2C_MASTER_FREQ_HZ, // Set I2C clock speed
-    };
+static esp_err_t sd_set_clock(uint32_t freq_khz)
+{
+    // After mounting, `card->host.slot` is the SDSPI device handle
+    esp_err_t ret = sdspi_host_set_card_clk(card->host.slot, freq_khz);
+    if (ret == ESP_OK) {
+        int real_khz = 0;
+        sdspi_host_get_real_freq(card->host.slot, &real_khz);
+        card->max_freq_khz = freq_khz;
+        card->real_freq_khz = real_khz;
+    }
+    return ret;
+}
 
-    esp_err_t err;
+static esp_err_t sd_read_probe(uint8_t *buf)
+{
+    return sdmmc_read_sectors(card, buf, 0, SD_PROBE_SECTORS);
+}
 
-    // Apply I2C configuration
-    err = i2c_param_config(i2c_master_port, &conf);
-    if (err != ESP_OK) {
-        ESP_LOGE("i2c", "i2c_param_config failed: %s", esp_err_to_name(err));
-        return err;
+// Raw sector read throughput at the current clock, in [KB/s]
+static uint32_t sd_measure_throughput(uint8_t *buf)
+{
+    const int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < SD_BENCH_ROUNDS; i++) {
+        if (sd_read_probe(buf) != ESP_OK) {
+            return 0;
+        }
     }
+    const int64_t elapsed_us = esp_timer_get_time() - start_us;
+    const uint64_t bytes = (uint64_t)SD_BENCH_ROUNDS * SD_PROBE_SECTORS * card->csd.sector_size;
+    return elapsed_us > 0 ? (uint32_t)(bytes * 1000000 / 1024 / elapsed_us) : 0;
+}
 
-    // Install I2C driver
-    err = i2c_driver_install(i2c_master_port, conf.mode,
-                             I2C_MASTER_RX_BUF_DISABLE,
-                             I2C_MASTER_TX_BUF_DISABLE, 0);
-    if (err != ESP_OK) {
-        ESP_LOGE("i2c", "i2c_driver_install failed: %s", esp_err_to_name(err));
+/**
+ * Raise the SD clock step by step. Each step must read the probe sectors without CRC error or timeout and return
+ * the same data as at the mount clock, otherwise the previous clock is restored and the negotiation stops.
+ */
+static void sd_negotiate_clock(void)
+{
+    const size_t probe_bytes = SD_PROBE_SECTORS * card->csd.sector_size;
+    uint8_t *reference = heap_caps_malloc(probe_bytes, MALLOC_CAP_DMA);
+    uint8_t *readback = heap_caps_malloc(probe_bytes, MALLOC_CAP_DMA);
+    uint32_t good_khz = CONFIG_STORAGE_SD_INIT_FREQ_KHZ;
+
+    memset(&bus_info, 0, sizeof(bus_info));
+    if (!reference || !readback) {
+        ESP_LOGW(TAG, "No memory for the SD clock probe, staying at %lu kHz", (unsigned long)good_khz);
+        goto out;
+    }
+    if (sd_read_probe(reference) != ESP_OK) {
+        ESP_LOGW(TAG, "SD probe read failed, staying at %lu kHz", (unsigned long)good_khz);
+        goto out;
     }
 
-    return err;
+    for (size_t i = 0; i < sizeof(sd_probe_freqs_khz) / sizeof(sd_probe_freqs_khz[0]); i++) {
+        const uint32_t freq_khz = sd_probe_freqs_khz[i];
+        if (freq_khz <= good_khz || freq_khz > CONFIG_STORAGE_SD_MAX_FREQ_KHZ) {
+            continue;
+        }
+        esp_err_t ret = sd_set_clock(freq_khz);
+        if (ret == ESP_OK) {
+            ret = sd_read_probe(readback);
+        }
+        if (ret == ESP_OK && memcmp(reference, readback, probe_bytes) != 0) {
+            ret = ESP_ERR_INVALID_RESPONSE;
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "SD clock %lu kHz failed (%s), falling back to %lu kHz",
+                     (unsigned long)freq_khz, esp_err_to_name(ret), (unsigned long)good_khz);
+            bus_info.probe_failures++;
+            sd_set_clock(good_khz);
+            if (sd_read_probe(readback) != ESP_OK || memcmp(reference, readback, probe_bytes) != 0) {
+                ESP_LOGE(TAG, "SD card did not recover at %lu kHz", (unsigned long)good_khz);
+            }
+            break; // Higher clocks won't do better
+        }
+        good_khz = freq_khz;
+    }
+    bus_info.read_kbps = sd_measure_throughput(readback);
+
+out:
+    bus_info.freq_khz = card->real_freq_khz ? card->real_freq_khz : good_khz;
+    ESP_LOGI(TAG, "SD clock %lu kHz, raw read %lu KB/s", (unsigned long)bus_info.freq_khz,
+             (unsigned long)bus_info.read_kbps);
+    heap_caps_free(reference);
+    heap_caps_free(readback);
 }
 
-esp_err_t storage_mount_sdcard()
+static void telemetry_init(void)
+{
+    const sdmmc_cid_t *cid = &card->cid;
+    storage_telemetry_t t = {
+        .manufacturer_id = (uint8_t)cid->mfg_id,
+        .oem_id = (uint16_t)cid->oem_id,
+        .revision = (uint8_t)cid->revision,
+        .serial = (uint32_t)cid->serial,
+        .mfg_year = (uint16_t)(2000 + (cid->date >> 4)),
+        .mfg_month = (uint8_t)(cid->date & 0xF),
+        .csd_max_khz = (uint32_t)card->csd.tr_speed / 1000,
+        .au_kb = card->ssr.alloc_unit_kb,
+        .bus = bus_info,
+    };
+    memcpy(t.product, cid->name, sizeof(t.product) - 1);   // Not always terminated
+
+    portENTER_CRITICAL(&s_telemetry_lock);
+    s_telemetry = t;
+    portEXIT_CRITICAL(&s_telemetry_lock);
+}
+
+static void telemetry_add_io(bool write, size_t bytes, int64_t elapsed_us, uint32_t retries, bool failed)
+{
+    size_t bucket = 0;
+    while (bucket < STORAGE_LATENCY_BUCKETS - 1 && elapsed_us > latency_edges_us[bucket]) {
+        bucket++;
+    }
+
+    portENTER_CRITICAL(&s_telemetry_lock);
+    if (write) {
+        s_telemetry.write_retries += retries;
+        s_telemetry.write_errors += failed ? 1 : 0;
+    } else {
+        s_telemetry.read_retries += retries;
+        s_telemetry.read_errors += failed ? 1 : 0;
+        s_telemetry.bytes_read += failed ? 0 : bytes;
+        s_telemetry.read_latency[bucket]++;
+    }
+    portEXIT_CRITICAL(&s_telemetry_lock);
+}
+
+// Bulk sector transfers, retried and accounted in the telemetry. The latency is that of the last attempt.
+static esp_err_t card_transfer(bool write, void *buf, uint32_t sector, uint32_t count)
 {
     esp_err_t ret;
-    // Initialize I2C
-    ESP_RETURN_ON_ERROR(i2c_bus_acquire(), TAG, "I2C bus acquire failed");
+    int64_t elapsed_us;
+    uint32_t retries = 0;
+    for (;;) {
+        const int64_t start_us = esp_timer_get_time();
+        ret = write ? sdmmc_write_sectors(card, buf, sector, count) : sdmmc_read_sectors(card, buf, sector, count);
+        elapsed_us = esp_timer_get_time() - start_us;
+        if (ret == ESP_OK || retries == IO_RETRIES) {
+            break;
+        }
+        retries++;
+    }
+    telemetry_add_io(write, (size_t)count * card->csd.sector_size, elapsed_us, retries, ret != ESP_OK);
+    return ret;
+}
 
-    // ret = i2c_master_init();
-    // if (ret != ESP_OK) {
-    //     ESP_LOGE(TAG, "i2c_master_init failed: %s", esp_err_to_name(ret));
-    //     return ESP_FAIL;
-    // }
+static esp_err_t card_read(void *dst, uint32_t sector, uint32_t count)
+{
+    return card_transfer(false, dst, sector, count);
+}
 
-    // Control CH422G to pull down the CS pin of the SD
-    uint8_t write_buf = 0x01;
-    ret = i2c_master_write_to_device(I2C_MASTER_NUM, 0x24, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "I2C write to 0x24 failed: %s", esp_err_to_name(ret));
-        return ESP_FAIL;
+static esp_err_t card_write(const void *src, uint32_t sector, uint32_t count)
+{
+    return card_transfer(true, (void *)src, sector, count);
+}
+
+// Start counting the free clusters in the background, unless FatFs already knows them from the FSInfo sector
+static void space_scan_start(void)
+{
+    memset(&s_space, 0, sizeof(s_space));
+
+    char root[8];
+    snprintf(root, sizeof(root), "%u:/", (unsigned)ff_diskio_get_pdrv_card(card));
+    FF_DIR dir;
+    if (f_opendir(&dir, root) != FR_OK) {
+        ESP_LOGW(TAG, "Can't open the root directory, no free space figure");
+        return;
     }
+    s_space.fs = dir.obj.fs;
+    f_closedir(&dir);
 
-    write_buf = 0x0A;
-    ret = i2c_master_write_to_device(I2C_MASTER_NUM, 0x38, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
+    if (s_space.fs->free_clst <= s_space.fs->n_fatent - 2) {
+        return;
+    }
+    s_space.scanning = true;
+    s_space.start_us = esp_timer_get_time();
+    if (s_write.notify) {
+        s_write.notify();       // Remounted: the I/O task is already running
+    }
+}
+
+esp_err_t storage_mount_sdcard()
+{
+    esp_err_t ret;
+    // Control CH422G to pull down the CS pin of the SD
+    if (!s_expander) {
+        ESP_RETURN_ON_ERROR(ch422g_init(), TAG, "CH422G not reachable");
+        s_expander = true;
+    }
+    ret = ch422g_set_level(CH422G_IO_SD_CS, 0);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "I2C write to 0x38 failed: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "CH422G write failed: %s", esp_err_to_name(ret));
+        expander_close();
         return ESP_FAIL;
     }
 
@@ -116,9 +317,14 @@ esp_err_t storage_mount_sdcard()
         .format_if_mount_failed = false, // If mount fails, do not format card
 #endif
         .max_files = 5,                   // Maximum number of files
-        .allocation_unit_size = 16 * 1024 // Set allocation unit size
+        .allocation_unit_size = ALLOCATION_UNIT_SIZE // Set allocation unit size
     };
 
+    if (!s_write.lock) {
+        s_write.lock = xSemaphoreCreateMutex();
+        ESP_RETURN_ON_FALSE(s_write.lock, ESP_ERR_NO_MEM, TAG, "No memory for the writer lock");
+    }
+
     // Initializing SD card
     ESP_LOGW(TAG, "Initializing SD card");
 
@@ -129,10 +335,10 @@ esp_err_t storage_mount_sdcard()
         .sclk_io_num = PIN_NUM_CLK,  // Set SCLK pin
         .quadwp_io_num = -1,         // Not used
         .quadhd_io_num = -1,         // Not used
-        .max_transfer_sz = 4*1024,     // Maximum transfer size
+        .max_transfer_sz = CONFIG_STORAGE_SD_MAX_TRANSFER_KB * 1024, // Maximum DMA transfer size
     };
 
-    host.max_freq_khz = 10000; // Set maximum frequency to 5MHz
+    host.max_freq_khz = CONFIG_STORAGE_SD_INIT_FREQ_KHZ; // Mount clock, raised by `sd_negotiate_clock()`
     host.command_timeout_ms = 500;  // extend timeout to 500ms
 
     // Initialize SPI bus
@@ -155,10 +361,13 @@ esp_err_t storage_mount_sdcard()
     // Filesystem mounted
     ESP_LOGI(TAG, "Filesystem mounted");
     is_mounted = true;
+    sd_negotiate_clock();
+    telemetry_init();
+    space_scan_start();
     return ESP_OK;
 
 cleanup:
-    i2c_bus_release();
+    expander_close();
     if (ret != ESP_OK){
         spi_bus_free(host.slot); // release if failed in initialization
     }
@@ -171,6 +380,8 @@ esp_err_t storage_unmount_sdcard(void){
     // Unmount the filesystem
     esp_vfs_fat_sdcard_unmount(mount_point, card);
     is_mounted = false;
+    heap_caps_free(s_space.buf);
+    memset(&s_space, 0, sizeof(s_space));
     ESP_LOGI(TAG, "SD card unmounted.");
 
     // Deinitialize SPI bus
@@ -184,14 +395,887 @@ bool storage_is_sdcard_mounted(void)
     return is_mounted;
 }
 
-// get SD card capacity information (dummy implementation)
+esp_err_t storage_get_bus_info(storage_bus_info_t *info)
+{
+    if (!info) return ESP_ERR_INVALID_ARG;
+    if (!is_mounted) return ESP_ERR_INVALID_STATE;
+
+    *info = bus_info;
+    return ESP_OK;
+}
+
+// A run of contiguous sectors of a file
+typedef struct {
+    uint32_t offset;            // File offset of the first sector
+    uint32_t sector;            // First card sector
+    uint32_t sectors;
+} storage_extent_t;
+
+struct storage_file_t {
+    uint32_t size;
+    uint32_t sector_size;
+    uint32_t n_extents;
+    storage_extent_t *extents;
+    uint8_t *ra_buf;            // Read-ahead buffer, DMA capable
+    uint32_t ra_offset;         // File offset of `ra_buf[0]`, sector aligned
+    uint32_t ra_len;            // Valid bytes in `ra_buf`
+    uint32_t next_offset;       // End of the last read, to detect sequential access
+};
+
+// Resolve the cluster chain with the FatFs fast seek table (CLMT) and turn it into sector runs
+static esp_err_t storage_file_map(FIL *fil, storage_file_t *file)
+{
+    UINT clmt_size = CLMT_INITIAL_SIZE;
+    DWORD *clmt = NULL;
+    FRESULT fr;
+
+    do {
+        DWORD *tbl = realloc(clmt, clmt_size * sizeof(DWORD));
+        if (!tbl) {
+            free(clmt);
+            return ESP_ERR_NO_MEM;
+        }
+        clmt = tbl;
+        clmt[0] = clmt_size;
+        fil->cltbl = clmt;
+        fr = f_lseek(fil, CREATE_LINKMAP);
+        clmt_size = clmt[0];    // Required size when FR_NOT_ENOUGH_CORE
+    } while (fr == FR_NOT_ENOUGH_CORE);
+    fil->cltbl = NULL;
+    if (fr != FR_OK) {
+        free(clmt);
+        return ESP_FAIL;
+    }
+
+    uint32_t n = 0;
+    for (DWORD *frag = clmt + 1; frag[0]; frag += 2) {
+        n++;
+    }
+    file->extents = calloc(n ? n : 1, sizeof(storage_extent_t));
+    if (!file->extents) {
+        free(clmt);
+        return ESP_ERR_NO_MEM;
+    }
+
+    const FATFS *fs = fil->obj.fs;
+    uint32_t offset = 0;
+    for (DWORD *frag = clmt + 1; frag[0]; frag += 2) {
+        storage_extent_t *ext = &file->extents[file->n_extents++];
+        ext->offset = offset;
+        ext->sector = (uint32_t)(fs->database + (LBA_t)(frag[1] - 2) * fs->csize);
+        ext->sectors = frag[0] * fs->csize;
+        offset += ext->sectors * file->sector_size;
+    }
+    free(clmt);
+    return ESP_OK;
+}
+
+// "/sdcard/dir/name" -> "<drive>:/dir/name"
+static esp_err_t storage_ff_path(const char *path, char *ff_path, size_t size)
+{
+    const size_t mp_len = strlen(mount_point);
+    if (strncmp(path, mount_point, mp_len) != 0 || path[mp_len] != '/') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int n = snprintf(ff_path, size, "%u:%s", (unsigned)ff_diskio_get_pdrv_card(card), path + mp_len);
+    if (n < 0 || (size_t)n >= size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_file_open(const char *path, storage_file_t **file)
+{
+    if (!path || !file) return ESP_ERR_INVALID_ARG;
+    if (!is_mounted) return ESP_ERR_INVALID_STATE;
+
+    char ff_path[MAX_FILE_CHAR_SIZE];
+    if (storage_ff_path(path, ff_path, sizeof(ff_path)) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    storage_file_t *f = calloc(1, sizeof(storage_file_t));
+    FIL *fil = calloc(1, sizeof(FIL));     // Holds a sector buffer, too large for the stack
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    FRESULT fr;
+    if (!f || !fil) {
+        goto err;
+    }
+    f->sector_size = card->csd.sector_size;
+    f->ra_buf = heap_caps_aligned_alloc(STORAGE_DMA_ALIGN, READ_AHEAD_SIZE, MALLOC_CAP_DMA);
+    if (!f->ra_buf) {
+        goto err;
+    }
+
+    fr = f_open(fil, ff_path, FA_READ);
+    if (fr != FR_OK) {
+        ret = (fr == FR_NO_FILE || fr == FR_NO_PATH) ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+        goto err;
+    }
+    f->size = (uint32_t)f_size(fil);
+    ret = storage_file_map(fil, f);
+    f_close(fil);
+    if (ret != ESP_OK) {
+        goto err;
+    }
+
+    free(fil);
+    *file = f;
+    return ESP_OK;
+
+err:
+    if (f) {
+        free(f->extents);
+        heap_caps_free(f->ra_buf);
+        free(f);
+    }
+    free(fil);
+    return ret;
+}
+
+uint32_t storage_file_size(const storage_file_t *file)
+{
+    return file ? file->size : 0;
+}
+
+static const storage_extent_t *storage_file_find(const storage_file_t *file, uint32_t offset)
+{
+    // Few fragments in practice, a linear scan is enough
+    for (uint32_t i = 0; i < file->n_extents; i++) {
+        const storage_extent_t *ext = &file->extents[i];
+        if (offset - ext->offset < ext->sectors * file->sector_size) {
+            return ext;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t storage_file_read(storage_file_t *file, uint32_t offset, void *buf, size_t size, size_t *len)
+{
+    if (!file || (!buf && size)) return ESP_ERR_INVALID_ARG;
+    if (!is_mounted) return ESP_ERR_INVALID_STATE;
+
+    size = offset < file->size ? (size < file->size - offset ? size : file->size - offset) : 0;
+    const bool sequential = (offset == file->next_offset);
+    const uint32_t ss = file->sector_size;
+    uint8_t *dst = buf;
+    size_t done = 0;
+    esp_err_t ret = ESP_OK;
+
+    while (done < size) {
+        const uint32_t pos = offset + done;
+        const size_t remain = size - done;
+
+        // Read-ahead hit
+        if (pos >= file->ra_offset && pos - file->ra_offset < file->ra_len) {
+            const size_t avail = file->ra_offset + file->ra_len - pos;
+            const size_t n = remain < avail ? remain : avail;
+            memcpy(dst + done, file->ra_buf + (pos - file->ra_offset), n);
+            done += n;
+            continue;
+        }
+
+        const storage_extent_t *ext = storage_file_find(file, pos);
+        if (!ext) {
+            ret = ESP_ERR_INVALID_SIZE;     // Cluster chain shorter than the file size
+            break;
+        }
+        const uint32_t first = (pos - ext->offset) / ss;
+        const uint32_t ext_left = ext->sectors - first;
+
+        // Whole sectors straight into the caller's buffer, as one multi-block read per extent. The SPI DMA can't
+        // write to PSRAM: such buffers are filled from the read-ahead buffer, a multi-block read of up to
+        // READ_AHEAD_SIZE at a time.
+        if (pos % ss == 0 && remain >= ss && ((uintptr_t)(dst + done) % STORAGE_DMA_ALIGN) == 0 &&
+                esp_ptr_dma_capable(dst + done)) {
+            const uint32_t count = remain / ss < ext_left ? remain / ss : ext_left;
+            ret = card_read(dst + done, ext->sector + first, count);
+            if (ret != ESP_OK) {
+                break;
+            }
+            done += count * ss;
+            continue;
+        }
+
+        // Partial sectors, unaligned or PSRAM buffer: fill the read-ahead buffer, all of it when streaming
+        uint32_t count = READ_AHEAD_SIZE / ss;
+        if (!sequential) {
+            const uint32_t need = (pos % ss + remain + ss - 1) / ss;
+            count = need < count ? need : count;
+        }
+        count = count < ext_left ? count : ext_left;
+        file->ra_len = 0;
+        ret = card_read(file->ra_buf, ext->sector + first, count);
+        if (ret != ESP_OK) {
+            break;
+        }
+        file->ra_offset = pos - pos % ss;
+        file->ra_len = count * ss;
+    }
+
+    file->next_offset = offset + done;
+    if (len) {
+        *len = done;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Bulk read failed at %lu: %s", (unsigned long)(offset + done), esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+void storage_file_close(storage_file_t *file)
+{
+    if (file) {
+        free(file->extents);
+        heap_caps_free(file->ra_buf);
+        free(file);
+    }
+}
+
+static uint32_t bench_kbps(size_t bytes, int64_t elapsed_us)
+{
+    return elapsed_us > 0 ? (uint32_t)((uint64_t)bytes * 1000000 / 1024 / elapsed_us) : 0;
+}
+
+esp_err_t storage_bench_read(const char *path, storage_read_bench_t *result)
+{
+    if (!path || !result) return ESP_ERR_INVALID_ARG;
+    if (!is_mounted) return ESP_ERR_INVALID_STATE;
+
+    struct stat st;
+    if (stat(path, &st) != 0 || st.st_size <= 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const size_t bytes = (size_t)st.st_size < BENCH_MAX_BYTES ? (size_t)st.st_size : BENCH_MAX_BYTES;
+    uint8_t *buf = heap_caps_aligned_alloc(STORAGE_DMA_ALIGN, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(result, 0, sizeof(*result));
+    result->file_bytes = bytes;
+    storage_file_t *file = NULL;
+    esp_err_t ret = ESP_OK;
+
+    // Current path: stdio over VFS/FatFs, in the chunk size of the SD I/O task
+    int64_t start_us = esp_timer_get_time();
+    FILE *f = fopen(path, "rb");
+    size_t rd = 0;
+    if (f) {
+        while (rd < bytes) {
+            const size_t chunk = bytes - rd < BENCH_CHUNK_SIZE ? bytes - rd : BENCH_CHUNK_SIZE;
+            const size_t n = fread(buf + rd, 1, chunk, f);
+            rd += n;
+            if (n < chunk) {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    if (rd != bytes) {
+        ret = ESP_FAIL;
+        goto out;
+    }
+    result->fread_kbps = bench_kbps(bytes, esp_timer_get_time() - start_us);
+
+    // Bulk path, opening (cluster map) included
+    start_us = esp_timer_get_time();
+    ret = storage_file_open(path, &file);
+    if (ret != ESP_OK) {
+        goto out;
+    }
+    for (rd = 0; rd < bytes && ret == ESP_OK; rd += BENCH_CHUNK_SIZE) {
+        const size_t chunk = bytes - rd < BENCH_CHUNK_SIZE ? bytes - rd : BENCH_CHUNK_SIZE;
+        ret = storage_file_read(file, rd, buf + rd, chunk, NULL);
+    }
+    result->bulk_kbps = bench_kbps(bytes, esp_timer_get_time() - start_us);
+    result->extents = file->n_extents;
+    storage_file_close(file);
+    if (ret != ESP_OK) {
+        goto out;
+    }
+
+    ESP_LOGI(TAG, "Read %lu bytes (%lu extents): fread %lu.%02lu MB/s, bulk %lu.%02lu MB/s",
+             (unsigned long)bytes, (unsigned long)result->extents,
+             (unsigned long)(result->fread_kbps / 1024), (unsigned long)(result->fread_kbps % 1024 * 100 / 1024),
+             (unsigned long)(result->bulk_kbps / 1024), (unsigned long)(result->bulk_kbps % 1024 * 100 / 1024));
+
+out:
+    heap_caps_free(buf);
+    return ret;
+}
+
+typedef enum {
+    WRITER_NEW,                 // File not created yet
+    WRITER_OPEN,
+    WRITER_FAILED,              // Data dropped, `status` holds the error
+} writer_state_t;
+
+struct storage_writer_t {
+    char ff_path[MAX_FILE_CHAR_SIZE];
+    uint32_t size_hint;
+    uint8_t *buf;               // Ring of WRITE_BUFFER_SIZE, a multiple of WRITE_CHUNK_SIZE
+    SemaphoreHandle_t event;    // Given when data left the ring and when the file is complete
+    // Protected by `s_write.lock`
+    uint32_t head;              // Bytes appended so far
+    uint32_t tail;              // Bytes written to the card so far, the file offset of the next chunk
+    writer_state_t state;
+    esp_err_t status;
+    bool closing;
+    bool detached;              // Closed without waiting, freed when complete
+    bool done;
+    storage_writer_t *next;
+    // Only used by the task calling `storage_service()`
+    FIL *fil;
+    uint32_t alloc_bytes;       // Bytes preallocated contiguously by f_expand(), written sector by sector
+    uint32_t first_sector;      // Of the preallocated clusters
+    uint32_t appended;          // Clusters allocated by f_write() since the last sync
+    int64_t sync_us;
+};
+
+// Sectors written to update the FAT (all copies) for `clusters` consecutive clusters
+static uint32_t fat_sectors(const FATFS *fs, uint32_t clusters)
+{
+    const uint32_t entry_bits = (fs->fs_type == FS_FAT12) ? 12 : (fs->fs_type == FS_FAT16) ? 16 : 32;
+    const uint32_t sector_bits = card->csd.sector_size * 8;
+    return clusters ? (clusters * entry_bits + sector_bits - 1) / sector_bits * fs->n_fats : 0;
+}
+
+// Sectors written by f_sync()/f_close(): the directory entry, the FSInfo sector and the FAT window
+static uint32_t sync_sectors(const storage_writer_t *w)
+{
+    const FATFS *fs = w->fil->obj.fs;
+    return 1 + (fs->fs_type == FS_FAT32 ? 1 : 0) + fat_sectors(fs, w->appended);
+}
+
+static esp_err_t ff_write_err(FRESULT fr)
+{
+    return (fr == FR_OK) ? ESP_OK : (fr == FR_INVALID_NAME || fr == FR_NO_PATH) ? ESP_ERR_INVALID_ARG : ESP_FAIL;
+}
+
+static void writer_notify(void)
+{
+    void (*notify)(void) = s_write.notify;
+    if (notify) {
+        notify();
+    }
+}
+
+static void writer_free(storage_writer_t *w)
+{
+    if (w->event) {
+        vSemaphoreDelete(w->event);
+    }
+    heap_caps_free(w->buf);
+    free(w);
+}
+
+esp_err_t storage_writer_open(const char *path, uint32_t size_hint, storage_writer_t **writer)
+{
+    if (!path || !writer) return ESP_ERR_INVALID_ARG;
+    if (!is_mounted) return ESP_ERR_INVALID_STATE;
+
+    storage_writer_t *w = calloc(1, sizeof(storage_writer_t));
+    if (!w) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (storage_ff_path(path, w->ff_path, sizeof(w->ff_path)) != ESP_OK) {
+        free(w);
+        return ESP_ERR_INVALID_ARG;
+    }
+    w->size_hint = size_hint;
+    w->buf = heap_caps_aligned_alloc(STORAGE_DMA_ALIGN, WRITE_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    w->event = xSemaphoreCreateBinary();
+    if (!w->buf || !w->event) {
+        writer_free(w);
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    storage_writer_t **link = &s_write.writers;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = w;
+    xSemaphoreGive(s_write.lock);
+
+    *writer = w;
+    writer_notify();
+    return ESP_OK;
+}
+
+esp_err_t storage_writer_write(storage_writer_t *writer, const void *data, size_t size)
+{
+    if (!writer || (!data && size)) return ESP_ERR_INVALID_ARG;
+
+    const uint8_t *src = data;
+    while (size > 0) {
+        xSemaphoreTake(s_write.lock, portMAX_DELAY);
+        const esp_err_t status = writer->status;
+        const uint32_t head = writer->head;
+        const uint32_t space = WRITE_BUFFER_SIZE - (head - writer->tail);
+        xSemaphoreGive(s_write.lock);
+        if (status != ESP_OK) {
+            return status;
+        }
+        if (space == 0) {
+            writer_notify();
+            xSemaphoreTake(writer->event, portMAX_DELAY);
+            continue;
+        }
+
+        // The free part of the ring is only touched here, the copy needs no lock
+        const uint32_t at = head % WRITE_BUFFER_SIZE;
+        size_t n = size < space ? size : space;
+        n = n < WRITE_BUFFER_SIZE - at ? n : WRITE_BUFFER_SIZE - at;
+        memcpy(writer->buf + at, src, n);
+
+        xSemaphoreTake(s_write.lock, portMAX_DELAY);
+        writer->head += n;
+        s_write.stats.bytes += n;
+        const bool ready = (writer->head - writer->tail >= WRITE_CHUNK_SIZE);
+        xSemaphoreGive(s_write.lock);
+        if (ready) {
+            writer_notify();
+        }
+        src += n;
+        size -= n;
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_writer_close(storage_writer_t *writer, bool wait)
+{
+    if (!writer) return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    writer->closing = true;
+    writer->detached = !wait;
+    xSemaphoreGive(s_write.lock);
+    writer_notify();
+    if (!wait) {
+        return ESP_OK;
+    }
+
+    bool done = false;
+    while (!done) {
+        xSemaphoreTake(writer->event, portMAX_DELAY);
+        xSemaphoreTake(s_write.lock, portMAX_DELAY);
+        done = writer->done;
+        xSemaphoreGive(s_write.lock);
+    }
+    const esp_err_t ret = writer->status;
+    writer_free(writer);
+    return ret;
+}
+
+// Create the file, contiguous when its size is known
+static esp_err_t writer_create(storage_writer_t *w)
+{
+    w->fil = calloc(1, sizeof(FIL));
+    if (!w->fil) {
+        return ESP_ERR_NO_MEM;
+    }
+    FRESULT fr = f_open(w->fil, w->ff_path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (fr != FR_OK) {
+        free(w->fil);
+        w->fil = NULL;
+        return ff_write_err(fr);
+    }
+    w->sync_us = esp_timer_get_time();
+    if (w->size_hint == 0) {
+        return ESP_OK;
+    }
+
+    fr = f_expand(w->fil, w->size_hint, 1);
+    if (fr == FR_DENIED) {
+        return ESP_OK;      // No free run that long, written cluster by cluster instead
+    }
+    if (fr == FR_OK) {
+        // Record the allocation right away: a power loss leaves a full size file, not lost clusters
+        fr = f_sync(w->fil);
+    }
+    if (fr != FR_OK) {
+        return ff_write_err(fr);
+    }
+    const FATFS *fs = w->fil->obj.fs;
+    const uint32_t cluster_bytes = fs->csize * card->csd.sector_size;
+    const uint32_t clusters = (w->size_hint + cluster_bytes - 1) / cluster_bytes;
+    w->alloc_bytes = clusters * cluster_bytes;
+    w->first_sector = (uint32_t)(fs->database + (LBA_t)(w->fil->obj.sclust - 2) * fs->csize);
+
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    s_write.stats.contiguous++;
+    s_write.stats.syncs++;
+    s_write.stats.meta_bytes += (uint64_t)(fat_sectors(fs, clusters) + sync_sectors(w)) * card->csd.sector_size;
+    s_write.card_bytes += (uint64_t)(fat_sectors(fs, clusters) + sync_sectors(w)) * card->csd.sector_size;
+    xSemaphoreGive(s_write.lock);
+    return ESP_OK;
+}
+
+// Write `n` bytes from the ring at the tail, a whole chunk or the end of the file
+static esp_err_t writer_write_chunk(storage_writer_t *w, uint32_t n)
+{
+    const uint32_t ss = card->csd.sector_size;
+    const uint32_t pos = w->tail;       // Only changed by this task, no lock needed to read it
+    uint8_t *src = w->buf + pos % WRITE_BUFFER_SIZE;
+    uint32_t data_bytes = 0;
+    uint32_t meta_sectors = 0;
+    bool synced = false;
+    esp_err_t ret = ESP_OK;
+
+    if (pos + n <= w->alloc_bytes) {
+        // Preallocated: whole sectors straight to the card, the padding is cut off when closing
+        const uint32_t sectors = (n + ss - 1) / ss;
+        memset(src + n, 0, sectors * ss - n);
+        ret = card_write(src, w->first_sector + pos / ss, sectors);
+        data_bytes = sectors * ss;
+    } else {
+        FRESULT fr = FR_OK;
+        UINT written = 0;
+        if (f_tell(w->fil) != pos) {
+            fr = f_lseek(w->fil, pos);
+        }
+        if (fr == FR_OK) {
+            fr = f_write(w->fil, src, n, &written);
+        }
+        if (fr == FR_OK && written < n) {
+            fr = FR_DENIED;     // Card full
+        }
+        ret = ff_write_err(fr);
+        data_bytes = (n + ss - 1) / ss * ss;
+        const uint32_t cluster_bytes = w->fil->obj.fs->csize * ss;
+        const uint32_t allocated = (pos > w->alloc_bytes ? pos : w->alloc_bytes) + cluster_bytes - 1;
+        const uint32_t needed = pos + n + cluster_bytes - 1;
+        if (needed / cluster_bytes > allocated / cluster_bytes) {
+            w->appended += needed / cluster_bytes - allocated / cluster_bytes;
+        }
+
+        // Lazy metadata: only long files not preallocated are synced before they are closed
+        if (ret == ESP_OK && esp_timer_get_time() - w->sync_us >= WRITE_SYNC_US) {
+            meta_sectors = sync_sectors(w);
+            ret = ff_write_err(f_sync(w->fil));
+            w->appended = 0;
+            w->sync_us = esp_timer_get_time();
+            synced = true;
+        }
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    w->tail += n;
+    s_write.stats.chunks++;
+    s_write.stats.syncs += synced ? 1 : 0;
+    s_write.stats.data_bytes += data_bytes;
+    s_write.stats.meta_bytes += (uint64_t)meta_sectors * ss;
+    s_write.card_bytes += data_bytes + (uint64_t)meta_sectors * ss;
+    xSemaphoreGive(s_write.lock);
+    xSemaphoreGive(w->event);
+    return ESP_OK;
+}
+
+// Everything is written: trim the preallocation and write the directory entry
+static esp_err_t writer_complete(storage_writer_t *w)
+{
+    const uint32_t ss = card->csd.sector_size;
+    const FATFS *fs = w->fil->obj.fs;
+    uint32_t meta_sectors = 0;
+    FRESULT fr = FR_OK;
+
+    if (w->alloc_bytes && w->tail != f_size(w->fil)) {
+        fr = f_lseek(w->fil, w->tail);      // Past the end, this grows the file into the preallocation
+        if (fr == FR_OK && w->tail < f_size(w->fil)) {
+            const uint32_t cluster_bytes = fs->csize * ss;
+            const uint32_t kept = (w->tail + cluster_bytes - 1) / cluster_bytes;
+            meta_sectors += fat_sectors(fs, w->alloc_bytes / cluster_bytes - kept);
+            fr = f_truncate(w->fil);
+        }
+    }
+    meta_sectors += sync_sectors(w);
+    const FRESULT fr_close = f_close(w->fil);
+    free(w->fil);
+    w->fil = NULL;
+
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    s_write.stats.syncs++;
+    s_write.stats.meta_bytes += (uint64_t)meta_sectors * ss;
+    s_write.card_bytes += (uint64_t)meta_sectors * ss;
+    xSemaphoreGive(s_write.lock);
+    return ff_write_err(fr != FR_OK ? fr : fr_close);
+}
+
+static void writer_fail(storage_writer_t *w, esp_err_t ret)
+{
+    ESP_LOGE(TAG, "Writing %s failed at %lu: %s", w->ff_path, (unsigned long)w->tail, esp_err_to_name(ret));
+    if (w->fil) {
+        f_close(w->fil);    // Keeps what was written
+        free(w->fil);
+        w->fil = NULL;
+    }
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    w->state = WRITER_FAILED;
+    w->status = ret;
+    w->tail = w->head;
+    xSemaphoreGive(s_write.lock);
+    xSemaphoreGive(w->event);   // Unblock a full `storage_writer_write()`
+}
+
+static void writer_finish(storage_writer_t *w)
+{
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    for (storage_writer_t **link = &s_write.writers; *link; link = &(*link)->next) {
+        if (*link == w) {
+            *link = w->next;
+            break;
+        }
+    }
+    if (w->status == ESP_OK) {
+        s_write.stats.files++;
+    } else {
+        s_write.stats.failed++;
+    }
+    w->done = true;
+    const bool detached = w->detached;
+    xSemaphoreGive(s_write.lock);
+
+    if (detached) {
+        writer_free(w);
+    } else {
+        xSemaphoreGive(w->event);
+    }
+}
+
+/**
+ * Count the free clusters in the next SPACE_SCAN_SECTORS sectors of the FAT, as f_getfree() would in one go.
+ * The last count is handed to FatFs, which then keeps it up to date on every allocation and release. FatFs ignores
+ * allocations while the count is invalid, so the writers wait for the end of the scan.
+ */
+static void space_scan_step(void)
+{
+    FATFS *fs = s_space.fs;
+    const uint32_t ss = card->csd.sector_size;
+
+    if (fs->fs_type != FS_FAT16 && fs->fs_type != FS_FAT32) {
+        // FAT12 volumes are small enough for one call
+        DWORD free_clusters;
+        FATFS *unused;
+        char root[8];
+        snprintf(root, sizeof(root), "%u:/", (unsigned)ff_diskio_get_pdrv_card(card));
+        if (f_getfree(root, &free_clusters, &unused) != FR_OK) {
+            ESP_LOGW(TAG, "f_getfree failed, no free space figure");
+        }
+        s_space.scanning = false;
+        return;
+    }
+
+    const uint32_t entry_size = (fs->fs_type == FS_FAT16) ? 2 : 4;
+    const uint32_t per_sector = ss / entry_size;
+    const uint32_t fat_sectors_used = (fs->n_fatent + per_sector - 1) / per_sector;
+    if (!s_space.buf) {
+        s_space.buf = heap_caps_aligned_alloc(STORAGE_DMA_ALIGN, SPACE_SCAN_SECTORS * ss,
+                                              MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_space.buf) {
+            ESP_LOGW(TAG, "No memory for the free space scan");
+            s_space.scanning = false;
+            return;
+        }
+    }
+
+    const uint32_t left = fat_sectors_used - s_space.next_sector;
+    const uint32_t count = left < SPACE_SCAN_SECTORS ? left : SPACE_SCAN_SECTORS;
+    const LBA_t first = fs->fatbase + s_space.next_sector;
+    if (card_read(s_space.buf, first, count) != ESP_OK) {
+        ESP_LOGW(TAG, "FAT read failed, no free space figure");
+        heap_caps_free(s_space.buf);
+        s_space.buf = NULL;
+        s_space.scanning = false;
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        // A FAT sector changed in the FatFs window but not written back yet is counted from the window
+        const uint8_t *src = (fs->wflag && fs->winsect == first + i) ? fs->win : s_space.buf + i * ss;
+        uint32_t cluster = (s_space.next_sector + i) * per_sector;
+        for (uint32_t j = 0; j < per_sector && cluster < fs->n_fatent; j++, cluster++, src += entry_size) {
+            uint32_t entry = src[0] | (uint32_t)src[1] << 8;
+            if (entry_size == 4) {
+                entry |= ((uint32_t)src[2] << 16 | (uint32_t)src[3] << 24) & 0x0FFFFFFF;
+            }
+            if (entry == 0 && cluster >= 2) {
+                s_space.free_clusters++;
+            }
+        }
+    }
+    s_space.next_sector += count;
+    if (s_space.next_sector < fat_sectors_used) {
+        return;
+    }
+
+    fs->free_clst = s_space.free_clusters;
+    fs->fsi_flag |= 1;          // Write the count to the FSInfo sector at the next sync
+    heap_caps_free(s_space.buf);
+    s_space.buf = NULL;
+    s_space.scanning = false;
+    ESP_LOGI(TAG, "Free space: %lu of %lu clusters, counted in %lld ms",
+             (unsigned long)s_space.free_clusters, (unsigned long)(fs->n_fatent - 2),
+             (long long)((esp_timer_get_time() - s_space.start_us) / 1000));
+}
+
+bool storage_service(void)
+{
+    if (!s_write.lock || !is_mounted) {
+        return false;
+    }
+    if (s_space.scanning) {
+        space_scan_step();
+        return true;
+    }
+
+    // Oldest writer with something to do: a file to create, a full chunk, or the end of the file
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    storage_writer_t *w = s_write.writers;
+    uint32_t pending = 0;
+    writer_state_t state = WRITER_NEW;
+    for (; w; w = w->next) {
+        pending = w->head - w->tail;
+        state = w->state;
+        if (state == WRITER_NEW || w->closing || (state == WRITER_OPEN && pending >= WRITE_CHUNK_SIZE)) {
+            break;
+        }
+    }
+    xSemaphoreGive(s_write.lock);
+    if (!w) {
+        return false;
+    }
+
+    if (state == WRITER_FAILED) {
+        writer_finish(w);
+        return true;
+    }
+
+    const int64_t start_us = esp_timer_get_time();
+    esp_err_t ret;
+    if (state == WRITER_NEW) {
+        ret = writer_create(w);
+        if (ret == ESP_OK) {
+            xSemaphoreTake(s_write.lock, portMAX_DELAY);
+            w->state = WRITER_OPEN;
+            xSemaphoreGive(s_write.lock);
+        }
+    } else if (pending > 0) {
+        ret = writer_write_chunk(w, pending < WRITE_CHUNK_SIZE ? pending : WRITE_CHUNK_SIZE);
+    } else {
+        ret = writer_complete(w);
+    }
+    const int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    s_write.busy_us += elapsed_us;
+    xSemaphoreGive(s_write.lock);
+
+    if (ret != ESP_OK) {
+        writer_fail(w, ret);
+    } else if (state == WRITER_OPEN && pending == 0) {
+        writer_finish(w);
+    }
+    return true;
+}
+
+void storage_set_notify(void (*notify)(void))
+{
+    s_write.notify = notify;
+}
+
+void storage_get_write_stats(storage_write_stats_t *stats, bool reset)
+{
+    if (!stats) return;
+    if (!s_write.lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    *stats = s_write.stats;
+    const uint64_t card_bytes = stats->data_bytes + stats->meta_bytes;
+    stats->write_kbps = bench_kbps(card_bytes, s_write.busy_us);
+    stats->amplification_pct = stats->bytes ? (uint32_t)(card_bytes * 100 / stats->bytes) : 0;
+    if (reset) {
+        memset(&s_write.stats, 0, sizeof(s_write.stats));
+        s_write.busy_us = 0;
+    }
+    xSemaphoreGive(s_write.lock);
+}
+
+void storage_log_write_stats(void)
+{
+    storage_write_stats_t st;
+    storage_get_write_stats(&st, false);
+    ESP_LOGI(TAG, "Writes: %lu files (%lu contiguous, %lu failed), %lu chunks, %lu syncs",
+             (unsigned long)st.files, (unsigned long)st.contiguous, (unsigned long)st.failed,
+             (unsigned long)st.chunks, (unsigned long)st.syncs);
+    ESP_LOGI(TAG, "Writes: %llu bytes -> %llu data + %llu metadata, amplification %lu.%02lu, %lu KB/s",
+             (unsigned long long)st.bytes, (unsigned long long)st.data_bytes, (unsigned long long)st.meta_bytes,
+             (unsigned long)(st.amplification_pct / 100), (unsigned long)(st.amplification_pct % 100),
+             (unsigned long)st.write_kbps);
+}
+
+// get SD card capacity information
 esp_err_t storage_get_card_info(uint64_t *total_bytes, uint64_t *used_bytes)
 {
+    if (!total_bytes || !used_bytes) return ESP_ERR_INVALID_ARG;
+    if (!is_mounted || !s_space.fs) return ESP_ERR_INVALID_STATE;
+    if (s_space.scanning) return ESP_ERR_NOT_FINISHED;
+
+    const FATFS *fs = s_space.fs;
+    const uint32_t clusters = fs->n_fatent - 2;
+    const uint32_t free_clusters = fs->free_clst <= clusters ? fs->free_clst : 0;
+    const uint64_t cluster_bytes = (uint64_t)fs->csize * card->csd.sector_size;
+    *total_bytes = clusters * cluster_bytes;
+    *used_bytes = (clusters - free_clusters) * cluster_bytes;
+    return ESP_OK;
+}
+
+esp_err_t storage_get_telemetry(storage_telemetry_t *telemetry)
+{
+    if (!telemetry) return ESP_ERR_INVALID_ARG;
     if (!is_mounted) return ESP_ERR_INVALID_STATE;
 
-    // NOTE: add actual implementation to retrieve SD card info
-    // For now, we return dummy values
-    *total_bytes = 0;
-    *used_bytes = 0;
+    portENTER_CRITICAL(&s_telemetry_lock);
+    *telemetry = s_telemetry;
+    portEXIT_CRITICAL(&s_telemetry_lock);
+    xSemaphoreTake(s_write.lock, portMAX_DELAY);
+    telemetry->bytes_written = s_write.card_bytes;
+    xSemaphoreGive(s_write.lock);
     return ESP_OK;
 }
+
+void storage_log_telemetry(void)
+{
+    storage_telemetry_t t;
+    if (storage_get_telemetry(&t) != ESP_OK) {
+        return;
+    }
+    ESP_LOGI(TAG, "Card: MID 0x%02x OEM 0x%04x \"%s\" rev %u.%u SN %08lx, made %04u-%02u",
+             t.manufacturer_id, t.oem_id, t.product, t.revision >> 4, t.revision & 0xF,
+             (unsigned long)t.serial, t.mfg_year, t.mfg_month);
+    ESP_LOGI(TAG, "Card: CSD max %lu kHz, AU %lu KB, bus %lu kHz (%lu KB/s, %lu probe failures)",
+             (unsigned long)t.csd_max_khz, (unsigned long)t.au_kb, (unsigned long)t.bus.freq_khz,
+             (unsigned long)t.bus.read_kbps, (unsigned long)t.bus.probe_failures);
+    ESP_LOGI(TAG, "Card: %llu bytes read, %llu written, read retries %lu errors %lu, write retries %lu errors %lu",
+             (unsigned long long)t.bytes_read, (unsigned long long)t.bytes_written,
+             (unsigned long)t.read_retries, (unsigned long)t.read_errors,
+             (unsigned long)t.write_retries, (unsigned long)t.write_errors);
+
+    char line[128];
+    int n = 0;
+    for (size_t i = 0; i < STORAGE_LATENCY_BUCKETS && n < (int)sizeof(line); i++) {
+        if (i < STORAGE_LATENCY_BUCKETS - 1) {
+            n += snprintf(line + n, sizeof(line) - n, " <=%lu:%lu", (unsigned long)latency_edges_us[i],
+                          (unsigned long)t.read_latency[i]);
+        } else {
+            n += snprintf(line + n, sizeof(line) - n, " more:%lu", (unsigned long)t.read_latency[i]);
+        }
+    }
+    ESP_LOGI(TAG, "Card: read latency [us]%s", line);
+}
@@ -3,11 +3,24 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define STORAGE_DMA_ALIGN   (64)    // Alignment of buffers read from or written to the card, a PSRAM cache line
+
+/**
+ * @brief SD bus settings negotiated when mounting
+ */
+typedef struct {
+    uint32_t freq_khz;          // SPI clock of the card
+    uint32_t read_kbps;         // Raw sector read throughput measured at that clock, in [KB/s]
+    uint32_t probe_failures;    // Clocks that failed the read-back check
+} storage_bus_info_t;
+
 /**
  * @brief Mount SD card and initialize storage
  * @return ESP_OK on success, error code on failure
@@ -25,14 +38,217 @@ esp_err_t storage_unmount_sdcard(void);
  */
 bool storage_is_sdcard_mounted(void);
 
+/**
+ * @brief Get the SD clock and throughput negotiated by the last mount
+ * @param info Bus information
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if no card is mounted
+ */
+esp_err_t storage_get_bus_info(storage_bus_info_t *info);
+
+/**
+ * @brief A file opened for bulk reads, see `storage_file_open()`
+ */
+typedef struct storage_file_t storage_file_t;
+
+/**
+ * @brief Result of `storage_bench_read()`
+ */
+typedef struct {
+    uint32_t file_bytes;        // Bytes read by each path
+    uint32_t extents;           // Contiguous cluster runs of the file
+    uint32_t fread_kbps;        // Through VFS/FatFs with fread, in [KB/s]
+    uint32_t bulk_kbps;         // Through `storage_file_read()`, in [KB/s]
+} storage_read_bench_t;
+
+/**
+ * @brief Open a file for bulk reads
+ *
+ * The cluster chain of the file is resolved once into contiguous sector runs, then reads bypass FatFs and go to the
+ * card as multi-block reads. Whole sectors are read straight into the caller's buffer when it is DMA capable
+ * internal RAM aligned to STORAGE_DMA_ALIGN. Everything else, PSRAM buffers included (the SPI DMA can't reach
+ * them), goes through an internal read-ahead buffer of CONFIG_STORAGE_READ_AHEAD_KB and is copied from there.
+ * Bulk reads don't take the FatFs lock: use them from the task that owns the card (see sd_io.h) and never
+ * on a file that is being written.
+ *
+ * @param path Path under the mount point, e.g. "/sdcard/slides/IMG0001.JPG"
+ * @param file Returns the file
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Path not on the card or too long
+ *      - ESP_ERR_INVALID_STATE: Card not mounted
+ *      - ESP_ERR_NOT_FOUND: No such file
+ *      - ESP_ERR_NO_MEM: Out of memory
+ *      - ESP_FAIL: Filesystem error
+ */
+esp_err_t storage_file_open(const char *path, storage_file_t **file);
+
+/**
+ * @brief Size of a file opened by `storage_file_open()`
+ */
+uint32_t storage_file_size(const storage_file_t *file);
+
+/**
+ * @brief Read from a file opened by `storage_file_open()`
+ *
+ * @param len Returns the bytes read, short only at the end of the file, can be NULL
+ * @return ESP_OK on success, or the error of the SD read
+ */
+esp_err_t storage_file_read(storage_file_t *file, uint32_t offset, void *buf, size_t size, size_t *len);
+
+/**
+ * @brief Close a file opened by `storage_file_open()`
+ */
+void storage_file_close(storage_file_t *file);
+
+/**
+ * @brief Read a whole file with fread and with `storage_file_read()` and compare the throughput
+ *
+ * Reads up to 2 MB of the file into PSRAM with each path. Run it while nothing else uses the card.
+ *
+ * @param path Path under the mount point
+ * @param result Measured throughput
+ * @return ESP_OK on success, error code on failure
+ */
+esp_err_t storage_bench_read(const char *path, storage_read_bench_t *result);
+
+/**
+ * @brief A file being written behind, see `storage_writer_open()`
+ */
+typedef struct storage_writer_t storage_writer_t;
+
+/**
+ * @brief Statistics of the write-behind writer
+ */
+typedef struct {
+    uint32_t files;             // Files completed
+    uint32_t failed;            // Files dropped after an error
+    uint32_t contiguous;        // Files preallocated in one run of clusters
+    uint32_t chunks;            // Card writes, one cluster at most each
+    uint32_t syncs;             // Metadata flushes, closing included
+    uint64_t bytes;             // Bytes handed to the writer
+    uint64_t data_bytes;        // Bytes written to the card, sector padding included
+    uint64_t meta_bytes;        // Directory, FAT and FSInfo sectors written, estimated from the FatFs calls made
+    uint32_t write_kbps;        // Card throughput while writing, in [KB/s]
+    uint32_t amplification_pct; // (data_bytes + meta_bytes) / bytes, in [%]
+} storage_write_stats_t;
+
+/**
+ * @brief Create a file and write it behind
+ *
+ * Data is buffered in PSRAM and written to the card by `storage_service()`, which the SD I/O task calls
+ * when no read is pending, one cluster (the 16 KB allocation unit) at a time. A file of known size is allocated
+ * contiguously with f_expand() up front and its clusters are written straight to the card as multi-block writes;
+ * other files go through f_write() in whole clusters. Metadata is only written when the file is closed, and every
+ * CONFIG_STORAGE_WRITE_SYNC_S seconds for long files that could not be preallocated.
+ *
+ * @param path Path under the mount point, an existing file is replaced
+ * @param size_hint Expected size of the file, 0 if unknown
+ * @param writer Returns the writer
+ * @return
+ *      - ESP_OK: Success, the file is created by the SD I/O task
+ *      - ESP_ERR_INVALID_ARG: Path not on the card or too long
+ *      - ESP_ERR_INVALID_STATE: Card not mounted
+ *      - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t storage_writer_open(const char *path, uint32_t size_hint, storage_writer_t **writer);
+
+/**
+ * @brief Append data, blocks while the CONFIG_STORAGE_WRITE_BUFFER_KB buffer of the file is full
+ *
+ * @return ESP_OK, or the error that stopped the file: later data is dropped and `storage_writer_close()` returns it
+ */
+esp_err_t storage_writer_write(storage_writer_t *writer, const void *data, size_t size);
+
+/**
+ * @brief Close a writer, the rest of the file is written behind
+ *
+ * @param wait Wait until the file is complete on the card. Otherwise errors are only logged, and the writer is
+ *             freed by the SD I/O task.
+ * @return ESP_OK on success or when not waiting, otherwise the error that stopped the file
+ */
+esp_err_t storage_writer_close(storage_writer_t *writer, bool wait);
+
+/**
+ * @brief Do the next step of background card work, called by the task that owns the card when it has nothing else
+ *        to do: first the free space scan after mounting, then the pending data of the writers, a chunk each time
+ *
+ * @return true if anything was done and more work may be pending
+ */
+bool storage_service(void);
+
+/**
+ * @brief Set the function called when there is work for `storage_service()`
+ */
+void storage_set_notify(void (*notify)(void));
+
+/**
+ * @brief Get the statistics of the writer
+ *
+ * @param reset Clear them after reading
+ */
+void storage_get_write_stats(storage_write_stats_t *stats, bool reset);
+
+/**
+ * @brief Print the statistics of the writer with ESP_LOGI
+ */
+void storage_log_write_stats(void);
+
 /**
  * @brief Get SD card capacity information
+ *
+ * The free clusters are counted once after mounting by `storage_service()`, a few FAT sectors at a time. FatFs then
+ * keeps the count up to date on every allocation, so the result costs no card access.
+ *
  * @param total_bytes Total capacity in bytes
  * @param used_bytes Used capacity in bytes
- * @return ESP_OK on success, error code on failure
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: Card not mounted
+ *      - ESP_ERR_NOT_FINISHED: The free space is still being counted
  */
 esp_err_t storage_get_card_info(uint64_t *total_bytes, uint64_t *used_bytes);
 
+#define STORAGE_LATENCY_BUCKETS     (8)
+#define STORAGE_LATENCY_EDGES_US    { 500, 1000, 2000, 5000, 10000, 20000, 50000 }  // Upper bounds, the last is open
+
+/**
+ * @brief Identity and health of the card, to spot slow or wearing cards in the field
+ */
+typedef struct {
+    // CID register
+    uint8_t manufacturer_id;
+    uint16_t oem_id;
+    char product[8];            // Terminated
+    uint8_t revision;
+    uint32_t serial;
+    uint16_t mfg_year;
+    uint8_t mfg_month;
+    // Capabilities
+    uint32_t csd_max_khz;       // Highest transfer rate from the CSD register, in [kHz]
+    uint32_t au_kb;             // Allocation unit from the SD status, 0 if the card did not report it
+    storage_bus_info_t bus;     // Negotiated when mounting
+    // Since mounting
+    uint64_t bytes_read;        // By bulk reads and the free space scan, not through the VFS
+    uint64_t bytes_written;     // By the write-behind writer, metadata included
+    uint32_t read_latency[STORAGE_LATENCY_BUCKETS]; // Bulk read commands by duration, see STORAGE_LATENCY_EDGES_US
+    uint32_t read_retries;
+    uint32_t read_errors;       // Reads still failing after the retries
+    uint32_t write_retries;
+    uint32_t write_errors;
+} storage_telemetry_t;
+
+/**
+ * @brief Get the telemetry of the mounted card
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if no card is mounted
+ */
+esp_err_t storage_get_telemetry(storage_telemetry_t *telemetry);
+
+/**
+ * @brief Print the telemetry with ESP_LOGI
+ */
+void storage_log_telemetry(void);
+
 #ifdef __cplusplus
 }
 #endif
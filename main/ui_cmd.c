@@ -0,0 +1,165 @@
+#include "ui_cmd.h"
+
+#include "esp_log.h"
+#include "lvgl_mem.h"
+
+static const char *TAG = "ui_cmd";
+
+static lv_obj_t *s_overlay = NULL;      // Label on the top layer, created on first use
+static lv_timer_t *s_overlay_timer = NULL;
+static lv_obj_t *s_dim = NULL;          // Black layer for brightness levels below 255
+
+static esp_err_t ui_cmd_post(lvgl_port_cmd_t *cmd)
+{
+    esp_err_t ret = lvgl_port_post(cmd);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Post failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t ui_cmd_run(lvgl_port_cmd_cb_t run, void *user_data, lvgl_port_cmd_cb_t done)
+{
+    lvgl_port_cmd_t cmd = {
+        .run = run,
+        .done = done,
+        .user_data = user_data,
+    };
+    return ui_cmd_post(&cmd);
+}
+
+static void set_image_run(const lvgl_port_cmd_t *cmd)
+{
+    lv_img_set_src((lv_obj_t *)cmd->obj, cmd->data);
+}
+
+esp_err_t ui_cmd_set_image(lv_obj_t *img, const void *src, lvgl_port_cmd_cb_t done, void *user_data)
+{
+    if (!img || !src) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    lvgl_port_cmd_t cmd = {
+        .run = set_image_run,
+        .done = done,
+        .obj = img,
+        .data = src,
+        .user_data = user_data,
+    };
+    return ui_cmd_post(&cmd);
+}
+
+static void overlay_timer_cb(lv_timer_t *t)
+{
+    lv_timer_pause(t);
+    lv_obj_add_flag(s_overlay, LV_OBJ_FLAG_HIDDEN);
+}
+
+static void show_overlay_run(const lvgl_port_cmd_t *cmd)
+{
+    if (!s_overlay) {
+        s_overlay = lv_label_create(lv_layer_top());
+        lv_obj_set_style_bg_color(s_overlay, lv_color_black(), 0);
+        lv_obj_set_style_bg_opa(s_overlay, LV_OPA_60, 0);
+        lv_obj_set_style_text_color(s_overlay, lv_color_white(), 0);
+        lv_obj_set_style_pad_all(s_overlay, 8, 0);
+        lv_obj_align(s_overlay, LV_ALIGN_BOTTOM_MID, 0, -16);
+        s_overlay_timer = lv_timer_create(overlay_timer_cb, 1000, NULL);
+        lv_timer_pause(s_overlay_timer);
+    }
+    lv_label_set_text(s_overlay, (const char *)cmd->data);
+    lv_obj_clear_flag(s_overlay, LV_OBJ_FLAG_HIDDEN);
+
+    if (cmd->value > 0) {
+        lv_timer_set_period(s_overlay_timer, (uint32_t)cmd->value);
+        lv_timer_reset(s_overlay_timer);
+        lv_timer_resume(s_overlay_timer);
+    } else {
+        lv_timer_pause(s_overlay_timer);
+    }
+}
+
+esp_err_t ui_cmd_show_overlay(const char *text, uint32_t duration_ms)
+{
+    if (!text) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    lvgl_port_cmd_t cmd = {
+        .run = show_overlay_run,
+        .data = text,
+        .value = (intptr_t)duration_ms,
+    };
+    return ui_cmd_post(&cmd);
+}
+
+static void hide_overlay_run(const lvgl_port_cmd_t *cmd)
+{
+    if (s_overlay) {
+        lv_timer_pause(s_overlay_timer);
+        lv_obj_add_flag(s_overlay, LV_OBJ_FLAG_HIDDEN);
+    }
+}
+
+esp_err_t ui_cmd_hide_overlay(void)
+{
+    lvgl_port_cmd_t cmd = {
+        .run = hide_overlay_run,
+    };
+    return ui_cmd_post(&cmd);
+}
+
+static void set_brightness_run(const lvgl_port_cmd_t *cmd)
+{
+    const lv_opa_t opa = (lv_opa_t)(255 - cmd->value);
+
+    if (!s_dim) {
+        if (opa == LV_OPA_TRANSP) {
+            return;
+        }
+        s_dim = lv_obj_create(lv_layer_top());
+        lv_obj_remove_style_all(s_dim);
+        lv_obj_set_size(s_dim, LV_PCT(100), LV_PCT(100));
+        lv_obj_set_style_bg_color(s_dim, lv_color_black(), 0);
+        lv_obj_clear_flag(s_dim, LV_OBJ_FLAG_CLICKABLE);
+        lv_obj_move_background(s_dim); // Keep the overlay text readable
+    }
+    lv_obj_set_style_bg_opa(s_dim, opa, 0);
+    // A transparent layer would still be blended on every redraw
+    if (opa == LV_OPA_TRANSP) {
+        lv_obj_add_flag(s_dim, LV_OBJ_FLAG_HIDDEN);
+    } else {
+        lv_obj_clear_flag(s_dim, LV_OBJ_FLAG_HIDDEN);
+    }
+}
+
+esp_err_t ui_cmd_set_brightness(uint8_t level)
+{
+    lvgl_port_cmd_t cmd = {
+        .run = set_brightness_run,
+        .value = level,
+    };
+    return ui_cmd_post(&cmd);
+}
+
+static void log_mem_run(const lvgl_port_cmd_t *cmd)
+{
+    #if CONFIG_EXAMPLE_LVGL_MEM_POOLS
+    static lvgl_mem_snapshot_t baseline;
+    static bool has_baseline = false;
+
+    lvgl_mem_dump();
+    if (!has_baseline) {
+        lvgl_mem_snapshot(&baseline);
+        has_baseline = true;
+    } else {
+        lvgl_mem_report_leaks(&baseline, "UI");
+    }
+    #endif
+}
+
+esp_err_t ui_cmd_log_mem(void)
+{
+    lvgl_port_cmd_t cmd = {
+        .run = log_mem_run,
+    };
+    return ui_cmd_post(&cmd);
+}
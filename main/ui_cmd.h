@@ -0,0 +1,80 @@
+#ifndef UI_CMD_H
+#define UI_CMD_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "lvgl.h"
+#include "lvgl_port.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Typed commands for the LVGL task. All functions only post to the command queue of `lvgl_port` and return
+ * immediately, they can be called from any task. `done` (optional) is called from the LVGL task once the
+ * command has been applied, with `user_data` in `cmd->user_data`.
+ */
+
+/**
+ * @brief Run an arbitrary function in the LVGL task with the LVGL mutex held
+ *
+ * @return See `lvgl_port_post()`
+ */
+esp_err_t ui_cmd_run(lvgl_port_cmd_cb_t run, void *user_data, lvgl_port_cmd_cb_t done);
+
+/**
+ * @brief Set the source of an image object
+ *
+ * @param[in] img: Image object
+ * @param[in] src: Image source, must stay valid while it is shown
+ *
+ * @return See `lvgl_port_post()`
+ */
+esp_err_t ui_cmd_set_image(lv_obj_t *img, const void *src, lvgl_port_cmd_cb_t done, void *user_data);
+
+/**
+ * @brief Show a text overlay on top of the screen
+ *
+ * @param[in] text: Text to show, copied by LVGL when the command runs so it must stay valid until then
+ * @param[in] duration_ms: Time after which the overlay is hidden again, `0` keeps it until the next overlay
+ *
+ * @return See `lvgl_port_post()`
+ */
+esp_err_t ui_cmd_show_overlay(const char *text, uint32_t duration_ms);
+
+/**
+ * @brief Hide the text overlay
+ *
+ * @return See `lvgl_port_post()`
+ */
+esp_err_t ui_cmd_hide_overlay(void);
+
+/**
+ * @brief Set the screen brightness
+ *
+ * @note The backlight of the panel can only be switched on and off, lower levels dim the picture with a black
+ *       layer on top of the screen.
+ *
+ * @param[in] level: `255` is full brightness, `0` is black
+ *
+ * @return See `lvgl_port_post()`
+ */
+esp_err_t ui_cmd_set_brightness(uint8_t level);
+
+/**
+ * @brief Print the LVGL memory pools and the blocks held since the first call
+ *
+ * @note The first call records the baseline, e.g. after the first slideshow round once the overlay and the other
+ *       lazily created objects exist. Later calls report what the UI kept on top of it. Nothing is printed without
+ *       CONFIG_EXAMPLE_LVGL_MEM_POOLS.
+ *
+ * @return See `lvgl_port_post()`
+ */
+esp_err_t ui_cmd_log_mem(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UI_CMD_H
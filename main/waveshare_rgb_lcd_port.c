@@ -6,40 +6,62 @@
 
 #include "waveshare_rgb_lcd_port.h"
 #include "i2c_bus_mgr.h"
-
-// VSYNC event callback function
-IRAM_ATTR static bool rgb_lcd_on_vsync_event(esp_lcd_panel_handle_t panel, const esp_lcd_rgb_panel_event_data_t *edata, void *user_ctx)
-{
-    return lvgl_port_notify_rgb_vsync();
-}
+#include "ch422g.h"
+#include "perf_monitor.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include <string.h>
 
 // export panel hanlde
 static esp_lcd_panel_handle_t s_panel = NULL;
+static bool s_lvgl_attached = false;                       // Panel events may be forwarded to LVGL
+static int s_bounce_height = CONFIG_EXAMPLE_LCD_RGB_BOUNCE_BUFFER_HEIGHT; // Bounce buffer height in use
 
-#if CONFIG_EXAMPLE_LCD_TOUCH_CONTROLLER_GT911
+#if EXAMPLE_RGB_BOUNCE_BUFFER_SIZE > 0
 /**
- * @brief I2C master initialization
+ * Bounce buffer telemetry. The RGB driver refills the bounce buffers from the PSRAM frame buffer in its ISR,
+ * when PSRAM is saturated the refill falls behind the DMA and stale lines are sent out (screen shifting).
+ *  - late:     the last refill of a frame finished after the active area of that frame had already been sent
+ *  - underrun: a whole frame period passed without the refill of a frame completing
  */
-static esp_err_t i2c_master_init(void)
+static volatile int64_t s_vsync_us = 0;                    // Time of the last VSYNC
+static volatile bool s_bounce_done = true;                 // A bounce frame finished since the last VSYNC
+static uint32_t s_active_deadline_us = 0;                  // Time from VSYNC to the end of the active area
+
+static void bounce_update_deadline(uint32_t pclk_hz)
 {
-    int i2c_master_port = I2C_MASTER_NUM;
-
-    i2c_config_t i2c_conf = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_MASTER_SDA_IO,
-        .scl_io_num = I2C_MASTER_SCL_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2C_MASTER_FREQ_HZ,
-    };
+    const uint32_t line_px = EXAMPLE_LCD_HSYNC_PULSE_WIDTH + EXAMPLE_LCD_HSYNC_BACK_PORCH + EXAMPLE_LCD_H_RES + EXAMPLE_LCD_HSYNC_FRONT_PORCH;
+    const uint32_t lines = EXAMPLE_LCD_VSYNC_BACK_PORCH + EXAMPLE_LCD_V_RES;
+    s_active_deadline_us = (uint32_t)((uint64_t)line_px * lines * 1000000 / pclk_hz);
+}
 
-    // Configure I2C parameters
-    i2c_param_config(i2c_master_port, &i2c_conf);
+// VSYNC event callback function, only used for telemetry when bounce buffers are enabled
+IRAM_ATTR static bool rgb_lcd_on_vsync(esp_lcd_panel_handle_t panel, const esp_lcd_rgb_panel_event_data_t *edata, void *user_ctx)
+{
+    if (!s_bounce_done) {
+        perf_monitor_count(PERF_COUNTER_BOUNCE_UNDERRUN, 1);
+    }
+    s_bounce_done = false;
+    s_vsync_us = esp_timer_get_time();
+    return false;
+}
+#endif
 
-    // Install I2C driver
-    return i2c_driver_install(i2c_master_port, i2c_conf.mode, 0, 0, 0);
+// Bounce frame finish callback function, the frame buffer has been completely handed over to the LCD
+IRAM_ATTR static bool rgb_lcd_on_vsync_event(esp_lcd_panel_handle_t panel, const esp_lcd_rgb_panel_event_data_t *edata, void *user_ctx)
+{
+#if EXAMPLE_RGB_BOUNCE_BUFFER_SIZE > 0
+    int64_t vsync_us = s_vsync_us;
+    perf_monitor_count(PERF_COUNTER_BOUNCE_FRAMES, 1);
+    if (vsync_us != 0 && esp_timer_get_time() - vsync_us > s_active_deadline_us) {
+        perf_monitor_count(PERF_COUNTER_BOUNCE_LATE, 1);
+    }
+    s_bounce_done = true;
+#endif
+    return s_lvgl_attached ? lvgl_port_notify_rgb_vsync() : false;
 }
 
+#if CONFIG_EXAMPLE_LCD_TOUCH_CONTROLLER_GT911
 // GPIO initialization
 void gpio_init(void)
 {
@@ -58,39 +80,32 @@ void gpio_init(void)
 // Reset the touch screen
 void waveshare_esp32_s3_touch_reset()
 {
-    uint8_t write_buf = 0x01;
-    i2c_master_write_to_device(I2C_MASTER_NUM, 0x24, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
-
     // Reset the touch screen. It is recommended to reset the touch screen before using it.
-    write_buf = 0x2C;
-    i2c_master_write_to_device(I2C_MASTER_NUM, 0x38, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
+    ch422g_set_level(CH422G_IO_TP_RST, 0);
     esp_rom_delay_us(100 * 1000);
     gpio_set_level(GPIO_INPUT_IO_4, 0);
     esp_rom_delay_us(100 * 1000);
-    write_buf = 0x2E;
-    i2c_master_write_to_device(I2C_MASTER_NUM, 0x38, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
+    ch422g_set_level(CH422G_IO_TP_RST, 1);
     esp_rom_delay_us(200 * 1000);
 }
 
 #endif
 
-// Initialize RGB LCD
-esp_err_t waveshare_esp32_s3_rgb_lcd_init()
+// Create and start the RGB panel with the given bounce buffer height
+static esp_err_t rgb_panel_create(int bounce_height)
 {
-    ESP_LOGI(TAG, "Install RGB LCD panel driver"); // Log the start of the RGB LCD panel driver installation
-    // esp_lcd_panel_handle_t panel_handle = NULL; // Declare a handle for the LCD panel
     esp_lcd_rgb_panel_config_t panel_config = {
         .clk_src = LCD_CLK_SRC_DEFAULT, // Set the clock source for the panel
         .timings =  {
             .pclk_hz = EXAMPLE_LCD_PIXEL_CLOCK_HZ, // Pixel clock frequency
             .h_res = EXAMPLE_LCD_H_RES, // Horizontal resolution
             .v_res = EXAMPLE_LCD_V_RES, // Vertical resolution
-            .hsync_pulse_width = 4, // Horizontal sync pulse width
-            .hsync_back_porch = 8, // Horizontal back porch
-            .hsync_front_porch = 8, // Horizontal front porch
-            .vsync_pulse_width = 4, // Vertical sync pulse width
-            .vsync_back_porch = 8, // Vertical back porch
-            .vsync_front_porch = 8, // Vertical front porch
+            .hsync_pulse_width = EXAMPLE_LCD_HSYNC_PULSE_WIDTH, // Horizontal sync pulse width
+            .hsync_back_porch = EXAMPLE_LCD_HSYNC_BACK_PORCH, // Horizontal back porch
+            .hsync_front_porch = EXAMPLE_LCD_HSYNC_FRONT_PORCH, // Horizontal front porch
+            .vsync_pulse_width = EXAMPLE_LCD_VSYNC_PULSE_WIDTH, // Vertical sync pulse width
+            .vsync_back_porch = EXAMPLE_LCD_VSYNC_BACK_PORCH, // Vertical back porch
+            .vsync_front_porch = EXAMPLE_LCD_VSYNC_FRONT_PORCH, // Vertical front porch
             .flags = {
                 .pclk_active_neg = 1, // Active low pixel clock
             },
@@ -98,7 +113,7 @@ esp_err_t waveshare_esp32_s3_rgb_lcd_init()
         .data_width = EXAMPLE_RGB_DATA_WIDTH, // Data width for RGB
         .bits_per_pixel = EXAMPLE_RGB_BIT_PER_PIXEL, // Bits per pixel
         .num_fbs = LVGL_PORT_LCD_RGB_BUFFER_NUMS, // Number of frame buffers
-        .bounce_buffer_size_px = EXAMPLE_RGB_BOUNCE_BUFFER_SIZE, // Bounce buffer size in pixels
+        .bounce_buffer_size_px = EXAMPLE_LCD_H_RES * bounce_height, // Bounce buffer size in pixels
         .sram_trans_align = 4, // SRAM transaction alignment
         .psram_trans_align = 64, // PSRAM transaction alignment
         .hsync_gpio_num = EXAMPLE_LCD_IO_RGB_HSYNC, // GPIO number for horizontal sync
@@ -131,29 +146,139 @@ esp_err_t waveshare_esp32_s3_rgb_lcd_init()
     };
 
     // Create a new RGB panel with the specified configuration
-    ESP_ERROR_CHECK(esp_lcd_new_rgb_panel(&panel_config, &s_panel));
+    esp_err_t ret = esp_lcd_new_rgb_panel(&panel_config, &s_panel);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Create RGB panel failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
 
     ESP_LOGI(TAG, "Initialize RGB LCD panel"); // Log the initialization of the RGB LCD panel
     ESP_ERROR_CHECK(esp_lcd_panel_init(s_panel)); // Initialize the LCD panel
 
+    #if EXAMPLE_RGB_BOUNCE_BUFFER_SIZE > 0
+    s_vsync_us = 0;
+    s_bounce_done = true;
+    bounce_update_deadline(EXAMPLE_LCD_PIXEL_CLOCK_HZ);
+    #endif
+
+    // Register callbacks for RGB panel events
+    esp_lcd_rgb_panel_event_callbacks_t cbs = {
+        #if EXAMPLE_RGB_BOUNCE_BUFFER_SIZE > 0
+        .on_bounce_frame_finish = rgb_lcd_on_vsync_event, // Callback for bounce frame finish
+        .on_vsync = rgb_lcd_on_vsync, // Callback for vertical sync, bounce buffer telemetry
+        #else
+        .on_vsync = rgb_lcd_on_vsync_event, // Callback for vertical sync
+        #endif
+    };
+    ESP_ERROR_CHECK(esp_lcd_rgb_panel_register_event_callbacks(s_panel, &cbs, NULL)); // Register event callbacks
+
+    s_bounce_height = bounce_height;
+    return ESP_OK;
+}
+
+#if CONFIG_EXAMPLE_LCD_RGB_BOUNCE_AUTOTUNE && EXAMPLE_RGB_BOUNCE_BUFFER_SIZE > 0
+// Candidate heights, the frame buffer must be an even multiple of the bounce buffer
+static const int s_bounce_candidates[] = { 10, 16, 20, 24, 30, 40, 48, 60, 80 };
+
+#define BOUNCE_TUNE_LOAD_BUF_SIZE   (256 * 1024)    // Copies bigger than the cache, like a decoder streaming through PSRAM
+#define BOUNCE_TUNE_MEASURE_MS      (CONFIG_EXAMPLE_LCD_RGB_BOUNCE_AUTOTUNE_MEASURE_MS)
+
+static volatile bool s_tune_load_run = false;
+
+// Synthetic decode load, keeps PSRAM busy from one core until stopped
+static void bounce_tune_load_task(void *arg)
+{
+    SemaphoreHandle_t done = (SemaphoreHandle_t)arg;
+    uint8_t *src = heap_caps_malloc(BOUNCE_TUNE_LOAD_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    uint8_t *dst = heap_caps_malloc(BOUNCE_TUNE_LOAD_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    while (s_tune_load_run && src && dst) {
+        memcpy(dst, src, BOUNCE_TUNE_LOAD_BUF_SIZE);
+    }
+    heap_caps_free(src);
+    heap_caps_free(dst);
+    xSemaphoreGive(done);
+    vTaskDelete(NULL);
+}
+
+// Count late and underrun frames while both cores hammer PSRAM
+static uint32_t bounce_tune_measure(SemaphoreHandle_t done)
+{
+    uint32_t bad = perf_monitor_get_counter(PERF_COUNTER_BOUNCE_LATE) + perf_monitor_get_counter(PERF_COUNTER_BOUNCE_UNDERRUN);
+
+    s_tune_load_run = true;
+    for (int core = 0; core < 2; core++) {
+        xTaskCreatePinnedToCore(bounce_tune_load_task, "bb_load", 2048, done, 1, NULL, core);
+    }
+    vTaskDelay(pdMS_TO_TICKS(BOUNCE_TUNE_MEASURE_MS));
+    s_tune_load_run = false;
+    for (int core = 0; core < 2; core++) {
+        xSemaphoreTake(done, portMAX_DELAY);
+    }
+
+    return perf_monitor_get_counter(PERF_COUNTER_BOUNCE_LATE) + perf_monitor_get_counter(PERF_COUNTER_BOUNCE_UNDERRUN) - bad;
+}
+
+// Pick the smallest bounce buffer that stays underrun-free under load, the largest one is kept otherwise
+static esp_err_t rgb_panel_create_tuned(void)
+{
+    const int count = sizeof(s_bounce_candidates) / sizeof(s_bounce_candidates[0]);
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(2, 0);
+    if (!done) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_FAIL;
+    for (int i = 0; i < count; i++) {
+        const int height = s_bounce_candidates[i];
+        ret = rgb_panel_create(height);
+        if (ret != ESP_OK) {
+            continue;
+        }
+        uint32_t bad = bounce_tune_measure(done);
+        ESP_LOGI(TAG, "Bounce buffer height %d: %lu late/underrun frames", height, (unsigned long)bad);
+        if (bad == 0 || i == count - 1) {
+            break;
+        }
+        esp_lcd_panel_del(s_panel);
+        s_panel = NULL;
+    }
+
+    vSemaphoreDelete(done);
+    if (s_panel) {
+        ESP_LOGI(TAG, "Using bounce buffer height %d", s_bounce_height);
+    }
+    return s_panel ? ESP_OK : ret;
+}
+#endif /* CONFIG_EXAMPLE_LCD_RGB_BOUNCE_AUTOTUNE */
+
+// Initialize RGB LCD
+esp_err_t waveshare_esp32_s3_rgb_lcd_init()
+{
+    ESP_LOGI(TAG, "Install RGB LCD panel driver"); // Log the start of the RGB LCD panel driver installation
+#if CONFIG_EXAMPLE_LCD_RGB_BOUNCE_AUTOTUNE && EXAMPLE_RGB_BOUNCE_BUFFER_SIZE > 0
+    ESP_ERROR_CHECK(rgb_panel_create_tuned());
+#else
+    ESP_ERROR_CHECK(rgb_panel_create(CONFIG_EXAMPLE_LCD_RGB_BOUNCE_BUFFER_HEIGHT));
+#endif
+
     esp_lcd_touch_handle_t tp_handle = NULL; // Declare a handle for the touch panel
 
-    esp_err_t ret = i2c_bus_acquire();               // 取得
+    esp_err_t ret = ch422g_init();                   // 取得
     if (ret != ESP_OK) return ret;
 
     #if CONFIG_EXAMPLE_LCD_TOUCH_CONTROLLER_GT911
-    ESP_LOGI(TAG, "Initialize I2C bus"); // Log the initialization of the I2C bus
-    i2c_master_init(); // Initialize the I2C master
     ESP_LOGI(TAG, "Initialize GPIO"); // Log GPIO initialization
     gpio_init(); // Initialize GPIO pins
     ESP_LOGI(TAG, "Initialize Touch LCD"); // Log touch LCD initialization
     waveshare_esp32_s3_touch_reset(); // Reset the touch panel
 
     esp_lcd_panel_io_handle_t tp_io_handle = NULL; // Declare a handle for touch panel I/O
-    const esp_lcd_panel_io_i2c_config_t tp_io_config = ESP_LCD_TOUCH_IO_I2C_GT911_CONFIG(); // Configure I2C for GT911 touch controller
+    esp_lcd_panel_io_i2c_config_t tp_io_config = ESP_LCD_TOUCH_IO_I2C_GT911_CONFIG(); // Configure I2C for GT911 touch controller
+    tp_io_config.scl_speed_hz = I2C_MASTER_FREQ_HZ; // Required by the i2c_master driver
 
     ESP_LOGI(TAG, "Initialize I2C panel IO"); // Log I2C panel I/O initialization
-    ESP_ERROR_CHECK(esp_lcd_new_panel_io_i2c((esp_lcd_i2c_bus_handle_t)I2C_MASTER_NUM, &tp_io_config, &tp_io_handle)); // Create new I2C panel I/O
+    // Touch reads share the bus with the manager's transactions, serialized by the driver
+    ESP_ERROR_CHECK(esp_lcd_new_panel_io_i2c(i2c_bus_get_handle(), &tp_io_config, &tp_io_handle)); // Create new I2C panel I/O
 
     ESP_LOGI(TAG, "Initialize touch controller GT911"); // Log touch controller initialization
     const esp_lcd_touch_config_t tp_cfg = {
@@ -175,16 +300,7 @@ esp_err_t waveshare_esp32_s3_rgb_lcd_init()
     #endif // CONFIG_EXAMPLE_LCD_TOUCH_CONTROLLER_GT911
 
     ESP_ERROR_CHECK(lvgl_port_init(s_panel, tp_handle)); // Initialize LVGL with the panel and touch handles
-
-    // Register callbacks for RGB panel events
-    esp_lcd_rgb_panel_event_callbacks_t cbs = {
-        #if EXAMPLE_RGB_BOUNCE_BUFFER_SIZE > 0
-        .on_bounce_frame_finish = rgb_lcd_on_vsync_event, // Callback for bounce frame finish
-        #else
-        .on_vsync = rgb_lcd_on_vsync_event, // Callback for vertical sync
-        #endif
-    };
-    ESP_ERROR_CHECK(esp_lcd_rgb_panel_register_event_callbacks(s_panel, &cbs, NULL)); // Register event callbacks
+    s_lvgl_attached = true; // Forward panel events to LVGL from now on
 
     return ESP_OK; // Return success
 }
@@ -196,33 +312,113 @@ esp_lcd_panel_handle_t waveshare_rgb_lcd_get_panel(void)
 }
 
 
-/******************************* Turn on the screen backlight **************************************/
-esp_err_t wavesahre_rgb_lcd_bl_on()
+/******************************* Refresh rate **************************************/
+static waveshare_rgb_lcd_refresh_t s_refresh = WAVESHARE_RGB_LCD_REFRESH_NORMAL;
+
+esp_err_t waveshare_rgb_lcd_set_refresh(waveshare_rgb_lcd_refresh_t refresh)
 {
-    esp_err_t ret = i2c_bus_acquire();               // 取得
-    if (ret != ESP_OK) return ret;
+    if (!s_panel) {
+        return ESP_ERR_INVALID_STATE;
+    }
+#if CONFIG_EXAMPLE_LCD_ADAPTIVE_REFRESH
+    if (refresh == s_refresh) {
+        return ESP_OK;
+    }
+    uint32_t pclk_hz = (refresh == WAVESHARE_RGB_LCD_REFRESH_LOW) ? EXAMPLE_LCD_PIXEL_CLOCK_LOW_HZ : EXAMPLE_LCD_PIXEL_CLOCK_HZ;
+    esp_err_t ret = esp_lcd_rgb_panel_set_pclk(s_panel, pclk_hz); // Applied by the driver at the next VSYNC
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Set pixel clock %lu failed: %s", (unsigned long)pclk_hz, esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGD(TAG, "Pixel clock %lu Hz", (unsigned long)pclk_hz);
+#if EXAMPLE_RGB_BOUNCE_BUFFER_SIZE > 0
+    bounce_update_deadline(pclk_hz);
+#endif
+    s_refresh = refresh;
+#endif
+    return ESP_OK;
+}
 
-    //Configure CH422G to output mode
-    uint8_t write_buf = 0x01;
-    i2c_master_write_to_device(I2C_MASTER_NUM, 0x24, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
+int waveshare_rgb_lcd_get_bounce_height(void)
+{
+    return s_bounce_height;
+}
 
-    //Pull the backlight pin high to light the screen backlight
-    write_buf = 0x1E;
-    i2c_master_write_to_device(I2C_MASTER_NUM, 0x38, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
+waveshare_rgb_lcd_refresh_t waveshare_rgb_lcd_get_refresh(void)
+{
+    return s_refresh;
+}
+
+// Frames per second sent to the panel at `pclk_hz`, porches and sync pulses included
+static uint32_t refresh_hz(uint32_t pclk_hz)
+{
+    const uint32_t line_px = EXAMPLE_LCD_HSYNC_PULSE_WIDTH + EXAMPLE_LCD_HSYNC_BACK_PORCH + EXAMPLE_LCD_H_RES + EXAMPLE_LCD_HSYNC_FRONT_PORCH;
+    const uint32_t lines = EXAMPLE_LCD_VSYNC_PULSE_WIDTH + EXAMPLE_LCD_VSYNC_BACK_PORCH + EXAMPLE_LCD_V_RES + EXAMPLE_LCD_VSYNC_FRONT_PORCH;
+    return pclk_hz / (line_px * lines);
+}
+
+#define BENCH_PSRAM_BUF_SIZE    (512 * 1024)    // Bigger than the cache, so every copy really hits PSRAM
+#define BENCH_PSRAM_ROUNDS      (16)
+
+// Copy between two PSRAM buffers and return the bandwidth in KB/s
+static uint32_t bench_psram_copy(uint8_t *dst, const uint8_t *src)
+{
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < BENCH_PSRAM_ROUNDS; i++) {
+        memcpy(dst, src, BENCH_PSRAM_BUF_SIZE);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    return (uint32_t)((uint64_t)BENCH_PSRAM_BUF_SIZE * BENCH_PSRAM_ROUNDS * 1000000 / 1024 / elapsed_us);
+}
+
+esp_err_t waveshare_rgb_lcd_bench_psram(void)
+{
+    if (!s_panel) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t *src = heap_caps_malloc(BENCH_PSRAM_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    uint8_t *dst = heap_caps_malloc(BENCH_PSRAM_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!src || !dst) {
+        heap_caps_free(src);
+        heap_caps_free(dst);
+        return ESP_ERR_NO_MEM;
+    }
+    memset(src, 0x5A, BENCH_PSRAM_BUF_SIZE);
+
+    waveshare_rgb_lcd_refresh_t prev = s_refresh;
+    uint32_t kbps[2] = { 0 };
+    const waveshare_rgb_lcd_refresh_t modes[2] = { WAVESHARE_RGB_LCD_REFRESH_NORMAL, WAVESHARE_RGB_LCD_REFRESH_LOW };
+    for (int i = 0; i < 2; i++) {
+        waveshare_rgb_lcd_set_refresh(modes[i]);
+        vTaskDelay(pdMS_TO_TICKS(100)); // Let the new pixel clock take effect
+        kbps[i] = bench_psram_copy(dst, src);
+    }
+    waveshare_rgb_lcd_set_refresh(prev);
+
+    ESP_LOGI(TAG, "PSRAM copy: %lu KB/s @ %d MHz (%lu Hz), %lu KB/s @ %d MHz (%lu Hz) (+%ld%%)",
+             (unsigned long)kbps[0], EXAMPLE_LCD_PIXEL_CLOCK_HZ / 1000000,
+             (unsigned long)refresh_hz(EXAMPLE_LCD_PIXEL_CLOCK_HZ),
+             (unsigned long)kbps[1], EXAMPLE_LCD_PIXEL_CLOCK_LOW_HZ / 1000000,
+             (unsigned long)refresh_hz(EXAMPLE_LCD_PIXEL_CLOCK_LOW_HZ),
+             (long)(((int64_t)kbps[1] - kbps[0]) * 100 / kbps[0]));
+
+    heap_caps_free(src);
+    heap_caps_free(dst);
     return ESP_OK;
 }
 
+/******************************* Turn on the screen backlight **************************************/
+esp_err_t wavesahre_rgb_lcd_bl_on()
+{
+    //Pull the backlight pin high to light the screen backlight
+    return ch422g_set_level(CH422G_IO_DISP, 1);
+}
+
 /******************************* Turn off the screen backlight **************************************/
 esp_err_t wavesahre_rgb_lcd_bl_off()
 {
-    //Configure CH422G to output mode
-    uint8_t write_buf = 0x01;
-    i2c_master_write_to_device(I2C_MASTER_NUM, 0x24, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
-
     //Turn off the screen backlight by pulling the backlight pin low
-    write_buf = 0x1A;
-    i2c_master_write_to_device(I2C_MASTER_NUM, 0x38, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
-    return ESP_OK;
+    return ch422g_set_level(CH422G_IO_DISP, 0);
 }
 
 /******************************* Example code **************************************/
@@ -4,7 +4,6 @@
 #include "esp_log.h"
 #include "esp_heap_caps.h"
 #include "driver/gpio.h"
-#include "driver/i2c.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_lcd_panel_ops.h"
@@ -15,13 +14,7 @@
 
 #define CONFIG_EXAMPLE_LCD_TOUCH_CONTROLLER_GT911 0 // 1 initiates the touch, 0 closes the touch.
 
-#define I2C_MASTER_SCL_IO           9       /*!< GPIO number used for I2C master clock */
-#define I2C_MASTER_SDA_IO           8       /*!< GPIO number used for I2C master data  */
-#define I2C_MASTER_NUM              0       /*!< I2C master i2c port number, the number of i2c peripheral interfaces available will depend on the chip */
-#define I2C_MASTER_FREQ_HZ          400000                     /*!< I2C master clock frequency */
-#define I2C_MASTER_TX_BUF_DISABLE   0                          /*!< I2C master doesn't need buffer */
-#define I2C_MASTER_RX_BUF_DISABLE   0                          /*!< I2C master doesn't need buffer */
-#define I2C_MASTER_TIMEOUT_MS       1000
+#define I2C_MASTER_FREQ_HZ          400000  /*!< I2C clock of the touch controller, the bus itself is set up by i2c_bus_mgr */
 
 #define GPIO_INPUT_IO_4    4
 #define GPIO_INPUT_PIN_SEL  1ULL<<GPIO_INPUT_IO_4
@@ -31,6 +24,13 @@
 #define EXAMPLE_LCD_H_RES               (LVGL_PORT_H_RES)
 #define EXAMPLE_LCD_V_RES               (LVGL_PORT_V_RES)
 #define EXAMPLE_LCD_PIXEL_CLOCK_HZ      (16 * 1000 * 1000)
+#define EXAMPLE_LCD_PIXEL_CLOCK_LOW_HZ  (CONFIG_EXAMPLE_LCD_LOW_REFRESH_PCLK_MHZ * 1000 * 1000) // Used while static content is shown
+#define EXAMPLE_LCD_HSYNC_PULSE_WIDTH   (4)
+#define EXAMPLE_LCD_HSYNC_BACK_PORCH    (8)
+#define EXAMPLE_LCD_HSYNC_FRONT_PORCH   (8)
+#define EXAMPLE_LCD_VSYNC_PULSE_WIDTH   (4)
+#define EXAMPLE_LCD_VSYNC_BACK_PORCH    (8)
+#define EXAMPLE_LCD_VSYNC_FRONT_PORCH   (8)
 #define EXAMPLE_LCD_BIT_PER_PIXEL       (16)
 #define EXAMPLE_RGB_BIT_PER_PIXEL       (16)
 #define EXAMPLE_RGB_DATA_WIDTH          (16)
@@ -67,6 +67,17 @@
 
 static const char *TAG = "example";
 
+/**
+ * @brief Panel refresh rate
+ *
+ * The RGB DMA streams the whole frame buffer out of PSRAM every frame, lowering the pixel clock while a
+ * static image is shown leaves more PSRAM bandwidth to decoding.
+ */
+typedef enum {
+    WAVESHARE_RGB_LCD_REFRESH_NORMAL,   // EXAMPLE_LCD_PIXEL_CLOCK_HZ, for transitions and animations
+    WAVESHARE_RGB_LCD_REFRESH_LOW,      // EXAMPLE_LCD_PIXEL_CLOCK_LOW_HZ, for static content
+} waveshare_rgb_lcd_refresh_t;
+
 bool example_lvgl_lock(int timeout_ms);
 void example_lvgl_unlock(void);
 
@@ -77,6 +88,30 @@ esp_err_t wavesahre_rgb_lcd_bl_off();
 
 esp_lcd_panel_handle_t waveshare_rgb_lcd_get_panel(void);
 
+/**
+ * @brief Switch the panel refresh rate, takes effect from the next frame
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: The panel is not initialized
+ */
+esp_err_t waveshare_rgb_lcd_set_refresh(waveshare_rgb_lcd_refresh_t refresh);
+
+waveshare_rgb_lcd_refresh_t waveshare_rgb_lcd_get_refresh(void);
+
+/**
+ * @brief Get the bounce buffer height in use, in lines
+ *
+ * @note Differs from CONFIG_EXAMPLE_LCD_RGB_BOUNCE_BUFFER_HEIGHT when CONFIG_EXAMPLE_LCD_RGB_BOUNCE_AUTOTUNE is enabled.
+ *       Underruns are counted in PERF_COUNTER_BOUNCE_LATE / PERF_COUNTER_BOUNCE_UNDERRUN.
+ */
+int waveshare_rgb_lcd_get_bounce_height(void);
+
+/**
+ * @brief Measure PSRAM copy bandwidth with the normal and the low refresh rate and log the result
+ */
+esp_err_t waveshare_rgb_lcd_bench_psram(void);
+
 
 void example_lvgl_demo_ui();
 
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Convert photos for the panel and pack them into a flash album (see tools/pack_album.py).
+
+Every photo is turned upright from its EXIF orientation, scaled to fit the panel (or to fill it with --fill) and
+centered on black, then written as
+ - rgb565: an LVGL true color image, each channel Floyd-Steinberg dithered down to 5/6/5 bits by Pillow's quantizer.
+           Drawn straight from flash.
+ - jpeg:   a baseline JPEG at panel size with a restart marker after each MCU row.
+
+    tools/convert_assets.py --format rgb565 --pack build/album.bin assets/original/*.jpg
+
+Needs Pillow (pip install Pillow).
+"""
+
+import argparse
+import io
+import os
+import struct
+import sys
+
+try:
+    from PIL import Image, ImageChops, ImageOps
+except ImportError:
+    sys.exit('convert_assets.py needs Pillow: pip install Pillow')
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import pack_album  # noqa: E402
+
+EXTENSIONS = ('.jpg', '.jpeg', '.png', '.bmp')
+
+
+def fit(img, width, height, fill):
+    img = ImageOps.exif_transpose(img).convert('RGB')
+    if fill:
+        return ImageOps.fit(img, (width, height), Image.LANCZOS)
+    img = ImageOps.contain(img, (width, height), Image.LANCZOS)
+    canvas = Image.new('RGB', (width, height))
+    canvas.paste(img, ((width - img.width) // 2, (height - img.height) // 2))
+    return canvas
+
+
+def levels_palette(bits):
+    """Gray palette of the 2**bits levels of a channel, palette index = level."""
+    top = (1 << bits) - 1
+    palette = Image.new('P', (1, 1))
+    palette.putpalette([v for level in range(top + 1) for v in (level * 255 // top,) * 3] + [0] * 3 * (255 - top))
+    return palette
+
+
+def channel_levels(channel, bits):
+    """Floyd-Steinberg dither one channel down to `bits`, with Pillow's quantizer. Returns the levels as an L image."""
+    quantized = channel.convert('RGB').quantize(palette=levels_palette(bits), dither=Image.FLOYDSTEINBERG)
+    return Image.frombytes('L', quantized.size, quantized.tobytes())
+
+
+def to_rgb565(img, swap):
+    """Floyd-Steinberg dither to RGB565, returns the pixels in LVGL order (little endian, or swapped)."""
+    r, g, b = (channel_levels(c, bits) for c, bits in zip(img.split(), (5, 6, 5)))
+    low = ImageChops.add(g.point(lambda v: (v & 7) << 5), b)
+    high = ImageChops.add(r.point(lambda v: v << 3), g.point(lambda v: v >> 3))
+    return Image.merge('LA', (high, low) if swap else (low, high)).tobytes()
+
+
+def lvgl_bin(pixels, width, height):
+    header = pack_album.LV_IMG_CF_TRUE_COLOR | (width << 10) | (height << 21)
+    return struct.pack('<I', header) + pixels
+
+
+def convert(path, args):
+    with Image.open(path) as src:
+        img = fit(src, args.width, args.height, args.fill)
+    name = os.path.splitext(os.path.basename(path))[0]
+    if args.format == 'rgb565':
+        return name, to_rgb565(img, args.swap), img.width, img.height, pack_album.LV_IMG_CF_TRUE_COLOR, '.bin'
+
+    out = io.BytesIO()
+    # Restart markers need a recent Pillow, older versions ignore the option
+    img.save(out, 'JPEG', quality=args.quality, progressive=False, optimize=True, restart_marker_rows=1)
+    return name, out.getvalue(), img.width, img.height, pack_album.LV_IMG_CF_RAW, '.jpg'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--width', type=int, default=800)
+    parser.add_argument('--height', type=int, default=480)
+    parser.add_argument('--format', choices=('rgb565', 'jpeg'), default='rgb565')
+    parser.add_argument('--quality', type=int, default=90, help='JPEG quality')
+    parser.add_argument('--swap', action='store_true', help='Swap the bytes of RGB565 pixels (LV_COLOR_16_SWAP)')
+    parser.add_argument('--fill', action='store_true', help='Crop to fill the panel instead of letterboxing')
+    parser.add_argument('-o', '--output-dir', help='Also write each converted image here')
+    parser.add_argument('--pack', metavar='ALBUM', help='Write the album image for the "photos" partition')
+    parser.add_argument('--partitions', default=os.path.join(os.path.dirname(__file__), '..', 'partitions.csv'))
+    parser.add_argument('inputs', nargs='+', help='Image files or directories')
+    args = parser.parse_args()
+
+    paths = []
+    for p in args.inputs:
+        if os.path.isdir(p):
+            paths += sorted(os.path.join(p, f) for f in os.listdir(p) if f.lower().endswith(EXTENSIONS))
+        else:
+            paths.append(p)
+    if not paths:
+        sys.exit('no images in %s' % ' '.join(args.inputs))
+
+    images = []
+    for path in paths:
+        try:
+            name, data, w, h, cf, ext = convert(path, args)
+        except OSError as e:
+            sys.exit('%s: %s' % (path, e))
+        images.append((name, data, w, h, cf))
+        if args.output_dir:
+            os.makedirs(args.output_dir, exist_ok=True)
+            with open(os.path.join(args.output_dir, name + ext), 'wb') as f:
+                f.write(lvgl_bin(data, w, h) if cf == pack_album.LV_IMG_CF_TRUE_COLOR else data)
+
+    if args.pack:
+        album = pack_album.pack(images)
+        size = pack_album.partition_size(args.partitions, 'photos')
+        if len(album) > size:
+            sys.exit('album is %d bytes, partition "photos" holds %d' % (len(album), size))
+        with open(args.pack, 'wb') as f:
+            f.write(album)
+        print('%d images, %d of %d bytes' % (len(images), len(album), size))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Write the slide index (see main/slide_index.h) of a directory of a FAT12/16/32 SD card.
+
+The firmware's FatFs has no long file name support. This reads the directory straight from the card or a card image,
+pairs every long name with its 8.3 name and size, and writes the index file. Copy it into the
+directory; adding it does not change the other entries. Run it again whenever the photos change.
+
+    sync
+    sudo tools/make_slide_index.py /dev/sdX1 -o /media/$USER/CARD/slides/TPINDEX.BIN
+    tools/make_slide_index.py card.img --dir slides -o TPINDEX.BIN --list
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x58495054  # "TPIX"
+VERSION = 2
+INDEX_FILE = 'TPINDEX.BIN'
+HEADER = struct.Struct('<IHHIIIIII')
+ENTRY = struct.Struct('<IIHBB12s')
+FNV_OFFSET = 2166136261
+FNV_PRIME = 16777619
+
+ATTR_VOLUME = 0x08
+ATTR_DIR = 0x10
+ATTR_LFN = 0x0F
+
+
+def fnv1a(data, h=FNV_OFFSET):
+    for c in data:
+        h = ((h ^ c) * FNV_PRIME) & 0xFFFFFFFF
+    return h
+
+
+class Fat:
+    def __init__(self, dev):
+        self.dev = dev
+        self.base = 0
+        bs = self.read(0, 512)
+        if not self.is_bpb(bs) and bs[510:512] == b'\x55\xaa':
+            # Partitioned card or image: use the first partition
+            self.base = struct.unpack('<I', bs[446 + 8:446 + 12])[0] * 512
+            bs = self.read(0, 512)
+        if not self.is_bpb(bs):
+            raise ValueError('no FAT file system (exFAT is not supported)')
+
+        self.ss, self.csize, reserved, self.n_fats, root_entries, total16, fat16 = struct.unpack('<HBHBHHxH', bs[11:24])
+        total32, fat32, self.root_cluster = struct.unpack('<II4xI', bs[32:48])
+        self.fat_size = fat16 or fat32
+        total = total16 or total32
+        self.fat_start = reserved
+        self.root_start = reserved + self.n_fats * self.fat_size
+        self.root_sectors = (root_entries * 32 + self.ss - 1) // self.ss
+        self.data_start = self.root_start + self.root_sectors
+        clusters = (total - self.data_start) // self.csize
+        self.type = 12 if clusters < 4085 else 16 if clusters < 65525 else 32
+        self.fat = self.read(self.fat_start * self.ss, self.fat_size * self.ss)
+
+    @staticmethod
+    def is_bpb(bs):
+        ss = struct.unpack('<H', bs[11:13])[0]
+        return bs[0] in (0xEB, 0xE9) and ss in (512, 1024, 2048, 4096) and bs[13] != 0 and bs[3:11] != b'EXFAT   '
+
+    def read(self, offset, size):
+        self.dev.seek(self.base + offset)
+        data = self.dev.read(size)
+        if len(data) != size:
+            raise ValueError('short read at %d' % offset)
+        return data
+
+    def next_cluster(self, c):
+        if self.type == 32:
+            n = struct.unpack('<I', self.fat[c * 4:c * 4 + 4])[0] & 0x0FFFFFFF
+            return None if n >= 0x0FFFFFF8 else n
+        if self.type == 16:
+            n = struct.unpack('<H', self.fat[c * 2:c * 2 + 2])[0]
+            return None if n >= 0xFFF8 else n
+        n = struct.unpack('<H', self.fat[c * 3 // 2:c * 3 // 2 + 2])[0]
+        n = n >> 4 if c & 1 else n & 0xFFF
+        return None if n >= 0xFF8 else n
+
+    def read_chain(self, cluster):
+        data = b''
+        seen = set()
+        while cluster is not None and cluster >= 2 and cluster not in seen:
+            seen.add(cluster)
+            data += self.read((self.data_start + (cluster - 2) * self.csize) * self.ss, self.csize * self.ss)
+            cluster = self.next_cluster(cluster)
+        return data
+
+    def read_dir(self, cluster):
+        if cluster == 0 and self.type != 32:
+            raw = self.read(self.root_start * self.ss, self.root_sectors * self.ss)
+        else:
+            raw = self.read_chain(cluster or self.root_cluster)
+
+        lfn = {}
+        for i in range(0, len(raw), 32):
+            e = raw[i:i + 32]
+            if e[0] == 0x00:
+                break
+            if e[0] == 0xE5:
+                lfn = {}
+                continue
+            if e[11] == ATTR_LFN:
+                seq = e[0] & 0x1F
+                if e[0] & 0x40:
+                    lfn = {'sum': e[13]}
+                lfn[seq] = e[1:11] + e[14:26] + e[28:32]
+                continue
+            if e[11] & ATTR_VOLUME:
+                lfn = {}
+                continue
+
+            raw_name = bytes([0xE5]) + e[1:11] if e[0] == 0x05 else e[0:11]
+            base, ext = raw_name[:8].rstrip(b' '), raw_name[8:].rstrip(b' ')
+            short = base + (b'.' + ext if ext else b'')
+            name = None
+            if lfn and lfn.get('sum') == self.checksum(e[0:11]):
+                utf16 = b''.join(lfn[k] for k in sorted(k for k in lfn if k != 'sum'))
+                name = utf16.decode('utf-16-le', 'replace').split('\x00')[0]
+            if name is None:
+                # No long name: the 8.3 name, with the lower case flags of Windows NT
+                b = base.decode('cp437').lower() if e[12] & 0x08 else base.decode('cp437')
+                x = ext.decode('cp437').lower() if e[12] & 0x10 else ext.decode('cp437')
+                name = b + ('.' + x if x else '')
+            cluster = (struct.unpack('<H', e[20:22])[0] << 16 if self.type == 32 else 0) | struct.unpack('<H', e[26:28])[0]
+            size = struct.unpack('<I', e[28:32])[0]
+            lfn = {}
+            yield name, short, e[11], cluster, size
+
+    @staticmethod
+    def checksum(name11):
+        s = 0
+        for c in name11:
+            s = (((s & 1) << 7) + (s >> 1) + c) & 0xFF
+        return s
+
+    def find_dir(self, path):
+        cluster = 0
+        for part in [p for p in path.split('/') if p]:
+            for name, short, attr, clus, _ in self.read_dir(cluster):
+                if attr & ATTR_DIR and part.lower() in (name.lower(), short.decode('cp437').lower()):
+                    cluster = clus
+                    break
+            else:
+                raise ValueError('no directory "%s"' % path)
+        return cluster
+
+
+def build(files):
+    """files: list of (long name, short name bytes, attr, cluster, size). Returns the index file."""
+    files = sorted(files, key=lambda f: f[0].lower())
+    names = b''
+    entries = b''
+    for name, short, attr, _, size in files:
+        encoded = name.encode('utf-8')
+        entries += ENTRY.pack(size, len(names), len(encoded), attr, 0, short)
+        names += encoded + b'\x00'
+
+    body = entries + names
+    names_offset = HEADER.size + len(entries)
+    header = HEADER.pack(MAGIC, VERSION, ENTRY.size, len(files), names_offset, len(names), 0, 0, fnv1a(body))
+    return header + body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('device', help='SD card partition or image, e.g. /dev/sdX1')
+    parser.add_argument('--dir', default='slides', help='Directory to index, from the root of the card')
+    parser.add_argument('-o', '--output', default=INDEX_FILE)
+    parser.add_argument('--list', action='store_true', help='Print the indexed files')
+    args = parser.parse_args()
+
+    try:
+        with open(args.device, 'rb') as dev:
+            fat = Fat(dev)
+            files = [f for f in fat.read_dir(fat.find_dir(args.dir))
+                     if not f[2] & ATTR_DIR and f[1].upper() != INDEX_FILE.encode()]
+    except (OSError, ValueError, struct.error) as e:
+        sys.exit('%s: %s' % (args.device, e))
+
+    index = build(files)
+    with open(args.output, 'wb') as f:
+        f.write(index)
+    if args.list:
+        for name, short, _, _, size in sorted(files, key=lambda f: f[0].lower()):
+            print('%-12s %10d  %s' % (short.decode('cp437'), size, name))
+    print('FAT%d, %d files in /%s, %d bytes written to %s' % (fat.type, len(files), args.dir.strip('/'), len(index),
+                                                           args.output))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Pack photos into the image of the "photos" flash partition (see main/flash_album.h).
+
+JPEG, PNG and SJPG files are stored as they are and decoded on the device. LVGL binary images (.bin from the LVGL
+image converter, true color at the LV_COLOR_DEPTH/LV_COLOR_16_SWAP of sdkconfig) are drawn straight from flash.
+
+    tools/pack_album.py -o build/album.bin photos/*.jpg
+    parttool.py write_partition --partition-name photos --input build/album.bin
+"""
+
+import argparse
+import csv
+import os
+import struct
+import sys
+
+MAGIC = 0x4C415054  # "TPAL"
+VERSION = 1
+MAX_IMAGES = 64
+ALIGN = 64
+NAME_LEN = 16
+
+HEADER = struct.Struct('<IHHII')
+ENTRY = struct.Struct('<IIHHB3x16s')
+
+LV_IMG_CF_RAW = 1
+LV_IMG_CF_TRUE_COLOR = 4
+
+
+def jpeg_size(data):
+    i = 2
+    while i + 9 <= len(data):
+        if data[i] != 0xFF:
+            break
+        marker = data[i + 1]
+        length = struct.unpack('>H', data[i + 2:i + 4])[0]
+        if 0xC0 <= marker <= 0xCF and marker not in (0xC4, 0xC8, 0xCC):
+            h, w = struct.unpack('>HH', data[i + 5:i + 9])
+            return w, h
+        i += 2 + length
+    return 0, 0
+
+
+def load(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if not data:
+        raise ValueError('empty file')
+    if data[:2] == b'\xff\xd8':
+        w, h = jpeg_size(data)
+        return data, w, h, LV_IMG_CF_RAW
+    if data[:8] == b'\x89PNG\r\n\x1a\n':
+        w, h = struct.unpack('>II', data[16:24])
+        return data, w, h, LV_IMG_CF_RAW
+    if data[:8] == b'_SJPG__\x00':
+        w, h = struct.unpack('<HH', data[14:18])
+        return data, w, h, LV_IMG_CF_RAW
+    if path.lower().endswith('.bin') and len(data) > 4:
+        header = struct.unpack('<I', data[:4])[0]
+        cf, w, h = header & 0x1F, (header >> 10) & 0x7FF, (header >> 21) & 0x7FF
+        if cf != LV_IMG_CF_TRUE_COLOR or len(data) - 4 < w * h * 2:
+            raise ValueError('only true color LVGL images are supported')
+        return data[4:4 + w * h * 2], w, h, LV_IMG_CF_TRUE_COLOR
+    raise ValueError('unknown format')
+
+
+def pack(images):
+    """images: list of (name, data, w, h, cf). Returns the partition image."""
+    if len(images) > MAX_IMAGES:
+        raise ValueError('at most %d images' % MAX_IMAGES)
+
+    def align(n):
+        return (n + ALIGN - 1) // ALIGN * ALIGN
+
+    offset = align(HEADER.size + ENTRY.size * len(images))
+    entries = b''
+    body = b''
+    for name, data, w, h, cf in images:
+        body += b'\xff' * (offset - HEADER.size - ENTRY.size * len(images) - len(body))
+        entries += ENTRY.pack(offset, len(data), w, h, cf, name.encode()[:NAME_LEN - 1])
+        body += data
+        offset = align(offset + len(data))
+    total = HEADER.size + len(entries) + len(body)
+    return HEADER.pack(MAGIC, VERSION, len(images), total, 0) + entries + body
+
+
+def partition_size(table, label):
+    def number(s):
+        s = s.strip().upper()
+        units = {'K': 1024, 'M': 1024 * 1024}
+        return int(s[:-1], 0) * units[s[-1]] if s[-1] in units else int(s, 0)
+
+    with open(table) as f:
+        for row in csv.reader(line for line in f if not line.lstrip().startswith('#')):
+            if row and row[0].strip() == label:
+                return number(row[4])
+    raise ValueError('no partition "%s" in %s' % (label, table))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-o', '--output', required=True)
+    parser.add_argument('--partitions', default=os.path.join(os.path.dirname(__file__), '..', 'partitions.csv'))
+    parser.add_argument('--label', default='photos')
+    parser.add_argument('files', nargs='+')
+    args = parser.parse_args()
+
+    images = []
+    for path in args.files:
+        try:
+            data, w, h, cf = load(path)
+        except (OSError, ValueError, struct.error) as e:
+            sys.exit('%s: %s' % (path, e))
+        name = os.path.splitext(os.path.basename(path))[0]
+        images.append((name, data, w, h, cf))
+        print('%-16s %5d x %-5d %8d bytes%s' % (name[:NAME_LEN - 1], w, h, len(data),
+                                             '  rgb565' if cf == LV_IMG_CF_TRUE_COLOR else ''))
+
+    album = pack(images)
+    size = partition_size(args.partitions, args.label)
+    if len(album) > size:
+        sys.exit('album is %d bytes, partition "%s" holds %d' % (len(album), args.label, size))
+    with open(args.output, 'wb') as f:
+        f.write(album)
+    print('%d images, %d of %d bytes' % (len(images), len(album), size))
+
+
+if __name__ == '__main__':
+    main()